@@ -0,0 +1,52 @@
+# Writes <file>.gz and <file>.br sidecars next to each compressible static file
+# for the gzip_static and brotli_static directives. Run as a script:
+#   cmake -DPRECOMPRESS_DIR=<frontend build directory> -P cmake/Precompress.cmake
+# or through the precompress target (cmake --build . --target precompress).
+
+if (NOT IS_DIRECTORY "${PRECOMPRESS_DIR}")
+  message(FATAL_ERROR "PRECOMPRESS_DIR \"${PRECOMPRESS_DIR}\" is not a directory")
+endif()
+
+find_program(GZIP_EXECUTABLE gzip)
+find_program(BROTLI_EXECUTABLE brotli)
+if (NOT GZIP_EXECUTABLE AND NOT BROTLI_EXECUTABLE)
+  message(FATAL_ERROR "Neither gzip nor brotli found, cannot precompress")
+endif()
+if (NOT BROTLI_EXECUTABLE)
+  message(WARNING "brotli not found, only writing .gz sidecars")
+endif()
+
+# Already compressed formats (images, archives) don't shrink, so skip them
+file(GLOB_RECURSE files
+  "${PRECOMPRESS_DIR}/*.html" "${PRECOMPRESS_DIR}/*.htm"
+  "${PRECOMPRESS_DIR}/*.css" "${PRECOMPRESS_DIR}/*.js"
+  "${PRECOMPRESS_DIR}/*.json" "${PRECOMPRESS_DIR}/*.map"
+  "${PRECOMPRESS_DIR}/*.svg" "${PRECOMPRESS_DIR}/*.txt"
+  "${PRECOMPRESS_DIR}/*.xml" "${PRECOMPRESS_DIR}/*.ico"
+)
+
+foreach (file ${files})
+  file(SIZE "${file}" size)
+  if (size LESS 256) # Too small to be worth a sidecar
+    continue()
+  endif()
+  if (GZIP_EXECUTABLE) # -n omits name/timestamp so rebuilds are reproducible
+    execute_process(COMMAND "${GZIP_EXECUTABLE}" -9 -n -k -f "${file}"
+                    COMMAND_ERROR_IS_FATAL ANY)
+    file(SIZE "${file}.gz" compressed)
+    if (NOT compressed LESS size) # Compression didn't help, serve original
+      file(REMOVE "${file}.gz")
+    endif()
+  endif()
+  if (BROTLI_EXECUTABLE)
+    execute_process(COMMAND "${BROTLI_EXECUTABLE}" -q 11 -k -f "${file}"
+                    COMMAND_ERROR_IS_FATAL ANY)
+    file(SIZE "${file}.br" compressed)
+    if (NOT compressed LESS size)
+      file(REMOVE "${file}.br")
+    endif()
+  endif()
+endforeach()
+
+list(LENGTH files count)
+message(STATUS "Checked ${count} compressible file(s) in ${PRECOMPRESS_DIR}")
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <atomic>
+#include <chrono> // microseconds
 #include <ctime>
+#include <map>
+#include <mutex>
 #include <string>
 
 class Analytics final{ // Singleton class (only one instance)
@@ -15,13 +19,39 @@ public:
   /// Returns a static reference to the singleton instance of Registry.
   static Analytics& inst();
 
-  int gets = 0;
-  int posts = 0;
-  int invalid = 0;
-  int malicious = 0;
-  int health = 0;
+  /**
+   * Records a completed TLS handshake.
+   *
+   * @param protocol The negotiated protocol version (e.g., "TLSv1.3").
+   * @param cipher The negotiated cipher (e.g., "TLS_AES_256_GCM_SHA384").
+   * @param resumed Whether the session was resumed (cache or ticket).
+   * @param latency Time from the accepted connection to the finished handshake.
+   */
+  void record_handshake(const std::string& protocol, const std::string& cipher,
+                        bool resumed, std::chrono::microseconds latency);
+
+  // Atomic because sessions on different worker threads update concurrently
+  std::atomic<int> gets = 0;
+  std::atomic<int> posts = 0;
+  std::atomic<int> invalid = 0;
+  std::atomic<int> malicious = 0;
+  std::atomic<int> health = 0;
+  std::atomic<int> tls_handshakes = 0; // Completed, including resumed
+  std::atomic<int> tls_resumed = 0; // From the session cache or a ticket
+  std::atomic<int> handshakes_queued = 0; // Waiting for a HandshakePool thread
+  std::atomic<int> handshakes_queued_peak = 0;
+  std::atomic<int> http2_connections = 0; // TLS connections that selected h2
+  std::atomic<int> http3_connections = 0; // QUIC connections (listen quic)
 
 private:
   Analytics(){}; // Making constructor private due to being a singleton class
   std::time_t start_time = std::time(0);
+
+  struct HandshakeStats{
+    int count = 0;
+    std::chrono::microseconds latency{0}; // Sum, for the average
+  };
+  std::mutex handshakes_mutex; // Guards the maps below
+  std::map<std::string, HandshakeStats> protocols; // By protocol version
+  std::map<std::string, HandshakeStats> ciphers; // By cipher name
 };
\ No newline at end of file
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <boost/asio/io_context.hpp> // io_context
+#include <boost/asio/posix/stream_descriptor.hpp> // stream_descriptor
+#include <cstdint> // int64_t
+#include <list>
+#include <memory> // shared_ptr, unique_ptr
+#include <mutex>
+#include <string>
+#include <sys/inotify.h> // inotify_event
+#include <sys/stat.h> // stat
+#include <unordered_map>
+
+class FileCache final{ // Singleton class (only one instance)
+public:
+  // Deleting the copy and assignment operators due to being a singleton class
+  FileCache(const FileCache&) = delete;
+  FileCache& operator=(const FileCache&) = delete;
+
+  /// Returns a static reference to the singleton instance of FileCache.
+  static FileCache& inst();
+
+  // Larger files aren't cached, sendfile(2) serves them from the page cache
+  enum{max_entry_size = 1048576};
+  // Files whose validators are memoized, independent of max_size()
+  enum{max_metadata = 16384};
+
+  struct Entry{
+    std::shared_ptr<const std::string> body; // Immutable, shared by responses
+    std::string content_type;
+    std::string last_modified; // HTTP date for the Last-Modified header
+    std::int64_t mtime_ns = 0; // Modification time when body was read
+    std::string etag; // Strong entity tag (hash of body) for the ETag header
+  };
+
+  /**
+   * Sets the memory budget, evicting least recently used entries to fit.
+   *
+   * @param bytes The most body bytes the cache may hold, 0 disables it.
+   */
+  void max_size(size_t bytes);
+
+  /// Returns the memory budget in bytes (0 if the cache is disabled).
+  size_t max_size();
+
+  /// Returns the number of body bytes currently cached.
+  size_t size();
+
+  /**
+   * Starts watching the directories of cached files with inotify, so that
+   * hits need no syscalls. Until then, each hit is validated with stat(2).
+   *
+   * @param io_context The IO context that reads inotify events.
+   * @returns true if inotify is available, false to keep validating hits.
+   */
+  bool watch(boost::asio::io_context& io_context);
+
+  /// Stops watching for changes, falling back to validating hits with stat.
+  void unwatch();
+
+  /**
+   * Looks up a file and marks it as most recently used.
+   *
+   * @param path A normalized absolute file path.
+   * @returns The cached entry, or nullptr on a miss or if the file changed.
+   */
+  std::shared_ptr<const Entry> find(const std::string& path);
+
+  /**
+   * Caches a file read from disk. Rejected if the cache is disabled, the body
+   * doesn't fit, or the file changed since entry.mtime_ns.
+   *
+   * @param path A normalized absolute file path.
+   * @param entry The file's contents and headers.
+   * @returns true if the entry was cached.
+   */
+  bool insert(const std::string& path, const Entry& entry);
+
+  /**
+   * Looks up the memoized validators of a file version, so that they are
+   * computed once per version even for files too large to cache.
+   *
+   * @param[in] path A normalized absolute file path.
+   * @param[in] info The current stat(2) of the file.
+   * @param[out] etag The strong entity tag of this version.
+   * @param[out] last_modified The HTTP date of this version.
+   * @returns true if this version of the file was memoized.
+   */
+  bool find_metadata(const std::string& path, const struct stat& info,
+                     std::string& etag, std::string& last_modified);
+
+  /**
+   * Memoizes the validators of a file version (see find_metadata).
+   *
+   * @param path A normalized absolute file path.
+   * @param info The stat(2) of the file the validators were computed from.
+   * @param etag The strong entity tag of this version.
+   * @param last_modified The HTTP date of this version.
+   */
+  void insert_metadata(const std::string& path, const struct stat& info,
+                       const std::string& etag, const std::string& last_modified);
+
+  /// Drops all cached entries and memoized validators.
+  void clear();
+
+private:
+  FileCache(){}; // Making constructor private due to being a singleton class
+  void read_events();
+  void handle_events(const boost::system::error_code& error, size_t bytes);
+  void erase(const std::string& path);
+  void erase_dir(const std::string& dir);
+  void erase_all();
+  void evict();
+
+  struct Slot{
+    std::shared_ptr<const Entry> entry;
+    std::list<std::string>::iterator lru; // Position in lru_
+  };
+
+  std::mutex mutex_; // Guards everything below, sessions run on many threads
+  std::unordered_map<std::string, Slot> entries_;
+  std::list<std::string> lru_; // Cached paths, most recently used first
+  size_t size_ = 0;
+  size_t max_size_ = 0;
+
+  struct Metadata{ // Validators of one version of a file
+    std::int64_t mtime_ns;
+    off_t size;
+    ino_t inode;
+    std::string etag;
+    std::string last_modified;
+  };
+  std::unordered_map<std::string, Metadata> metadata_;
+
+  // inotify state, only used after watch() succeeds
+  std::unique_ptr<boost::asio::posix::stream_descriptor> events_;
+  std::unordered_map<int, std::string> watches_; // Watch descriptor -> dir
+  alignas(inotify_event) char event_buffer_[4096];
+};
\ No newline at end of file
@@ -4,6 +4,10 @@
 
 class FileRequestHandler : public RequestHandler{
 public:
+  /* Files up to this size get an ETag hashed from their contents, on the IO
+     thread. Larger ones get one from their mtime and size, like Nginx's. */
+  enum{hash_max_size = 16777216};
+
   /** 
    * Generates a response to a given GET request.
    *
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <boost/asio/post.hpp> // post
+#include <boost/asio/thread_pool.hpp> // thread_pool
+#include <memory> // unique_ptr
+#include <utility> // move
+
+#include "analytics.h" // Analytics::inst()
+
+/* Threads that run the asymmetric crypto of TLS handshakes, so a burst of
+   new clients doesn't delay the requests of established connections on the
+   worker threads. Sessions still wait for the socket on their own IO
+   context, only the OpenSSL calls hop to the pool (see tls_stream). */
+class HandshakePool final{ // Singleton class (only one instance)
+public:
+  // Deleting the copy and assignment operators due to being a singleton class
+  HandshakePool(const HandshakePool&) = delete;
+  HandshakePool& operator=(const HandshakePool&) = delete;
+
+  /// Returns a static reference to the singleton instance of HandshakePool.
+  static HandshakePool& inst();
+
+  /**
+   * Starts the pool. Until then, handshakes run on the worker threads.
+   *
+   * @param threads The number of pool threads, 0 leaves the pool disabled.
+   */
+  void start(unsigned threads);
+
+  /// Waits for queued handshake steps, then joins the pool threads.
+  void stop();
+
+  /// Returns true if handshakes should be posted to the pool.
+  bool enabled(){return pool_ != nullptr;}
+
+  /**
+   * Queues a handshake step, counted by Analytics until a pool thread runs it.
+   *
+   * @pre enabled() is true.
+   * @param handler The step to run, invoked without arguments.
+   */
+  template <class Handler>
+  void post(Handler&& handler){
+    int depth = ++Analytics::inst().handshakes_queued;
+    int peak = Analytics::inst().handshakes_queued_peak;
+    while (depth > peak &&
+           !Analytics::inst().handshakes_queued_peak.compare_exchange_weak(peak, depth));
+    /* Wrapped so that the step runs on the pool. post() would otherwise
+       dispatch it to the handler's own executor, i.e., the worker thread. */
+    boost::asio::post(*pool_, [handler = std::move(handler)]() mutable{
+      Analytics::inst().handshakes_queued--;
+      handler();
+    });
+  }
+
+private:
+  HandshakePool(){}; // Making constructor private due to being a singleton class
+  std::unique_ptr<boost::asio::thread_pool> pool_;
+};
\ No newline at end of file
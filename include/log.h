@@ -10,7 +10,7 @@ public:
     std::string invalid_req;
   };
 
-  /// Machine-parseable log for response metrics.
+  /// Machine-parseable log for response metrics. Safe to call from any thread.
   static void res_metrics(
     const std::string& client_ip,
     req_info& req,
@@ -18,7 +18,7 @@ public:
     unsigned response_code
   );
 
-  /// Convenience wrappers for BOOST_LOG_TRIVIAL macros.
+  /// Convenience wrappers for BOOST_LOG_TRIVIAL macros (thread-safe).
   static void debug(const std::string& source, const std::string& msg);
   static void error(const std::string& source, const std::string& msg);
   static void fatal(const std::string& source, const std::string& msg);
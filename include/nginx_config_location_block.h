@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef> // size_t
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -21,6 +23,13 @@ struct LocationBlock{
   // Can override index and root of containing server block
   std::string index = "";
   std::string root = "";
+  // Directory descriptor of root, opened by Config::validate() (-1 if none)
+  int root_fd = -1;
+  // Can override client_max_body_size of containing server block
+  std::optional<size_t> client_max_body_size;
+  // Can override gzip_static and brotli_static of containing server block
+  std::optional<bool> gzip_static;
+  std::optional<bool> brotli_static;
 
   /* If this location block specified (optional) try_files directive:
    * - try_files_args stores the relative paths to try.
@@ -29,4 +38,16 @@ struct LocationBlock{
    **/
   std::vector<std::string> try_files_args;
   std::string try_files_fallback = "";
+
+  /* try_files compiled by Config::validate(), so that a request only has to
+   * concatenate its target into it:
+   * - try_files_paths stores each of try_files_args split at its $uri
+   *   variables, with root + "/" joined to the first segment.
+   * - try_files_fallback_status stores the code of a return code fallback,
+   *   or -1 if the fallback is a URI.
+   * - try_files_fallback_path stores root + "/" + the fallback URI.
+   **/
+  std::vector<std::vector<std::string>> try_files_paths;
+  int try_files_fallback_status = -1;
+  std::string try_files_fallback_path = "";
 };
\ No newline at end of file
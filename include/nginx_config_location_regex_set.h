@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory> // unique_ptr
+#include <string>
+#include <vector>
+
+#include "nginx_config_location_block.h" // LocationBlock
+
+/* Regex match (~ and ~*) location blocks of a server block, compiled by
+   Config::validate() into one RE2 set. A request target is matched against
+   all of them in a single linear-time pass (RE2's DFA, no backtracking), and
+   the first block in config order that matches wins, as in Nginx. Does not
+   own the location blocks. */
+class LocationRegexSet{
+ public:
+  LocationRegexSet();
+  ~LocationRegexSet(); // Defined where the RE2 set is a complete type
+
+  /**
+   * Compiles the patterns of the regex match location blocks, replacing any
+   * compiled before. ~* patterns are matched case-insensitively.
+   *
+   * @param locations Regex match location blocks that outlive the set, in
+   *   config order.
+   * @returns true on success, false if a pattern isn't valid RE2 syntax.
+   */
+  bool compile(const std::vector<LocationBlock*>& locations);
+
+  /**
+   * Finds the first regex match location block whose pattern matches the
+   * path of the request target (the query string is not matched).
+   *
+   * @pre compile() succeeded.
+   * @param req_target The target URI of the incoming request.
+   * @returns A pointer to the matching location block, or nullptr if none.
+   */
+  LocationBlock* find(const std::string& req_target) const;
+
+ private:
+  struct Set; // re2::RE2::Set, kept out of this header
+  std::unique_ptr<Set> set_; // nullptr if there are no regex blocks
+  std::vector<LocationBlock*> locations_; // By index in set_
+};
\ No newline at end of file
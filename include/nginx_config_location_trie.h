@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory> // unique_ptr
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nginx_config_location_block.h" // LocationBlock
+
+/* Location blocks of a server block, compiled by Config::validate() so that
+   a request target is resolved in one walk over its characters. Exact match
+   (=) URIs are looked up in a hash table, and prefix match (^~ and none) URIs
+   are stored in a compressed (radix) trie, whose nodes hold the blocks whose
+   URI ends there. Does not own the location blocks. */
+class LocationTrie{
+ public:
+  /// Removes all location blocks.
+  void clear();
+
+  /**
+   * Adds an exact match or prefix match location block. If another block
+   * with the same modifier and URI was added first, that one is kept.
+   *
+   * @param location A pointer to a location block that outlives the trie.
+   */
+  void insert(LocationBlock* location);
+
+  /**
+   * Resolves request target URI to a location block with Nginx precedence:
+   * an exact match, else the longest prefix match, where a prefix match with
+   * stop modifier (^~) is only used if it is strictly the longest.
+   *
+   * @param req_target The target URI of the incoming request.
+   * @returns A pointer to the matching location block, or nullptr if none.
+   */
+  LocationBlock* find(const std::string& req_target) const;
+
+ private:
+  struct Node{
+    std::string edge; // Characters between the parent node and this one
+    LocationBlock* prefix = nullptr; // No modifier, URI ends at this node
+    LocationBlock* prefix_stop = nullptr; // ^~, URI ends at this node
+    // Sorted by the first character of their edge, which is unique
+    std::vector<std::unique_ptr<Node>> children;
+  };
+
+  static const Node* child(const Node& node, char c);
+
+  std::unordered_map<std::string, LocationBlock*> exact_; // By URI
+  Node root_; // Empty edge, the empty prefix
+};
\ No newline at end of file
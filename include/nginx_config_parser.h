@@ -1,6 +1,7 @@
 #pragma once
 
 #include <boost/filesystem/fstream.hpp> // ifstream
+#include <memory> // shared_ptr
 #include <vector>
 
 #include "nginx_config_location_block.h" // LocationBlock
@@ -23,6 +24,15 @@ class ConfigParser final{ // Singleton class (only one instance)
    */
   std::vector<Config*> configs();
 
+  /** 
+   * Returns the parsed Config objects as a snapshot that outlives the next
+   * parse(), e.g., for the servers and sessions of a running webserver.
+   * 
+   * @pre parse() succeeded.
+   * @returns ConfigParser.configs_, shared with the caller.
+   */
+  std::vector<std::shared_ptr<Config>> snapshot();
+
   /** 
    * Sets the working directory for conversion of relative paths.
    * 
@@ -30,9 +40,89 @@ class ConfigParser final{ // Singleton class (only one instance)
    *   directory.
    */
   void set_working_directory(const std::string& cwd);
+
+  /** 
+   * Returns the number of threads that should run the IO context.
+   * 
+   * @pre parse() succeeded.
+   * @returns The value of the worker_threads directive if specified, else the
+   *   number of hardware threads (at least 1).
+   */
+  unsigned worker_threads();
+
+  enum WorkerMode{
+    SHARED_WORKERS = 0, // All worker threads run one shared IO context
+    SHARDED_WORKERS = 1 // Each worker thread runs its own IO context/acceptors
+  };
+
+  /** 
+   * Returns how worker threads divide up the servers' IO.
+   * 
+   * @pre parse() succeeded.
+   * @returns The value of the worker_mode directive if specified, else
+   *   SHARED_WORKERS.
+   */
+  WorkerMode worker_mode();
+
+  /** 
+   * Returns the size of the TLS handshake thread pool (see HandshakePool).
+   * 
+   * @pre parse() succeeded.
+   * @returns The value of the ssl_handshake_threads directive if specified,
+   *   else 0 (handshakes run on the worker threads).
+   */
+  unsigned ssl_handshake_threads();
+
+  /** 
+   * Returns the memory budget of the static file cache (see FileCache).
+   * 
+   * @pre parse() succeeded.
+   * @returns The value of the open_cache_max_size directive in bytes if
+   *   specified, else 0 (cache disabled).
+   */
+  size_t open_cache_max_size();
+
+  /** 
+   * Returns the most paths OpenFileCache may hold.
+   * 
+   * @pre parse() succeeded.
+   * @returns The max parameter of the open_file_cache directive if specified,
+   *   else 0 (open_file_cache off).
+   */
+  size_t open_file_cache_max();
+
+  /** 
+   * Returns how long OpenFileCache keeps paths that aren't looked up.
+   * 
+   * @pre parse() succeeded.
+   * @returns The inactive parameter of the open_file_cache directive in
+   *   seconds if specified, else 60.
+   */
+  long open_file_cache_inactive();
+
+  /** 
+   * Returns how often OpenFileCache checks cached paths on disk.
+   * 
+   * @pre parse() succeeded.
+   * @returns The value of the open_file_cache_valid directive in seconds if
+   *   specified, else 60.
+   */
+  long open_file_cache_valid();
+
+  /** 
+   * Returns whether OpenFileCache caches paths that don't exist.
+   * 
+   * @pre parse() succeeded.
+   * @returns The value of the open_file_cache_errors directive if specified,
+   *   else false.
+   */
+  bool open_file_cache_errors();
   
   /** 
    * Parses the specified config file and populates ConfigParser.configs_.
+   * Replaces the results of an earlier parse(), so that the same file can be
+   * parsed again when it changes (see reload_config() in server_main.cc). A
+   * parse error leaves the earlier results in place.
    * 
    * @param file_path A string containing the path to the config file.
    * @returns true on successful parse, false on parse error.
@@ -41,6 +131,7 @@ class ConfigParser final{ // Singleton class (only one instance)
 
  private:
   ConfigParser(){}; // Making constructor private due to being a singleton class
+  void commit(ConfigParser& staged);
   bool parse(boost::filesystem::ifstream& cfg_in);
   bool parse_block_start(std::vector<std::string>& statement);
   bool parse_block_end(std::vector<std::string>& statement);
@@ -60,6 +151,10 @@ class ConfigParser final{ // Singleton class (only one instance)
   };
 
   std::string clean(const std::string& path, PathType type);
+  bool parse_size(const std::string& value, size_t& size);
+  bool parse_flag(const std::string& value, bool& flag);
+  bool parse_time(const std::string& value, long& seconds);
+  bool parse_session_cache(const std::string& value, size_t& sessions);
 
   enum TokenType{
     INVALID = -1,
@@ -86,10 +181,23 @@ class ConfigParser final{ // Singleton class (only one instance)
 
   // Tracking variables used during parse()
   Context context = MAIN_CONTEXT;
-  LocationBlock* cur_location_block;
-  Config* cur_config;
+  LocationBlock* cur_location_block = nullptr;
+  Config* cur_config = nullptr;
   std::string cwd_;
 
+  // Main context parameters, 0 means "auto" (one per hardware thread)
+  unsigned worker_threads_ = 0;
+  WorkerMode worker_mode_ = SHARED_WORKERS;
+  unsigned ssl_handshake_threads_ = 0; // 0 runs handshakes on the workers
+
+  // HTTP context parameters, 0 disables the static file cache
+  size_t open_cache_max_size_ = 0;
+  // Open file cache parameters, max 0 disables it (times in seconds)
+  size_t open_file_cache_max_ = 0;
+  long open_file_cache_inactive_ = 60;
+  long open_file_cache_valid_ = 60;
+  bool open_file_cache_errors_ = false;
+
   // Contains parsed Config objects after parse() completes
-  std::vector<Config*> configs_;
+  std::vector<std::shared_ptr<Config>> configs_;
 };
@@ -1,34 +1,101 @@
 #pragma once
 
+#include <cstddef> // size_t
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 #include "nginx_config_location_block.h" // LocationBlock
+#include "nginx_config_location_regex_set.h" // LocationRegexSet
+#include "nginx_config_location_trie.h" // LocationTrie
 
 class Config{
  public:
+  Config() = default;
+  /// Frees the location blocks and closes the root directories.
+  ~Config();
+  // Not copyable, copies would free the same location blocks
+  Config(const Config&) = delete;
+  Config& operator=(const Config&) = delete;
+
   /// Validates the individual server block stored by the Config object.
   bool validate();
 
+  /** 
+   * Resolves request target URI to a location block in this server block.
+   *
+   * @pre ConfigParser::parse() succeeded.
+   * @param req_target The target URI of the incoming request.
+   * @returns A pointer to the matching location block, or nullptr if none.
+   */
+  LocationBlock* get_location(const std::string& req_target);
+
+  /** 
+   * Decodes the path of a request target (e.g., "/a%20b.html?v=1" becomes
+   * "/a b.html"), which locations are matched and files looked up by (like
+   * Nginx's $uri).
+   *
+   * @param req_target The target URI of the incoming request.
+   * @param uri Set to the decoded path, without the query string.
+   * @returns False if a percent-encoding is invalid or decodes to NUL.
+   */
+  static bool decode_uri(std::string_view req_target, std::string& uri);
+
+  /** 
+   * Returns the client_max_body_size of the location block that a request
+   * target is routed to, or of this server block if none (0 is unlimited).
+   *
+   * @pre ConfigParser::parse() succeeded.
+   * @param req_target The target URI of the incoming request.
+   */
+  size_t body_limit(std::string_view req_target);
+
   enum ServerType{
     HTTP_SERVER = 0,
     HTTPS_SERVER = 1
   };
 
+  // Bits of ssl_protocols
+  enum SSLProtocol{
+    TLS_V1 = 1,
+    TLS_V1_1 = 2,
+    TLS_V1_2 = 4,
+    TLS_V1_3 = 8
+  };
+
   // Defined by all server blocks
   ServerType type = HTTP_SERVER;
 
   // Standard parameters
   unsigned short port = 80; // Default value, may be overriden. 0 - 65535
+  unsigned short quic_port = 0; // UDP port of listen <port> quic, 0 is none
   std::string index = "index.html"; // Default value, may be overriden.
   std::string root = "html"; // Default value, may be overriden.
+  // Directory descriptor of root for files beneath it, opened by validate()
+  int root_fd = -1; // -1 if root couldn't be opened
   std::string host = "";
+  // Largest accepted request body in bytes, 0 disables the check
+  size_t client_max_body_size = 1048576; // Default value (1m), may be overriden.
+  // Serve precompressed <file>.gz/<file>.br sidecars when the client accepts them
+  bool gzip_static = false;
+  bool brotli_static = false;
   // Return statement parameters
   short ret = 0;
   std::string ret_val = "";
   // SSL parameters
-  std::string certificate = "";
-  std::string private_key = "";
+  // Paired by position, e.g., an RSA and an ECDSA chain picked per client
+  std::vector<std::string> certificates;
+  std::vector<std::string> private_keys;
+  bool ktls = true; // Let the kernel encrypt records (kTLS) if it supports it
+  size_t ssl_session_cache = 0; // Sessions cached by the server, 0 disables
+  bool ssl_session_tickets = true; // Resume from client-held encrypted tickets
+  long ssl_session_timeout = 300; // Seconds a session can be resumed (5m)
+  int ssl_protocols = TLS_V1_2 | TLS_V1_3; // SSLProtocol bits, Nginx default
+  // OpenSSL cipher list, TLS_* names select TLS 1.3 cipher suites
+  std::string ssl_ciphers = "HIGH:!aNULL:!MD5"; // Nginx default
+  std::string ssl_ecdh_curve = "auto"; // Key exchange groups, by preference
+  bool http2 = false; // Offer h2 with ALPN (needs -DENABLE_HTTP2=ON)
 
   // location directives defined within this server block
   // 0: Exact match (=)
@@ -36,4 +103,14 @@ class Config{
   // 2: Regex match (case-sensitive or case-insensitive) (~, ~*)
   // 3: No modifier
   std::vector<LocationBlock*> locations[4];
+  // Exact and prefix match blocks of locations, built by validate()
+  LocationTrie location_trie;
+  // Regex match blocks of locations, compiled by validate()
+  LocationRegexSet location_regexes;
+
+ private:
+  int open_root(const std::string& dir);
+
+  // Each distinct root of this server block is opened once
+  std::unordered_map<std::string, int> root_fds_;
 };
\ No newline at end of file
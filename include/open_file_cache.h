@@ -0,0 +1,92 @@
+#pragma once
+
+#include <boost/beast/http/file_body.hpp> // file_body
+#include <chrono> // seconds, steady_clock
+#include <list>
+#include <memory> // shared_ptr
+#include <mutex>
+#include <string>
+#include <sys/stat.h> // stat
+#include <unordered_map>
+
+/* Caches the results of looking up files, like Nginx's open_file_cache: open
+   descriptors of regular files, their stat(2), directories, and (optionally)
+   files that don't exist. Entries are trusted for the validity period, so
+   repeated lookups of the same path (e.g., try_files probing a missing $uri
+   before falling back to index.html) make no syscalls. A file changed within
+   the validity period may be served in its previous version until then.
+
+   Files are looked up with openat2(2) beneath the descriptor of their root
+   directory, so no path (e.g., with "..", or a symlink out of the root) can
+   resolve to a file outside of it. */
+class OpenFileCache final{ // Singleton class (only one instance)
+public:
+  // Deleting the copy and assignment operators due to being a singleton class
+  OpenFileCache(const OpenFileCache&) = delete;
+  OpenFileCache& operator=(const OpenFileCache&) = delete;
+
+  /// Returns a static reference to the singleton instance of OpenFileCache.
+  static OpenFileCache& inst();
+
+  struct File{
+    bool exists = false; // false if stat(2) failed, e.g., no such file
+    bool directory = false;
+    struct stat info = {}; // Zeroed if the file doesn't exist
+    /* Open regular file, or nullptr if not a regular file or it failed to
+       open. Shared by every response sending it, which must read it at
+       explicit offsets (sendfile, pread) rather than seek it. */
+    std::shared_ptr<boost::beast::http::file_body::value_type> body;
+  };
+
+  /**
+   * Sets the limits of the cache, dropping entries that no longer fit.
+   *
+   * @param max The most paths to cache, 0 disables the cache.
+   * @param inactive Entries not looked up for this long are dropped.
+   * @param valid Entries are checked against the file system this often.
+   * @param errors Whether to cache paths that don't exist.
+   */
+  void configure(size_t max, std::chrono::seconds inactive,
+                 std::chrono::seconds valid, bool errors);
+
+  /// Returns the number of cached paths.
+  size_t size();
+
+  /**
+   * Looks up a path, from the cache if it was looked up within the validity
+   * period, else from the file system (then caching it, if enabled).
+   *
+   * @param root_fd A descriptor of the root directory, or -1 if it couldn't
+   *   be opened (then no file exists).
+   * @param path A file system path starting with the root directory, cached
+   *   as given (not normalized).
+   * @param root_length The length of the root directory in path. The rest of
+   *   path is resolved beneath root_fd.
+   * @returns The file, never nullptr.
+   */
+  std::shared_ptr<const File> find(int root_fd, const std::string& path,
+                                   size_t root_length);
+
+  /// Drops all cached paths, closing descriptors no response is using.
+  void clear();
+
+private:
+  OpenFileCache(){}; // Making constructor private due to being a singleton class
+  void evict(std::chrono::steady_clock::time_point now);
+
+  struct Slot{
+    std::shared_ptr<const File> file;
+    size_t root_length; // Part of the path file was looked up beneath
+    std::chrono::steady_clock::time_point validated; // Last checked on disk
+    std::chrono::steady_clock::time_point used; // Last looked up
+    std::list<std::string>::iterator lru; // Position in lru_
+  };
+
+  std::mutex mutex_; // Guards everything below, sessions run on many threads
+  std::unordered_map<std::string, Slot> entries_;
+  std::list<std::string> lru_; // Cached paths, most recently used first
+  size_t max_ = 0;
+  std::chrono::seconds inactive_{60};
+  std::chrono::seconds valid_{60};
+  bool errors_ = false;
+};
\ No newline at end of file
@@ -22,8 +22,18 @@ public:
    */
   void init_config(Config* config){config_ = config;}
 
+  /** 
+   * Sets the file holding the request body when the session spilled it to
+   * disk instead of buffering it (req.body() is then empty). Override not
+   * required; the session deletes the file after handle_request() returns.
+   *
+   * @param path The path of the spilled request body, or "" if in memory.
+   */
+  void init_body_file(const std::string& path){body_file_ = path;}
+
 protected:
   Config* config_;
+  std::string body_file_ = ""; // Empty if the body is in req.body()
 };
 
 class RequestHandlerFactory{ // Pure virtual class (interface)
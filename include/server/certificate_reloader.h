@@ -0,0 +1,69 @@
+#pragma once
+
+#include <boost/asio.hpp> // io_context, posix::stream_descriptor, steady_timer
+#include <atomic>
+#include <memory> // enable_shared_from_this, shared_ptr
+#include <string>
+#include <sys/inotify.h> // inotify_event
+#include <unordered_map>
+#include <unordered_set>
+
+#include "nginx_config_server_block.h" // Config
+#include "server/tls_context.h" // tls_context
+
+/* Current TLS context of one HTTPS server block. Watches the directories of
+   its ssl_certificate and ssl_certificate_key files with inotify, and builds
+   a new tls_context on its own thread when they change. New sessions get the
+   new context, sessions already running keep theirs until they close. */
+class certificate_reloader
+  : public std::enable_shared_from_this<certificate_reloader>{
+public:
+  /**
+   * Returns the reloader of a server block, creating it and its first
+   * tls_context on first use.
+   *
+   * @pre ConfigParser::parse() succeeded.
+   * @param config The parsed Config object of an HTTPS server.
+   * @param io_context The IO context that reads inotify events and runs the
+   *   ticket key rotation timers.
+   * @returns The reloader shared by all https_server instances of config.
+   * @throws boost::system::system_error If the first tls_context fails.
+   */
+  static std::shared_ptr<certificate_reloader> get(
+    const std::shared_ptr<Config>& config, boost::asio::io_context& io_context);
+
+  /**
+   * Builds the first tls_context and starts watching. Use get() instead.
+   *
+   * @param config The parsed Config object of an HTTPS server.
+   * @param io_context The IO context that reads inotify events.
+   */
+  certificate_reloader(std::shared_ptr<Config> config,
+                       boost::asio::io_context& io_context);
+
+  /// Waits for a reload in progress, then stops watching.
+  ~certificate_reloader();
+
+  /// Returns the context for a new session. Safe to call from any thread.
+  std::shared_ptr<tls_context> context(){return context_.load();}
+
+private:
+  void read_events();
+  void handle_events(const boost::system::error_code& error, size_t bytes);
+  void reload();
+
+  // Certificate updates often write several files (e.g., cert, then key), so
+  // the reload waits until no change was seen for reload_delay_ms
+  enum{reload_delay_ms = 1000};
+
+  std::shared_ptr<Config> config_; // Read by reload() on reload_thread_
+  boost::asio::io_context& io_context_;
+  std::atomic<std::shared_ptr<tls_context>> context_;
+  boost::asio::strand<boost::asio::io_context::executor_type> strand_;
+  std::unique_ptr<boost::asio::posix::stream_descriptor> events_; // inotify
+  std::unordered_map<int, std::string> watches_; // Watch descriptor -> dir
+  std::unordered_set<std::string> files_; // Certificate and key paths
+  boost::asio::steady_timer delay_timer_;
+  boost::asio::thread_pool reload_thread_{1}; // Keeps OpenSSL's parsing off the IO threads
+  alignas(inotify_event) char event_buffer_[4096];
+};
\ No newline at end of file
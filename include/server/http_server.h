@@ -8,11 +8,16 @@ public:
    * Initializes the server and starts listening for incoming connections.
    *
    * @pre ConfigParser::parse() succeeded.
-   * @param config A pointer to a parsed Config object that supplies server parameters.
+   * @param config The parsed Config object that supplies server parameters.
    * @param io_context A reference to boost::asio::io_context supplied by main.
+   * @param shared_port If true, binds with SO_REUSEPORT (see server::server).
    */
-  http_server(Config* config, boost::asio::io_context& io_context);
+  http_server(std::shared_ptr<Config> config, boost::asio::io_context& io_context,
+              bool shared_port = false);
 
 private:
   void start_accept() override;
+  void handle_http_accept(std::shared_ptr<session_base> new_session,
+                          std::shared_ptr<Config> config,
+                          const boost::system::error_code& error);
 };
\ No newline at end of file
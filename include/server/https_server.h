@@ -1,8 +1,12 @@
 #pragma once
 
-#include <boost/asio/ssl.hpp> // ssl::context
+#include <memory> // shared_ptr
 
+#include "server/certificate_reloader.h" // certificate_reloader
 #include "server/server.h" // server
+#ifdef ENABLE_HTTP3
+#include "server/quic_server.h" // quic_server
+#endif
 
 class https_server : public server{
 public:
@@ -10,13 +14,37 @@ public:
    * Initializes the server and starts listening for incoming connections.
    *
    * @pre ConfigParser::parse() succeeded.
-   * @param config A pointer to a parsed Config object that supplies server parameters.
+   * @param config The parsed Config object that supplies server parameters.
    * @param io_context A reference to boost::asio::io_context supplied by main.
+   * @param shared_port If true, binds with SO_REUSEPORT (see server::server).
    */
-  https_server(Config* config, boost::asio::io_context& io_context);
+  https_server(std::shared_ptr<Config> config, boost::asio::io_context& io_context,
+               bool shared_port = false);
+
+  /** 
+   * Gives sessions accepted from now on a new Config and a TLS context built
+   * from its certificates. The UDP port of listen quic isn't reopened.
+   *
+   * @param config The reparsed Config object of this server's port.
+   * @throws boost::system::system_error If the TLS context fails, in which
+   *   case the server keeps its current config and certificates.
+   */
+  void reconfigure(std::shared_ptr<Config> config) override;
+
+  /// Stops accepting connections on the TCP port and the UDP port of quic.
+  void close() override;
 
 private:
   void start_accept() override;
+  void handle_tls_accept(std::shared_ptr<session_base> new_session,
+                         std::shared_ptr<Config> config,
+                         std::shared_ptr<tls_context> context,
+                         const boost::system::error_code& error);
   
-  boost::asio::ssl::context ssl_context_;
+  // TLS context for new sessions, shared with the servers of other worker threads
+  std::shared_ptr<certificate_reloader> certificates_;
+  unsigned short quic_port_; // Of the first config, kept until restart
+#ifdef ENABLE_HTTP3
+  std::unique_ptr<quic_server> quic_server_; // listen <port> quic, else null
+#endif
 };
\ No newline at end of file
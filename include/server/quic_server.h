@@ -0,0 +1,145 @@
+#pragma once
+
+#include <boost/asio.hpp> // io_context, ip::udp, steady_timer
+#include <boost/beast/core/file.hpp> // file
+#include <cstdint> // uint8_t, uint64_t
+#include <map>
+#include <memory> // shared_ptr, unique_ptr
+#include <quiche.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "log.h" // req_info
+#include "nginx_config_server_block.h" // Config
+#include "server/certificate_reloader.h" // certificate_reloader
+#include "typedefs/http.h" // Request, Response
+
+/* Experimental HTTP/3 endpoint of an HTTPS server block (listen <port> quic),
+   on a UDP socket. quiche handles QUIC (loss recovery, congestion control,
+   TLS 1.3) and HTTP/3 framing with QPACK; each complete request stream is
+   answered by RequestHandler dispatch, like an HTTP/1.1 request. Built with
+   -DENABLE_HTTP3=ON. */
+class quic_server{
+public:
+  /**
+   * Binds the UDP socket and starts receiving packets.
+   *
+   * @pre ConfigParser::parse() succeeded.
+   * @param config The parsed Config object of an HTTPS server with a
+   *   quic_port. Its first ssl_certificate is used.
+   * @param certificates The reloader of the HTTPS server's certificates. New
+   *   connections load them again once it has reloaded them.
+   * @param io_context A reference to boost::asio::io_context supplied by main.
+   * @param shared_port If true, binds with SO_REUSEPORT (see server::server).
+   * @throws std::runtime_error If the certificate or key fails to load.
+   */
+  quic_server(std::shared_ptr<Config> config,
+              std::shared_ptr<certificate_reloader> certificates,
+              boost::asio::io_context& io_context, bool shared_port = false);
+  ~quic_server();
+
+  /** 
+   * Dispatches the requests of streams from now on with a new Config of the
+   * same server block (see server::reconfigure), and loads its certificate
+   * for new connections.
+   *
+   * @param config The reparsed Config object, with the same quic_port.
+   * @param certificates The reloader of config's certificates.
+   */
+  void reconfigure(std::shared_ptr<Config> config,
+                   std::shared_ptr<certificate_reloader> certificates);
+
+  /** 
+   * Stops accepting connections (see server::close). Connections already
+   * open are served until they close, then the UDP socket is closed.
+   */
+  void close();
+
+  quic_server(const quic_server&) = delete;
+  quic_server& operator=(const quic_server&) = delete;
+
+private:
+  // Part of a response body, either in memory or in a file
+  struct segment{
+    const char* data; // nullptr if the bytes are read from fd
+    int fd;
+    std::uint64_t offset;
+    std::uint64_t length;
+  };
+
+  struct stream{
+    ~stream(); // Removes the spilled body
+    Request req;
+    size_t received = 0; // Header and body bytes, for the response log
+    size_t body_limit = 0; // client_max_body_size of the target, 0 is none
+    size_t body_size = 0; // Body bytes received, in req.body() or body_file
+    std::string body_file; // Path of the spilled body, "" if in memory
+    boost::beast::file body_out; // Open while the body is spilled
+    std::unique_ptr<Response> res;
+    Log::req_info req_info;
+    std::vector<std::string> names; // Lowercase field names of res
+    std::vector<quiche_h3_header> headers; // Not yet sent if non-empty
+    std::vector<segment> body; // Unsent parts of res's body, in order
+    size_t next = 0; // Index of the first unsent segment in body
+  };
+
+  struct connection{
+    explicit connection(const boost::asio::any_io_executor& executor)
+      : timer(executor){}
+    ~connection(){
+      if (h3)
+        quiche_h3_conn_free(h3);
+      if (conn)
+        quiche_conn_free(conn);
+    }
+    quiche_conn* conn = nullptr;
+    std::shared_ptr<quiche_config> config; // conn was created from it
+    quiche_h3_conn* h3 = nullptr; // Created once the handshake completes
+    boost::asio::ip::udp::endpoint peer;
+    std::string client_ip;
+    std::vector<std::string> ids; // Keys of this connection in connections_
+    boost::asio::steady_timer timer; // Loss detection and idle timeout
+    std::map<std::uint64_t, stream> streams;
+  };
+
+  std::shared_ptr<quiche_config> load_config();
+  void start_receive();
+  void handle_receive(const boost::system::error_code& error, size_t bytes);
+  std::shared_ptr<connection> accept(const std::string& dcid);
+  void process(connection& conn);
+  void respond(connection& conn, std::uint64_t stream_id, stream& stream,
+               int status);
+  bool send_response(connection& conn, std::uint64_t stream_id, stream& stream);
+  void finish(connection& conn, std::uint64_t stream_id);
+  void flush(connection& conn);
+  void schedule_timeout(const std::shared_ptr<connection>& conn);
+  void handle_timeout(const std::string& id,
+                      const boost::system::error_code& error);
+  void close_if_done(const std::shared_ptr<connection>& conn);
+  static int on_header(uint8_t* name, size_t name_length, uint8_t* value,
+                       size_t value_length, void* argp);
+
+  // Server connection IDs are local_id_length random bytes
+  // QUIC packets are at most max_datagram_size bytes (no path MTU discovery)
+  // Incoming concurrent streams allowed per connection (transport parameter)
+  enum{local_id_length = 16, max_datagram_size = 1350,
+       receive_buffer_size = 65535, chunk_size = 16384,
+       max_concurrent_streams = 128, idle_timeout_ms = 30000};
+
+  boost::asio::ip::udp::socket socket_; // On a strand, serializing all handlers
+  boost::asio::ip::udp::endpoint local_; // Bound address, the path of every packet
+  boost::asio::ip::udp::endpoint sender_; // Peer of the packet being received
+  std::shared_ptr<Config> config_; // Only accessed on the socket's strand
+  bool closing_ = false; // Set by close(), on the socket's strand
+  std::shared_ptr<certificate_reloader> certificates_; // On the socket's strand
+  // The context of certificates_ when quic_config_ loaded the same files
+  std::shared_ptr<tls_context> loaded_context_;
+  std::shared_ptr<quiche_config> quic_config_; // For new connections
+  quiche_h3_config* h3_config_ = nullptr;
+  // By connection ID: the server's, and the client's original destination ID
+  std::unordered_map<std::string, std::shared_ptr<connection>> connections_;
+  std::unique_ptr<uint8_t[]> receive_buffer_;
+  std::unique_ptr<uint8_t[]> send_buffer_;
+  std::unique_ptr<char[]> chunk_; // File bytes read for quiche_h3_send_body
+};
\ No newline at end of file
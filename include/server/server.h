@@ -1,5 +1,7 @@
 #pragma once
 
+#include <memory> // shared_ptr
+
 #include "session/session_base.h" // session_base
 
 class server{
@@ -8,17 +10,46 @@ public:
    * Initializes the server instance.
    *
    * @pre ConfigParser::parse() succeeded.
-   * @param config A pointer to a parsed Config object that supplies server parameters.
+   * @param config The parsed Config object that supplies server parameters,
+   *   shared with the sessions accepted until reconfigure() replaces it.
    * @param io_context A reference to boost::asio::io_context supplied by main.
+   * @param shared_port If true, binds with SO_REUSEPORT so that one acceptor
+   *   per worker thread can listen on the same port.
    */
-  server(Config* config, boost::asio::io_context& io_context);
+  server(std::shared_ptr<Config> config, boost::asio::io_context& io_context,
+         bool shared_port = false);
+
+  /// Deleted through server* by main, so subclasses free their members.
+  virtual ~server() = default;
+
+  /** 
+   * Gives sessions accepted from now on a new Config of the same port and
+   * type. Sessions already running keep the Config they started with.
+   *
+   * @param config The reparsed Config object of this server's port.
+   * @throws std::exception If the new config can't be applied, in which
+   *   case the server keeps its current one.
+   */
+  virtual void reconfigure(std::shared_ptr<Config> config);
+
+  /// Stops accepting connections, sessions already running are unaffected.
+  virtual void close();
+
+  /// Returns the port of the acceptor, which never changes.
+  unsigned short port(){return port_;}
+
+  /// Returns the type of the sessions it accepts, which never changes.
+  Config::ServerType type(){return type_;}
 
 protected:
   virtual void start_accept() = 0; // Must override
-  void handle_accept(session_base* new_session,
+  void handle_accept(std::shared_ptr<session_base> new_session,
                      const boost::system::error_code& error);
   
+  // On a strand, which serializes accepts with reconfigure() and close()
   boost::asio::ip::tcp::acceptor acceptor_;
-  Config* config_;
+  std::shared_ptr<Config> config_; // Only accessed on the acceptor's strand
   boost::asio::io_context& io_context_;
+  const unsigned short port_;
+  const Config::ServerType type_;
 };
\ No newline at end of file
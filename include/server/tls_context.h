@@ -0,0 +1,66 @@
+#pragma once
+
+#include <boost/asio.hpp> // io_context, steady_timer
+#include <boost/asio/ssl.hpp> // ssl::context
+#include <chrono> // seconds
+#include <memory> // enable_shared_from_this, shared_ptr
+#include <mutex>
+
+#include "nginx_config_server_block.h" // Config
+
+/* TLS settings of one HTTPS server block. Shared by the https_server of every
+   worker thread (see worker_mode sharded), so that a client resumes its
+   session whichever thread accepts it. Replaced by certificate_reloader when
+   the certificates change, sessions hold the context they started with. */
+class tls_context : public std::enable_shared_from_this<tls_context>{
+public:
+  /**
+   * Configures an SSL context from a server block, and starts rotating its
+   * session ticket keys.
+   *
+   * @pre ConfigParser::parse() succeeded.
+   * @param config A pointer to the parsed Config object of an HTTPS server.
+   * @param io_context The IO context that runs the ticket key rotation timer.
+   * @param previous The context this one replaces, whose ticket keys are
+   *   kept so that clients still resume, or nullptr.
+   * @returns The new context.
+   * @throws boost::system::system_error If a certificate, key or setting is
+   *   rejected by OpenSSL.
+   */
+  static std::shared_ptr<tls_context> create(Config* config,
+                                             boost::asio::io_context& io_context,
+                                             tls_context* previous = nullptr);
+
+  /**
+   * Configures an SSL context from a server block. Use create() instead.
+   *
+   * @param config A pointer to the parsed Config object of an HTTPS server.
+   * @param io_context The IO context that runs the ticket key rotation timer.
+   */
+  tls_context(Config* config, boost::asio::io_context& io_context);
+
+  /// Returns the OpenSSL context that sessions are created from.
+  boost::asio::ssl::context& ssl(){return ssl_context_;}
+
+  /// Replaces the ticket key, keeping the previous one to decrypt tickets.
+  void rotate_ticket_keys();
+
+private:
+  static int ticket_key_callback(SSL* ssl, unsigned char* name, unsigned char* iv,
+                                 EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac,
+                                 int encrypt);
+  void schedule_rotation();
+
+  struct ticket_key{
+    unsigned char name[16]; // Sent in the clear with each ticket
+    unsigned char aes_key[32];
+    unsigned char hmac_key[32];
+  };
+
+  boost::asio::ssl::context ssl_context_;
+  std::mutex ticket_keys_mutex_; // Handshakes run on every worker thread
+  ticket_key ticket_keys_[2] = {}; // Current (encrypts), then previous (decrypts)
+  int ticket_keys_valid_ = 0; // Leading slots holding generated keys, not zeros
+  boost::asio::steady_timer rotation_timer_;
+  std::chrono::seconds rotation_interval_;
+};
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <boost/asio/awaitable.hpp> // awaitable
+#include <boost/beast/core/file.hpp> // file
+#include <cstdint> // int32_t, uint64_t
+#include <functional>
+#include <memory> // unique_ptr
+#include <nghttp2/nghttp2.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "log.h" // req_info
+#include "nginx_config_server_block.h" // Config
+#include "typedefs/http.h" // Request, Response
+#include "typedefs/socket.h" // https_socket
+
+/* HTTP/2 server side of a TLS connection that negotiated h2 with ALPN.
+   nghttp2 handles framing, HPACK, flow control and stream priorities; each
+   complete request stream is answered by the session's RequestHandler
+   dispatch, like an HTTP/1.1 request. Built with -DENABLE_HTTP2=ON. */
+class http2_connection{
+public:
+  /* Creates the response to a request stream. body_file is the path of its
+     spilled body, "" if the body is in req.body(). status is 0 for a complete
+     request, else an error status (e.g., 413) to answer without dispatching.
+     received is the number of header and body bytes of the stream. */
+  typedef std::function<Response*(Request& req, const std::string& body_file,
+                                  int status, size_t received,
+                                  Log::req_info& req_info)> handler_type;
+
+  /**
+   * Sets up the nghttp2 server session.
+   *
+   * @pre ConfigParser::parse() succeeded.
+   * @param socket The TLS stream, after a handshake that selected h2.
+   * @param config A pointer to the parsed Config object of the server.
+   * @param client_ip The client address, for the response log.
+   * @param handler Creates the response to each request stream.
+   */
+  http2_connection(https_socket& socket, Config* config,
+                   const std::string& client_ip, handler_type handler);
+  ~http2_connection();
+
+  http2_connection(const http2_connection&) = delete;
+  http2_connection& operator=(const http2_connection&) = delete;
+
+  /**
+   * Serves request streams until the client closes the connection or sends
+   * GOAWAY, or an error occurs.
+   *
+   * @param[out] error The read, write or protocol error that ended the
+   *   connection, success if it ended with GOAWAY.
+   */
+  boost::asio::awaitable<void> run(boost::system::error_code& error);
+
+private:
+  // Part of a response body, either in memory or in a file
+  struct segment{
+    const char* data; // nullptr if the bytes are read from fd
+    int fd;
+    std::uint64_t offset;
+    std::uint64_t length;
+  };
+
+  struct stream{
+    ~stream(); // Removes the spilled body
+    Request req;
+    size_t received = 0; // Header and body bytes, for the response log
+    size_t body_limit = 0; // client_max_body_size of the target, 0 is none
+    size_t body_size = 0; // Body bytes received, in req.body() or body_file
+    std::string body_file; // Path of the spilled body, "" if in memory
+    boost::beast::file body_out; // Open while the body is spilled
+    bool responded = false;
+    std::unique_ptr<Response> res;
+    Log::req_info req_info;
+    std::vector<segment> body; // Unsent parts of res's body, in order
+    size_t next = 0; // Index of the first unsent segment in body
+  };
+
+  boost::asio::awaitable<void> flush(boost::system::error_code& error);
+  void respond(int32_t stream_id, stream& stream, int status);
+
+  static int on_begin_headers(nghttp2_session* session,
+                              const nghttp2_frame* frame, void* user_data);
+  static int on_header(nghttp2_session* session, const nghttp2_frame* frame,
+                       const uint8_t* name, size_t name_length,
+                       const uint8_t* value, size_t value_length,
+                       uint8_t flags, void* user_data);
+  static int on_frame_recv(nghttp2_session* session, const nghttp2_frame* frame,
+                           void* user_data);
+  static int on_data_chunk_recv(nghttp2_session* session, uint8_t flags,
+                                int32_t stream_id, const uint8_t* data,
+                                size_t length, void* user_data);
+  static int on_stream_close(nghttp2_session* session, int32_t stream_id,
+                             uint32_t error_code, void* user_data);
+  static ssize_t read_body(nghttp2_session* session, int32_t stream_id,
+                           uint8_t* buf, size_t length, uint32_t* data_flags,
+                           nghttp2_data_source* source, void* user_data);
+
+  // Incoming concurrent streams allowed per connection (SETTINGS)
+  enum{max_concurrent_streams = 128, read_buffer_size = 16384,
+       write_batch_size = 65536};
+
+  https_socket& socket_;
+  Config* config_;
+  const std::string& client_ip_;
+  handler_type handler_;
+  nghttp2_session* session_ = nullptr;
+  std::unordered_map<int32_t, std::unique_ptr<stream>> streams_;
+  std::string write_buffer_; // Frames gathered into one TLS write
+  std::unique_ptr<char[]> read_buffer_;
+};
\ No newline at end of file
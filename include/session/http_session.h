@@ -9,12 +9,15 @@ public:
    * Sets up the session socket.
    *
    * @pre ConfigParser::parse() succeeded.
-   * @param config A pointer to a parsed Config object that supplies session parameters.
+   * @param config The parsed Config object that supplies session parameters,
+   *   kept by the session even if the config is reloaded meanwhile.
    * @param io_context A reference to boost::asio::io_context supplied by main.
    */
-  http_session(Config* config, boost::asio::io_context& io_context)
-    : session(config){ // Call superclass constructor
-    socket_ = new http_socket(io_context);
+  http_session(std::shared_ptr<Config> config, boost::asio::io_context& io_context)
+    : session(std::move(config)){ // Call superclass constructor
+    /* Each session's socket gets its own strand, so its completion handlers
+       never run concurrently even when several threads run io_context. */
+    socket_ = new http_socket(boost::asio::make_strand(io_context));
   }
 
   /// Returns a reference to the TCP socket used by this session.
@@ -22,16 +25,10 @@ public:
     return *socket_;
   };
 
-  /// The entry point for http_session is do_read()
-  void start() override{
-    do_read();
-  };
-
 private:
   /// Closes the current session.
   void do_close() override{
     boost::system::error_code ec;
     socket_->shutdown(http_socket::shutdown_both, ec); // Shut down gracefully
-    delete this;
   }
-};
\ No newline at end of file
+};
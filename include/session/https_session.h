@@ -1,5 +1,8 @@
 #pragma once
 
+#include <memory> // shared_ptr
+
+#include "server/tls_context.h" // tls_context
 #include "session/session.h" // session
 #include "typedefs/socket.h" // http_socket, https_socket
 
@@ -9,14 +12,21 @@ public:
    * Sets up the session socket.
    *
    * @pre ConfigParser::parse() succeeded.
-   * @param config A pointer to a parsed Config object that supplies session parameters.
+   * @param config The parsed Config object that supplies session parameters,
+   *   kept by the session even if the config is reloaded meanwhile.
    * @param io_context A reference to boost::asio::io_context supplied by main.
-   * @param ssl_context A reference to the boost::asio::ssl::context supplied by https_server.
+   * @param context The current TLS context supplied by https_server, kept
+   *   by the session even if the certificates are reloaded meanwhile.
    */
-  https_session(Config* config, boost::asio::io_context& io_context,
-                boost::asio::ssl::context& ssl_context)
-    : session(config){ // Call superclass constructor
-    socket_ = new https_socket(io_context, ssl_context);
+  https_session(std::shared_ptr<Config> config, boost::asio::io_context& io_context,
+                std::shared_ptr<tls_context> context)
+    : session(std::move(config)), // Call superclass constructor
+      tls_context_(std::move(context)){
+    /* Each session's socket gets its own strand, so its completion handlers
+       (including intermediate SSL handlers) never run concurrently even when
+       several threads run io_context. */
+    socket_ = new https_socket(boost::asio::make_strand(io_context),
+                               tls_context_->ssl());
   }
 
   /// Returns a reference to the TCP socket used by this session.
@@ -24,13 +34,13 @@ public:
     return socket_->next_layer();
   };
 
-  /// The entry point for https_session is do_handshake()
-  void start() override{
-    do_handshake();
-  };
-
 private:
-  void do_handshake();
-  void handle_handshake(const boost::system::error_code& error);
+  boost::asio::awaitable<bool> do_handshake() override;
+#ifdef ENABLE_HTTP2
+  boost::asio::awaitable<bool> run_negotiated() override;
+#endif
   void do_close() override;
-};
\ No newline at end of file
+
+  // Held until the session ends, its tickets are encrypted with the context's keys
+  std::shared_ptr<tls_context> tls_context_;
+};
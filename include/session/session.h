@@ -9,19 +9,34 @@ public:
    * Sets up the session socket.
    * 
    * @pre ConfigParser::parse() succeeded.
-   * @param config A pointer to a parsed Config object that supplies session parameters.
+   * @param config The parsed Config object that supplies session parameters,
+   *   kept by the session even if the config is reloaded meanwhile.
    */
-  session(Config* config) : session_base(config){}
+  session(std::shared_ptr<Config> config) : session_base(std::move(config)){}
 
   /// Delete the dynamically allocated socket upon session deletion.
   ~session(){delete socket_;}
 
 protected:
-  void do_read() override;
-  void do_write(Response* res, Log::req_info& req_info) override;
+  boost::asio::awaitable<void> run() override;
+
+  /// Performs any handshake required before reading. Returns success status.
+  virtual boost::asio::awaitable<bool> do_handshake(){
+    co_return true; // Plain sockets have no handshake
+  }
+
+  /// Serves the connection with a protocol selected by the handshake instead
+  /// of HTTP/1.x (e.g., HTTP/2). Returns true once it has, after closing.
+  virtual boost::asio::awaitable<bool> run_negotiated(){
+    co_return false; // Plain sockets only speak HTTP/1.x
+  }
+
+  boost::asio::awaitable<void> send_file(
+    const std::vector<boost::asio::const_buffer>& headers, const Response& res,
+    boost::system::error_code& error);
   
   /* Must be a pointer, otherwise constructor will complain that socket_ is
      missing from initializer list. Can't include in initializer list because
      the two different socket types have different constructor params. */
   AsyncWriteStream* socket_; // Belongs to session, should be deleted by destructor
-};
\ No newline at end of file
+};
@@ -1,40 +1,107 @@
 #pragma once
 
+#include <boost/asio/awaitable.hpp> // awaitable
+#include <boost/beast/core/file.hpp> // file
+#include <boost/beast/core/flat_buffer.hpp> // flat_buffer
+#include <memory> // enable_shared_from_this, shared_ptr
+#include <optional>
+#include <vector>
+
 #include "log.h" // req_info
 #include "nginx_config_server_block.h" // Config
 #include "typedefs/http.h" // Request, Response
 
-class session_base{
+class session_base : public std::enable_shared_from_this<session_base>{
 public:
   /** 
    * Sets up the session socket.
    * 
    * @pre ConfigParser::parse() succeeded.
-   * @param config A pointer to a parsed Config object that supplies session parameters.
+   * @param config The parsed Config object that supplies session parameters,
+   *   kept by the session even if the config is reloaded meanwhile.
    */
-  session_base(Config* config) : config_(config){}
+  session_base(std::shared_ptr<Config> config) : config_(std::move(config)){}
+
+  /// Removes the spilled body of an unfinished request, if any.
+  virtual ~session_base();
 
   /// Returns a reference to the TCP socket used by this session.
   virtual boost::asio::ip::tcp::socket& socket() = 0; // Must be overriden
 
-  /// Must be overriden with the appropriate entrypoint for the session type.
-  virtual void start() = 0; // Must be overriden
+  /** 
+   * Spawns the session coroutine on the socket's strand. The coroutine holds
+   * a shared_ptr to the session, which is freed when the coroutine returns.
+   *
+   * @pre The session is owned by a std::shared_ptr.
+   */
+  void start();
+
+  /**
+   * Appends part of a request body that arrives in frames (HTTP/2 or HTTP/3
+   * DATA) to body, moving it to a temporary file once it passes
+   * body_buffer_size, like prepare_body() does for HTTP/1.
+   *
+   * @param[in,out] body The body received so far, emptied once spilled.
+   * @param[in,out] body_file The path of the spilled body, "" until spilled.
+   *   The caller removes it (see remove_body_file) once the body is handled.
+   * @param[in,out] file The spilled body, opened for writing when spilling.
+   * @param data The received part of the body.
+   * @param length The size of data in bytes.
+   * @returns false if the temporary file can't be created or written.
+   */
+  static bool append_body(std::string& body, std::string& body_file,
+                          boost::beast::file& file, const char* data,
+                          size_t length);
 
 protected:
-  virtual void do_read() = 0; // Must be overriden
-  void handle_read(const boost::system::error_code& error, size_t bytes);
-  void create_response(int status);
-  void create_response(Request& req);
-  void create_return_response(Request& req);
-  virtual void do_write(Response* res, Log::req_info& req_info) = 0; // Must be overriden
-  void handle_write(const boost::system::error_code& error, size_t res_bytes,
-                    Response* res, Log::req_info& req_info);
+  /// Session loop (handshake, read, dispatch, write, repeat). Must be overriden
+  virtual boost::asio::awaitable<void> run() = 0;
+  void init_parser();
+  bool header_done();
+  bool request_done();
+  boost::system::error_code prepare_body();
+  bool expects_continue();
+  bool parse_buffered(boost::system::error_code& error);
+  bool queue_response(const boost::system::error_code& error);
+  bool pipeline_ready();
+  Response* handle_read(const boost::system::error_code& error,
+                        Log::req_info& req_info);
+  void handle_read_error(const boost::system::error_code& error);
+  Response* create_response(int status, const std::string& received,
+                            Log::req_info& req_info);
+  Response* create_response(Request& req, Log::req_info& req_info,
+                            const std::string& body_file);
+  Response* create_spilled_response(Log::req_info& req_info);
+  Response* create_return_response(Request& req, Log::req_info& req_info);
+  std::vector<boost::asio::const_buffer>& prepare_batch(size_t& next);
+  bool handle_write(const boost::system::error_code& error);
   void close(int severity, const std::string& message);
   virtual void do_close() = 0; // Must be overriden
   
   std::string client_ip_;
-  Config* config_; // Belongs to server, should not be deleted by destructor
-  enum{max_length = 1024};
-  char data_[max_length];
-  std::string total_received_data_ = "";
-};
\ No newline at end of file
+  std::shared_ptr<Config> config_; // Snapshot shared with the server and other sessions
+  // Requests with a header of max_length+ bytes get 413
+  // Bodies that may exceed body_buffer_size bytes are spilled to a file
+  // At most max_pipeline pipelined responses are written per batch
+  enum{max_length = 4096, body_buffer_size = 16384, max_pipeline = 16};
+  // Read buffer, reused across requests; may hold pipelined bytes
+  boost::beast::flat_buffer buffer_;
+  // Parser for the request currently being read, fed incrementally
+  std::optional<http::request_parser<http::string_body>> parser_;
+  // Takes over from parser_ after the header if the body is spilled
+  std::optional<http::request_parser<http::file_body>> file_parser_;
+  std::string body_file_; // Path of the spilled body, "" if in memory
+  size_t received_bytes_ = 0; // Bytes consumed by parser_ for this request
+
+  // A response waiting to be written, with its logging info
+  struct queued_response{
+    std::unique_ptr<Response> res;
+    Log::req_info req_info;
+    size_t header_size = 0; // Serialized header length in batch_headers_
+  };
+  /* Responses to pipelined requests, written in order by one gathered write
+     (plus a sendfile(2) per response with a body file) */
+  std::vector<queued_response> batch_;
+  std::string batch_headers_; // Serialized headers of batch_, reused
+  std::vector<boost::asio::const_buffer> batch_buffers_; // Reused
+};
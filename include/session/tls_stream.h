@@ -0,0 +1,156 @@
+#pragma once
+
+#include <boost/asio.hpp> // async_compose, ip::tcp, post
+#include <boost/asio/ssl.hpp> // ssl::context, ssl::error
+#include <cerrno> // errno
+#include <openssl/err.h> // ERR_clear_error
+#include <openssl/ssl.h> // SSL, SSL_sendfile
+#include <sys/types.h> // off_t
+
+#include "handshake_pool.h" // HandshakePool
+
+/* TLS stream that runs OpenSSL directly on the TCP socket. Unlike
+   boost::asio::ssl::stream, which feeds OpenSSL through a memory BIO pair,
+   this lets OpenSSL hand the record layer to the kernel (kTLS) after the
+   handshake, so files can be sent with SSL_sendfile without being copied to
+   userspace. Satisfies AsyncReadStream and AsyncWriteStream. */
+class tls_stream{
+public:
+  typedef boost::asio::ip::tcp::socket next_layer_type;
+  typedef next_layer_type::executor_type executor_type;
+
+  /**
+   * Creates the stream and its SSL object. The socket is opened by accept.
+   *
+   * @param executor The executor (strand) of the socket.
+   * @param context The SSL context, with SSL_OP_ENABLE_KTLS set to allow kTLS.
+   */
+  tls_stream(const executor_type& executor, boost::asio::ssl::context& context);
+  ~tls_stream();
+
+  tls_stream(const tls_stream&) = delete;
+  tls_stream& operator=(const tls_stream&) = delete;
+
+  executor_type get_executor(){return socket_.get_executor();}
+  next_layer_type& next_layer(){return socket_;}
+  SSL* native_handle(){return ssl_;}
+
+  /// Returns true if the kernel encrypts writes (kTLS), see async_sendfile.
+  bool ktls_send() const;
+
+  /**
+   * Performs the server side of the TLS handshake on the accepted socket. If
+   * the HandshakePool is enabled, OpenSSL runs on its threads.
+   */
+  template <class HandshakeToken>
+  auto async_handshake(HandshakeToken&& token){
+    attach();
+    return async_perform([this](size_t&){
+      return SSL_accept(ssl_);
+    }, std::forward<HandshakeToken>(token), HandshakePool::inst().enabled());
+  }
+
+  /// Reads some decrypted data into the first non-empty buffer.
+  template <class MutableBufferSequence, class ReadToken>
+  auto async_read_some(const MutableBufferSequence& buffers, ReadToken&& token){
+    boost::asio::mutable_buffer buffer = first<boost::asio::mutable_buffer>(buffers);
+    return async_perform([this, buffer](size_t& bytes){
+      return buffer.size() ?
+        SSL_read_ex(ssl_, buffer.data(), buffer.size(), &bytes) : 1;
+    }, std::forward<ReadToken>(token));
+  }
+
+  /// Writes some of the first non-empty buffer.
+  template <class ConstBufferSequence, class WriteToken>
+  auto async_write_some(const ConstBufferSequence& buffers, WriteToken&& token){
+    boost::asio::const_buffer buffer = first<boost::asio::const_buffer>(buffers);
+    return async_perform([this, buffer](size_t& bytes){
+      return buffer.size() ?
+        SSL_write_ex(ssl_, buffer.data(), buffer.size(), &bytes) : 1;
+    }, std::forward<WriteToken>(token));
+  }
+
+  /**
+   * Sends part of a file with SSL_sendfile, which the kernel encrypts without
+   * copying it to userspace. Only valid if ktls_send() is true.
+   *
+   * @param fd The file to send.
+   * @param offset The offset of the first byte to send.
+   * @param size The most bytes to send.
+   * @param token Completion token with signature void(error_code, size_t).
+   */
+  template <class WriteToken>
+  auto async_sendfile(int fd, off_t offset, size_t size, WriteToken&& token){
+    return async_perform([this, fd, offset, size](size_t& bytes){
+      ossl_ssize_t sent = SSL_sendfile(ssl_, fd, offset, size, 0);
+      if (sent < 0)
+        return -1;
+      bytes = sent;
+      return 1;
+    }, std::forward<WriteToken>(token));
+  }
+
+  /// Sends close_notify, without waiting for the client's reply.
+  void shutdown(boost::system::error_code& error);
+
+private:
+  void attach();
+  boost::system::error_code translate_error(int result);
+
+  /// Returns the first non-empty buffer (OpenSSL takes one buffer per call).
+  template <class Buffer, class BufferSequence>
+  static Buffer first(const BufferSequence& buffers){
+    auto end = boost::asio::buffer_sequence_end(buffers);
+    for (auto it = boost::asio::buffer_sequence_begin(buffers); it != end; ++it)
+      if (Buffer(*it).size())
+        return Buffer(*it);
+    return Buffer();
+  }
+
+  /* Runs an OpenSSL call until it succeeds, waiting for the socket whenever
+     it wants to read or write. Like asio's sockets, never completes inside
+     the initiating function. With offload, each call runs on the
+     HandshakePool, and completion is posted back to the socket's executor. */
+  template <class Operation, class CompletionToken>
+  auto async_perform(Operation operation, CompletionToken&& token,
+                     bool offload = false){
+    return boost::asio::async_compose<CompletionToken,
+                                      void(boost::system::error_code, size_t)>(
+      [this, operation, offload, offloaded = false, waited = false,
+       done = false, bytes = size_t(0), result = boost::system::error_code()]
+      (auto& self, boost::system::error_code error = {}) mutable{
+        if (done) // Posted below
+          return self.complete(result, bytes);
+        if (!error && offload && !offloaded){
+          offloaded = true; // Come back here on a pool thread
+          return HandshakePool::inst().post(std::move(self));
+        }
+        offloaded = false; // Next call hops to the pool again
+        if (!error){
+          ERR_clear_error();
+          errno = 0; // Set by a failed syscall, see translate_error
+          int ret = operation(bytes);
+          if (ret <= 0){
+            int ssl_error = SSL_get_error(ssl_, ret);
+            if (ssl_error == SSL_ERROR_WANT_READ || ssl_error == SSL_ERROR_WANT_WRITE){
+              waited = true;
+              return socket_.async_wait(ssl_error == SSL_ERROR_WANT_READ ?
+                next_layer_type::wait_read : next_layer_type::wait_write,
+                std::move(self));
+            }
+            error = translate_error(ret);
+            bytes = 0;
+          }
+        }
+        if (waited && !offload) // Already on the socket's executor
+          return self.complete(error, bytes);
+        done = true;
+        result = error;
+        boost::asio::post(socket_.get_executor(), std::move(self));
+      }, token, socket_);
+  }
+
+  next_layer_type socket_;
+  SSL* ssl_;
+  bool failed_ = false; // A fatal error occurred, no close_notify may be sent
+};
\ No newline at end of file
@@ -1,8 +1,47 @@
 #pragma once
 
-#include <boost/beast.hpp> // http::request, http::response
+#include <boost/beast.hpp> // http::request, http::response, http::file_body
+#include <memory> // shared_ptr
+#include <string>
+#include <vector>
 
 namespace http = boost::beast::http;
 
 typedef http::request<http::string_body> Request;
-typedef http::response<http::string_body> Response;
\ No newline at end of file
+
+class Response : public http::response<http::string_body>{
+public:
+  /* If set, the body is sent from this file (with sendfile(2) on plain HTTP
+     sessions) instead of body(), and Content-Length must already be set.
+     Shared so that Response stays copyable. */
+  std::shared_ptr<http::file_body::value_type> file;
+
+  /* If set, the body is sent from this immutable buffer instead of body(),
+     and Content-Length must already be set. Shared with FileCache, so cache
+     hits are written to the socket without copying the file. */
+  std::shared_ptr<const std::string> shared_body;
+
+  struct byte_range{
+    std::uint64_t offset;
+    std::uint64_t length;
+    std::string prefix; // Sent before the bytes, e.g. a multipart part header
+  };
+
+  /* If set, only these ranges of the body (wherever it is stored) are sent,
+     in order, followed by ranges_suffix. Used for 206 Partial Content. */
+  std::vector<byte_range> ranges;
+  std::string ranges_suffix;
+
+  /// Returns the number of body bytes sent, wherever the body is stored.
+  std::uint64_t payload_size() const{
+    if (!ranges.empty()){
+      std::uint64_t size = ranges_suffix.size();
+      for (const byte_range& range : ranges)
+        size += range.prefix.size() + range.length;
+      return size;
+    }
+    if (file)
+      return file->size();
+    return shared_body ? shared_body->size() : body().size();
+  }
+};
\ No newline at end of file
@@ -1,7 +1,14 @@
 #pragma once
 
 #include <boost/asio.hpp> // ip::tcp
-#include <boost/asio/ssl.hpp> // ssl::stream
+
+#include "session/tls_stream.h" // tls_stream
 
 typedef boost::asio::ip::tcp::socket http_socket;
-typedef boost::asio::ssl::stream<boost::asio::ip::tcp::socket> https_socket;
\ No newline at end of file
+typedef tls_stream https_socket; // Supports kTLS, unlike boost::asio::ssl::stream
+
+// Socket option allowing several acceptors to bind the same port (Linux 3.9+)
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
+
+// Socket option holding back partial frames until uncorked (Linux, see tcp(7))
+typedef boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_CORK> tcp_cork;
\ No newline at end of file
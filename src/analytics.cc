@@ -33,11 +33,51 @@ std::string Analytics::report(){
          "- " + std::to_string(malicious) + " malicious\n" +
          "- " + std::to_string(health) + " health checks\n";
 
+  // Resumed handshakes skip the server's asymmetric crypto
+  int handshakes = tls_handshakes, resumed = tls_resumed;
+  out += "\nTLS handshakes: " + std::to_string(handshakes) + "\n" +
+         "- " + std::to_string(resumed) + " resumed (" +
+         std::to_string(handshakes ? 100LL * resumed / handshakes : 0) + "% hit rate)\n" +
+         "- " + std::to_string(handshakes_queued) + " queued for the handshake pool (peak " +
+         std::to_string(handshakes_queued_peak) + ")\n" +
+         "- " + std::to_string(http2_connections) + " selected HTTP/2\n" +
+         "- " + std::to_string(http3_connections) + " more over QUIC (HTTP/3)\n";
+
+  // Handshake count and average latency per protocol version and cipher
+  auto report_handshakes = [&out](const std::map<std::string, HandshakeStats>& stats){
+    for (const auto& [name, group] : stats){
+      long average_us = group.latency.count() / group.count;
+      out += "- " + name + ": " + std::to_string(group.count) + " (avg " +
+             std::to_string(average_us / 1000) + "." +
+             std::to_string(average_us % 1000 / 100) + " ms)\n";
+    }
+  };
+  std::lock_guard<std::mutex> lock(handshakes_mutex);
+  out += "By protocol:\n";
+  report_handshakes(protocols);
+  out += "By cipher:\n";
+  report_handshakes(ciphers);
+
   out += "</pre></body></html>";
   return out;
 }
 
 
+/// Records a completed TLS handshake.
+void Analytics::record_handshake(const std::string& protocol,
+                                 const std::string& cipher, bool resumed,
+                                 std::chrono::microseconds latency){
+  tls_handshakes++;
+  if (resumed)
+    tls_resumed++;
+  std::lock_guard<std::mutex> lock(handshakes_mutex);
+  for (HandshakeStats* stats : {&protocols[protocol], &ciphers[cipher]}){
+    stats->count++;
+    stats->latency += latency;
+  }
+}
+
+
 /// Returns a static reference to the singleton instance of Analytics.
 Analytics& Analytics::inst(){
   static Analytics instRef;
@@ -0,0 +1,241 @@
+#include "file_cache.h"
+#include "log.h"
+
+// Standardized log prefix for this source
+#define LOG_PRE "[FileCache] "
+
+// Directory changes that may invalidate a cached file inside it
+#define WATCH_MASK (IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+                    IN_DELETE_SELF | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | \
+                    IN_MOVED_TO)
+
+
+/// Returns true if the file at path still matches the cached entry.
+static bool unchanged(const std::string& path, const FileCache::Entry& entry){
+  struct stat info;
+  return !::stat(path.c_str(), &info) &&
+         info.st_size == static_cast<off_t>(entry.body->size()) &&
+         info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec == entry.mtime_ns;
+}
+
+
+/// Returns a static reference to the singleton instance of FileCache.
+FileCache& FileCache::inst(){
+  static FileCache instRef;
+  return instRef;
+}
+
+
+/// Sets the memory budget, evicting least recently used entries to fit.
+void FileCache::max_size(size_t bytes){
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_size_ = bytes;
+  evict();
+}
+
+
+/// Returns the memory budget in bytes (0 if the cache is disabled).
+size_t FileCache::max_size(){
+  std::lock_guard<std::mutex> lock(mutex_);
+  return max_size_;
+}
+
+
+/// Returns the number of body bytes currently cached.
+size_t FileCache::size(){
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_;
+}
+
+
+/// Starts watching the directories of cached files with inotify.
+bool FileCache::watch(boost::asio::io_context& io_context){
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (events_) // Already watching
+    return true;
+
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0){
+    Log::error(LOG_PRE, "inotify unavailable, validating cache hits with stat");
+    return false;
+  }
+  events_ = std::make_unique<boost::asio::posix::stream_descriptor>(io_context, fd);
+  /* Files cached before now have no watch, and may have changed already.
+     Drop them rather than serve them stale forever. */
+  erase_all();
+  read_events();
+  return true;
+}
+
+
+/// Looks up a file and marks it as most recently used.
+std::shared_ptr<const FileCache::Entry> FileCache::find(const std::string& path){
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(path);
+  if (it == entries_.end())
+    return nullptr;
+
+  if (!events_ && !unchanged(path, *it->second.entry)){ // Not watching, check
+    erase(path);
+    return nullptr;
+  }
+
+  lru_.splice(lru_.begin(), lru_, it->second.lru); // Move to front
+  return it->second.entry;
+}
+
+
+/// Caches a file read from disk if it fits and hasn't changed.
+bool FileCache::insert(const std::string& path, const Entry& entry){
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entry.body->size() > max_entry_size || entry.body->size() > max_size_)
+    return false; // Also rejects everything if the cache is disabled
+
+  if (events_){ // Watch the directory before the stat below, so no change is missed
+    std::string dir = path.substr(0, path.rfind('/'));
+    int wd = inotify_add_watch(events_->native_handle(), dir.c_str(), WATCH_MASK);
+    if (wd < 0) // e.g., out of watches (fs.inotify.max_user_watches)
+      return false;
+    watches_[wd] = dir; // Same descriptor if dir is already watched
+  }
+
+  if (!unchanged(path, entry)) // Changed while it was being read
+    return false;
+
+  erase(path); // Replace any older version
+  lru_.push_front(path);
+  entries_[path] = {std::make_shared<const Entry>(entry), lru_.begin()};
+  size_ += entry.body->size();
+  evict();
+  return true;
+}
+
+
+/// Looks up the memoized validators of a file version.
+bool FileCache::find_metadata(const std::string& path, const struct stat& info,
+                              std::string& etag, std::string& last_modified){
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = metadata_.find(path);
+  if (it == metadata_.end())
+    return false;
+  const Metadata& metadata = it->second;
+  // Any change to the file makes a new version (rename replaces the inode)
+  if (metadata.mtime_ns != info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec ||
+      metadata.size != info.st_size || metadata.inode != info.st_ino)
+    return false;
+  etag = metadata.etag;
+  last_modified = metadata.last_modified;
+  return true;
+}
+
+
+/// Memoizes the validators of a file version.
+void FileCache::insert_metadata(const std::string& path, const struct stat& info,
+                                const std::string& etag,
+                                const std::string& last_modified){
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (metadata_.size() >= max_metadata && !metadata_.count(path))
+    metadata_.erase(metadata_.begin()); // Full, forget an arbitrary file
+  metadata_[path] = {info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec,
+                     info.st_size, info.st_ino, etag, last_modified};
+}
+
+
+/// Drops all cached entries and memoized validators.
+void FileCache::clear(){
+  std::lock_guard<std::mutex> lock(mutex_);
+  erase_all();
+  metadata_.clear();
+}
+
+
+/// Stops watching for changes, falling back to validating hits with stat.
+void FileCache::unwatch(){
+  std::lock_guard<std::mutex> lock(mutex_);
+  events_.reset(); // Cancels the pending read and closes the descriptor
+  watches_.clear();
+}
+
+
+/// Reads the next batch of inotify events. Caller holds mutex_.
+void FileCache::read_events(){
+  events_->async_read_some(boost::asio::buffer(event_buffer_),
+    [this](const boost::system::error_code& error, size_t bytes){
+      handle_events(error, bytes);
+    });
+}
+
+
+/// Drops cached files affected by a batch of inotify events.
+void FileCache::handle_events(const boost::system::error_code& error, size_t bytes){
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (error){
+    if (error == boost::asio::error::operation_aborted)
+      return; // IO context shutting down
+    // Fall back to validating hits with stat, dropping possibly stale entries
+    Log::error(LOG_PRE, "Failed to read inotify events: " + error.message());
+    events_.reset(); // Closes the inotify descriptor, removing all watches
+    watches_.clear();
+    erase_all();
+    return;
+  }
+
+  for (size_t i = 0; i < bytes;){
+    const inotify_event* event = reinterpret_cast<const inotify_event*>(event_buffer_ + i);
+    i += sizeof(inotify_event) + event->len;
+
+    if (event->mask & IN_Q_OVERFLOW){ // Events were lost, anything may be stale
+      erase_all();
+      continue;
+    }
+    auto watch = watches_.find(event->wd);
+    if (watch == watches_.end())
+      continue;
+    if (event->len) // A file inside the directory changed
+      erase(watch->second + "/" + event->name);
+    else // The directory itself was deleted, moved, or unmounted
+      erase_dir(watch->second);
+    if (event->mask & IN_IGNORED) // Watch removed by the kernel
+      watches_.erase(watch);
+  }
+  read_events();
+}
+
+
+/// Drops the entry for path, if any. Caller holds mutex_.
+void FileCache::erase(const std::string& path){
+  auto it = entries_.find(path);
+  if (it == entries_.end())
+    return;
+  size_ -= it->second.entry->body->size();
+  lru_.erase(it->second.lru);
+  entries_.erase(it);
+}
+
+
+/// Drops every entry directly inside dir. Caller holds mutex_.
+void FileCache::erase_dir(const std::string& dir){
+  for (auto it = lru_.begin(); it != lru_.end();){
+    std::string path = *it++; // Copy and advance first, erase() frees the node
+    if (path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 &&
+        path[dir.size()] == '/' && path.find('/', dir.size() + 1) == std::string::npos)
+      erase(path);
+  }
+}
+
+
+/// Drops every entry. Caller holds mutex_.
+void FileCache::erase_all(){
+  entries_.clear();
+  lru_.clear();
+  size_ = 0;
+}
+
+
+/// Evicts least recently used entries until the cache fits. Caller holds mutex_.
+void FileCache::evict(){
+  while (size_ > max_size_ && !lru_.empty()){
+    std::string path = lru_.back(); // Copy, erase() destroys the list node
+    erase(path);
+  }
+}
\ No newline at end of file
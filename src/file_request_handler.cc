@@ -1,11 +1,19 @@
-#include <boost/filesystem.hpp> // exists, is_directory, path
-#include <boost/filesystem/fstream.hpp> // ifstream
-#include <boost/lexical_cast.hpp> // lexical_cast
-#include <iomanip> // put_time
-// #include <regex> // regex_search
-
+#include <boost/algorithm/string.hpp> // iequals, is_any_of, split, trim
+#include <boost/filesystem.hpp> // last_write_time, path
+#include <charconv> // from_chars
+#include <cstdio> // snprintf
+#include <cstdlib> // strtod
+#include <cstring> // memcpy
+#include <ctime> // gmtime_r, strftime
+#include <memory> // make_shared
+#include <random> // mt19937_64, random_device
+#include <sys/stat.h> // fstat, S_ISREG
+#include <unistd.h> // pread
+
+#include "file_cache.h" // FileCache::inst()
 #include "file_request_handler.h"
 #include "log.h"
+#include "open_file_cache.h" // OpenFileCache::inst()
 #include "registry.h" // Registry::inst(), REGISTER_HANDLER macro
 
 // Standardized log prefix for this source
@@ -14,56 +22,176 @@
 namespace fs = boost::filesystem;
 
 
+std::string http_date(std::time_t time);
 std::string last_modified_time(fs::path file_obj);
+bool read_file(http::file_body::value_type& file, std::string& contents,
+               std::int64_t& mtime_ns);
+std::uint64_t xxh64(const char* data, size_t size, std::uint64_t seed);
+bool hash_file(http::file_body::value_type& file, struct stat& info,
+               std::string& etag, std::uint64_t max_size);
 std::string mime_type(fs::path file_obj);
-LocationBlock* get_location(const std::string& req_target, Config* config);
+bool accepts_encoding(const Request& req, const std::string& encoding);
+bool not_modified(const Request& req, const std::string& etag,
+                  const std::string& last_modified);
+bool if_range_matches(const Request& req, const std::string& etag,
+                      const std::string& last_modified);
+bool parse_ranges(boost::beast::string_view header, std::uint64_t size,
+                  std::vector<Response::byte_range>& ranges);
+void set_ranges(Response& res, std::vector<Response::byte_range> ranges,
+                const std::string& content_type, std::uint64_t size);
+std::string precompressed(const Request& req, bool gzip_static,
+                          bool brotli_static, int root_fd, size_t root_length,
+                          fs::path& file_obj,
+                          std::shared_ptr<const OpenFileCache::File>& opened);
 bool resolve_path(const std::string& target, const std::string& index,
-                  fs::path& file_obj);
+                  int root_fd, size_t root_length, fs::path& file_obj,
+                  std::shared_ptr<const OpenFileCache::File>& opened);
 bool get_file_from_loc(const std::string& req_target, LocationBlock* location,
-                       fs::path& file_obj, http::status& status);
+                       fs::path& file_obj,
+                       std::shared_ptr<const OpenFileCache::File>& opened,
+                       http::status& status);
 
 
 /// Generates a response to a given GET request.
 Response* FileRequestHandler::handle_request(const Request& req){
   http::status status = http::status::ok; // Response status code 200
-  std::ostringstream file_contents;
+  std::string file_contents;
+  std::shared_ptr<const std::string> shared_body; // Cached file contents
   std::string content_type = "text/html"; // Overwritten if valid file opened
   std::string last_modified = "";
+  std::string etag = ""; // Strong entity tag, a hash of the file's contents
+  std::string content_encoding = ""; // Set if a precompressed file is served
+  std::uint64_t file_size = 0;
+  std::vector<Response::byte_range> ranges; // Requested with Range, if any
   fs::path file_obj;
-
-  // Attempt to match req_target to a location block in the web server config
-  LocationBlock* location = get_location(std::string(req.target()), config_);
-
-  if (location != nullptr){ // Matching location block found
-    // Attempt to match req_target to a file given matched location block
-    if (!get_file_from_loc(std::string(req.target()), location, file_obj, status)){
-      // Matching file not found. get_file_from_loc sets status, fall through to res
-      // Log::trace(LOG_PRE, "get_file_from_loc returned false. Status: " + std::to_string(static_cast<int>(status)));
-    }
+  // The file as looked up when its path was resolved, see OpenFileCache
+  std::shared_ptr<const OpenFileCache::File> opened;
+  bool found = false;
+
+  /* Files are looked up by the decoded path of req_target (like Nginx's
+     $uri), beneath the root directory of the matched location or server. */
+  std::string uri;
+  LocationBlock* location = nullptr;
+  if (!Config::decode_uri(req.target(), uri))
+    status = http::status::bad_request; // Response status code 400
+  // Attempt to match uri to a location block in the web server config
+  else if ((location = config_->get_location(uri)) != nullptr){ // Matching location block found
+    // Attempt to match uri to a file given matched location block
+    found = get_file_from_loc(uri, location, file_obj, opened, status);
+    // If not found, get_file_from_loc sets status, fall through to res
   }
   else{ // No matching location block found
     // Attempt to resolve relative path to a file object
-    // Log::trace(LOG_PRE, "No location block, trying " + config_->root + std::string(req.target()));
-    if (!resolve_path(config_->root + std::string(req.target()), config_->index, file_obj))
+    // Log::trace(LOG_PRE, "No location block, trying " + config_->root + uri);
+    found = resolve_path(config_->root + uri, config_->index, config_->root_fd,
+                         config_->root.size(), file_obj, opened);
+    if (!found)
       status = http::status::not_found; 
   }
-
-  fs::ifstream fstream(file_obj); // Attempt to open the file
-  if (fstream){ // Successfully opened the file
-    last_modified = last_modified_time(file_obj);
-    try{ // If validation request, compare last_modified to cached time
-      std::string cached_time = std::string(
-        req.at(http::field::if_modified_since));
-      if (last_modified == cached_time) // Else last_modified is newer
+  // file_obj starts with the root that it was found beneath
+  int root_fd = location ? location->root_fd : config_->root_fd;
+  size_t root_length = location ? location->root.size() : config_->root.size();
+
+  /* With gzip_static/brotli_static on, serve a precompressed sidecar (e.g.,
+     main.js.br next to main.js) if the client accepts its encoding. file_obj
+     stays the requested file, which determines Content-Type. */
+  bool gzip_static = location ?
+    location->gzip_static.value_or(config_->gzip_static) : config_->gzip_static;
+  bool brotli_static = location ?
+    location->brotli_static.value_or(config_->brotli_static) : config_->brotli_static;
+  fs::path served = file_obj;
+  if (found && (gzip_static || brotli_static))
+    content_encoding = precompressed(req, gzip_static, brotli_static, root_fd,
+                                     root_length, served, opened);
+
+  // Hot files are served from memory without reading them (see FileCache)
+  std::string cache_key = served.lexically_normal().string();
+  std::shared_ptr<const FileCache::Entry> cached = FileCache::inst().find(cache_key);
+
+  /* Otherwise the file was opened and stat(2)ed when its path was resolved,
+     and is reused from OpenFileCache (if enabled) until its validity period
+     ends. */
+  if (!found || cached)
+    opened = nullptr; // Release the descriptor, if it isn't cached
+
+  /* Validators are computed once per version of a file and memoized, so a
+     revalidation of an unchanged file is answered with 304 without reading
+     it. */
+  struct stat info;
+  bool memoized = false;
+  if (cached){
+    etag = cached->etag;
+    last_modified = cached->last_modified;
+  }
+  else if (opened && opened->exists){
+    info = opened->info;
+    memoized = FileCache::inst().find_metadata(cache_key, info, etag, last_modified);
+  }
+  if ((cached || memoized) && not_modified(req, etag, last_modified))
+    status = http::status::not_modified; // Response status code 304
+
+  /* Otherwise send the opened file. Plain HTTP sessions send the body
+     straight from the page cache with sendfile(2), as do HTTPS sessions with
+     kTLS. Without kTLS, HTTPS sessions read and encrypt it in chunks, so
+     small files are read into the response instead. Small files are read
+     into FileCache either way, if it is enabled. */
+  bool use_sendfile = config_->type == Config::ServerType::HTTP_SERVER;
+  auto file = std::make_shared<http::file_body::value_type>(); // Not open
+  if (!cached && status != http::status::not_modified && opened && opened->body)
+    file = opened->body; // Shared with other responses, read at offsets only
+
+  // Found the file (already revalidated if memoized)
+  if (cached || file->is_open() || status == http::status::not_modified){
+    if (file->is_open() && !memoized){ // New version of the file, hash it
+      if (hash_file(*file, info, etag, hash_max_size)){
+        last_modified = http_date(info.st_mtim.tv_sec);
+        FileCache::inst().insert_metadata(cache_key, info, etag, last_modified);
+      }
+      else // Changed while hashing, send no ETag rather than a wrong one
+        last_modified = http_date(opened->info.st_mtim.tv_sec); // No path lookup
+      if (not_modified(req, etag, last_modified))
         status = http::status::not_modified; // Response status code 304
     }
-    // req.at() throws if not validation request. Safe to catch and ignore.
-    catch(std::out_of_range){}
 
-    content_type = mime_type(file_obj);
+    content_type = cached ? cached->content_type : mime_type(served);
+
+    /* Range requests are answered from the open file or cached buffer, so
+       only the requested bytes are read. The Range header is ignored if it is
+       invalid or If-Range names another version of the file. */
+    file_size = cached ? cached->body->size() : file->size();
+    if (status == http::status::ok && req.count(http::field::range) &&
+        if_range_matches(req, etag, last_modified) &&
+        parse_ranges(req[http::field::range], file_size, ranges)){
+      if (ranges.empty())
+        status = http::status::range_not_satisfiable; // Response status code 416
+      else if (ranges.size() > 1 && !content_encoding.empty())
+        ranges.clear(); // Parts of a compressed sidecar can't be multipart, send it all
+      else
+        status = http::status::partial_content; // Response status code 206
+    }
 
-    if (status != http::status::not_modified)
-      file_contents << fstream.rdbuf(); // Read file into string stream
+    bool cacheable = !cached && FileCache::inst().max_size() &&
+                     file->size() <= FileCache::max_entry_size;
+    if (status == http::status::not_modified ||
+        status == http::status::range_not_satisfiable){} // No body
+    else if (cached)
+      shared_body = cached->body;
+    else if (status == http::status::partial_content){} // Ranges read from file
+    else if (cacheable || (!use_sendfile && file->size() <= FileCache::max_entry_size)){
+      FileCache::Entry entry{nullptr, content_type, last_modified, 0, etag};
+      if (!read_file(*file, file_contents, entry.mtime_ns)){
+        Log::error(LOG_PRE, "Failed to read file " + served.string());
+        status = http::status::internal_server_error; // Response status code 500
+        file_contents = "<h1>Internal Server Error (Error 500).</h1>";
+      }
+      else if (cacheable){
+        entry.body = std::make_shared<const std::string>(std::move(file_contents));
+        FileCache::inst().insert(cache_key, entry); // Served even if rejected
+        shared_body = entry.body;
+      }
+    }
+    if (!content_encoding.empty()) // Sidecar is sent as the requested file
+      content_type = mime_type(file_obj);
   }
   else if (status == http::status::ok){
     /* File exists, but failed to open it for some reason. Since the server
@@ -71,10 +199,10 @@ Response* FileRequestHandler::handle_request(const Request& req){
        inadequate resources being the only failure condition. */
     Log::error(LOG_PRE, "Failed to open file (possibly inadequate resources)");
     status = http::status::internal_server_error; // Response status code 500
-    file_contents << "<h1>Internal Server Error (Error 500).</h1>";
+    file_contents = "<h1>Internal Server Error (Error 500).</h1>";
   }
   /* If status is not 200 OK, it was set by get_file_from_loc; file does not
-     exist and fstream returning false is not an error. Fall through to res. */
+     exist and failing to open it is not an error. Fall through to res. */
 
   // Construct and return pointer to HTTP response object
   Response* res = new Response();
@@ -87,22 +215,73 @@ Response* FileRequestHandler::handle_request(const Request& req){
   else
     res->set(http::field::connection, "close");
 
-  if (file_contents.str().length() > 0){ // If response body exists
+  // Body is sent from the opened file, if it wasn't read and isn't empty
+  bool file_body = status != http::status::not_modified &&
+                   status != http::status::range_not_satisfiable &&
+                   !shared_body && file_contents.empty() && file->is_open() &&
+                   file->size() > 0;
+  bool memory_body = shared_body && shared_body->size() > 0;
+  if (status == http::status::range_not_satisfiable){ // 416 Range Not Satisfiable
+    res->set(http::field::content_range, "bytes */" + std::to_string(file_size));
+    res->content_length(0); // Set Content-Length, no body
+  }
+  else if (file_body || memory_body || file_contents.length() > 0){ // If response body exists
     // Set Cache-Control, Content-Type, and Last-Modified headers
     res->set(http::field::cache_control, "public, max-age=604800, immutable");
     res->set(http::field::content_type, content_type); 
     res->set(http::field::last_modified, last_modified);
-    res->body() = file_contents.str(); // Set response body
-    res->prepare_payload(); // Set Content-Length
+    if (!etag.empty() && status != http::status::internal_server_error)
+      res->set(http::field::etag, etag);
+    if (!content_encoding.empty() && status != http::status::internal_server_error)
+      res->set(http::field::content_encoding, content_encoding);
+    if (found && (gzip_static || brotli_static)) // Body depends on Accept-Encoding
+      res->set(http::field::vary, "Accept-Encoding");
+    if (file_body || memory_body) // Clients may request ranges of files
+      res->set(http::field::accept_ranges, "bytes");
+    if (file_body || memory_body){
+      if (file_body)
+        res->file = file; // Session sends the file after the headers
+      else
+        res->shared_body = shared_body; // Session writes the buffer in place
+      if (!ranges.empty()) // 206 Partial Content, only send requested ranges
+        set_ranges(*res, std::move(ranges), content_type, file_size);
+      res->content_length(res->payload_size()); // Set Content-Length
+    }
+    else{
+      res->body() = std::move(file_contents); // Set response body
+      res->prepare_payload(); // Set Content-Length
+    }
   }
-  else if (status == http::status::not_modified) // 304 Not Modified
-    // Set Cache-Control header only
+  else if (status == http::status::not_modified){ // 304 Not Modified
+    // Set Cache-Control and ETag (and Vary, as above) headers only
     res->set(http::field::cache_control, "public, max-age=604800, immutable");
+    if (!etag.empty())
+      res->set(http::field::etag, etag);
+    if (gzip_static || brotli_static)
+      res->set(http::field::vary, "Accept-Encoding");
+  }
 
   return res;
 }
 
 
+/** 
+ * Formats a time as an HTTP date (e.g., "Sun, 06 Nov 1994 08:49:37 GMT").
+ *
+ * @param time Seconds since the epoch.
+ * @returns The time in HTTP time string format.
+ * @relatesalso FileRequestHandler
+ */
+std::string http_date(std::time_t time){
+  tm gm;
+  gmtime_r(&time, &gm); // Thread-safe, unlike std::gmtime
+  char date[32];
+  // Conversion specifiers: https://en.cppreference.com/w/cpp/chrono/c/strftime
+  // HTTP Spec: <day-name>, <day> <month> <year> <hour>:<minute>:<second> GMT
+  return std::string(date, std::strftime(date, sizeof(date), "%a, %d %b %Y %T GMT", &gm));
+}
+
+
 /** 
  * Returns the last modified time for the given file. Used for HTTP caching.
  *
@@ -111,14 +290,148 @@ Response* FileRequestHandler::handle_request(const Request& req){
  * @relatesalso FileRequestHandler
  */
 std::string last_modified_time(fs::path file_obj){
-  std::time_t last_write_time = fs::last_write_time(file_obj);
-  tm* gm = std::gmtime(&last_write_time);
+  return http_date(fs::last_write_time(file_obj));
+}
 
-  std::stringstream ss; // std::put_time must be used with a stream
-  // Conversion specifiers: https://en.cppreference.com/w/cpp/io/manip/put_time
-  // HTTP Spec: <day-name>, <day> <month> <year> <hour>:<minute>:<second> GMT
-  ss << std::put_time(gm, "%a, %d %b %Y %T %Z");
-  return ss.str();
+
+/** 
+ * Reads an opened file into memory.
+ *
+ * @param[in] file An opened file.
+ * @param[out] contents The contents of the file.
+ * @param[out] mtime_ns The file's modification time (in nanoseconds) before it
+ *   was read, for FileCache to detect changes made while reading.
+ * @returns Boolean true on success, false if a read failed.
+ * @relatesalso FileRequestHandler
+ */
+bool read_file(http::file_body::value_type& file, std::string& contents,
+               std::int64_t& mtime_ns){
+  struct stat info;
+  if (::fstat(file.file().native_handle(), &info))
+    return false;
+  mtime_ns = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+
+  // pread(2), as other responses may be reading the same descriptor
+  contents.resize(file.size());
+  for (size_t read = 0; read < contents.size();){
+    ssize_t bytes = ::pread(file.file().native_handle(), &contents[read],
+                            contents.size() - read, read);
+    if (bytes <= 0) // Error, or file shrank while reading
+      return false;
+    read += bytes;
+  }
+  return true;
+}
+
+
+/** 
+ * Computes the 64-bit xxHash (XXH64) of a buffer. Fast enough to hash every
+ * new version of a file, and stable across restarts and machines.
+ *
+ * @param data The buffer to hash.
+ * @param size The size of the buffer in bytes.
+ * @param seed The hash of the preceding data, if hashing in chunks.
+ * @returns The hash of the buffer.
+ * @relatesalso FileRequestHandler
+ */
+std::uint64_t xxh64(const char* data, size_t size, std::uint64_t seed){
+  const std::uint64_t P1 = 0x9E3779B185EBCA87ULL, P2 = 0xC2B2AE3D27D4EB4FULL,
+                      P3 = 0x165667B19E3779F9ULL, P4 = 0x85EBCA77C2B2AE63ULL,
+                      P5 = 0x27D4EB2F165667C5ULL;
+  auto rotl = [](std::uint64_t x, int r){ return (x << r) | (x >> (64 - r)); };
+  auto read64 = [](const char* p){ std::uint64_t v; std::memcpy(&v, p, 8); return v; };
+  auto read32 = [](const char* p){ std::uint32_t v; std::memcpy(&v, p, 4); return v; };
+  auto round = [&](std::uint64_t acc, std::uint64_t input){
+    return rotl(acc + input * P2, 31) * P1;
+  };
+  auto merge = [&](std::uint64_t acc, std::uint64_t lane){
+    return (acc ^ round(0, lane)) * P1 + P4;
+  };
+
+  const char* p = data;
+  const char* end = data + size;
+  std::uint64_t h;
+  if (size >= 32){ // Four lanes of 8 bytes at a time
+    std::uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+    for (; p + 32 <= end; p += 32){
+      v1 = round(v1, read64(p));
+      v2 = round(v2, read64(p + 8));
+      v3 = round(v3, read64(p + 16));
+      v4 = round(v4, read64(p + 24));
+    }
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+  }
+  else
+    h = seed + P5;
+  h += size;
+  for (; p + 8 <= end; p += 8) // Remaining bytes
+    h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+  if (p + 4 <= end){
+    h = rotl(h ^ (read32(p) * P1), 23) * P2 + P3;
+    p += 4;
+  }
+  for (; p < end; p++)
+    h = rotl(h ^ (static_cast<unsigned char>(*p) * P5), 11) * P1;
+  h ^= h >> 33; // Avalanche
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  return h ^ (h >> 32);
+}
+
+
+/** 
+ * Computes the strong entity tag of an opened file from its contents, so that
+ * it only changes when the contents do (unlike mtime/size based tags).
+ * Reading a file blocks the IO thread, so files over max_size get a tag from
+ * their mtime and size instead, like Nginx's.
+ *
+ * @param[in] file An opened file.
+ * @param[out] info The stat(2) of the file that was hashed.
+ * @param[out] etag The entity tag, a 16 digit hex hash in double quotes, or
+ *   "<mtime in ns>-<size>" in hex in double quotes for a file over max_size.
+ * @param[in] max_size The largest file to hash.
+ * @returns Boolean true on success, false if a read failed or the file changed
+ *   while it was hashed.
+ * @relatesalso FileRequestHandler
+ */
+bool hash_file(http::file_body::value_type& file, struct stat& info,
+               std::string& etag, std::uint64_t max_size){
+  etag.clear();
+  int fd = file.file().native_handle();
+  if (::fstat(fd, &info))
+    return false;
+  if (static_cast<std::uint64_t>(info.st_size) > max_size){
+    char tag[36];
+    std::snprintf(tag, sizeof(tag), "\"%llx-%llx\"",
+                  static_cast<unsigned long long>(info.st_mtim.tv_sec) * 1000000000ULL +
+                    info.st_mtim.tv_nsec,
+                  static_cast<unsigned long long>(info.st_size));
+    etag = tag;
+    return true;
+  }
+
+  std::uint64_t hash = 0;
+  std::unique_ptr<char[]> chunk(new char[65536]);
+  for (off_t offset = 0; offset < info.st_size;){
+    ssize_t bytes = ::pread(fd, chunk.get(),
+                            std::min<off_t>(info.st_size - offset, 65536), offset);
+    if (bytes <= 0) // Error, or file shrank while hashing
+      return false;
+    hash = xxh64(chunk.get(), bytes, hash); // Chained, seeded by the previous chunk
+    offset += bytes;
+  }
+
+  struct stat after;
+  if (::fstat(fd, &after) || after.st_size != info.st_size ||
+      after.st_mtim.tv_sec != info.st_mtim.tv_sec ||
+      after.st_mtim.tv_nsec != info.st_mtim.tv_nsec)
+    return false;
+  char hex[19];
+  std::snprintf(hex, sizeof(hex), "\"%016llx\"", static_cast<unsigned long long>(hash));
+  etag = hex;
+  return true;
 }
 
 
@@ -155,106 +468,250 @@ std::string mime_type(fs::path file_obj){
 
 
 /** 
- * Resolves request target URI to a location block in the web server config.
+ * Checks whether the Accept-Encoding header of a request allows an encoding.
  *
- * @pre ConfigParser::parse() succeeded.
- * @param req_target The target URI of the incoming request.
- * @param config The parameters of the session that dispatched this handler.
- * @returns A pointer to a parsed location block from the web server config.
+ * @param req The incoming request.
+ * @param encoding A content coding (e.g., "gzip").
+ * @returns Boolean true if encoding (or *) is listed without q=0.
  * @relatesalso FileRequestHandler
  */
-LocationBlock* get_location(const std::string& req_target, Config* config){
-  // Log::trace(LOG_PRE, "Resolving path for request target \"" + req_target + "\".");
-
-  // Step 1. Search location blocks for exact matches
-  for (LocationBlock* location : config->locations[LocationBlock::ModifierType::EXACT_MATCH]){
-    if (req_target == location->uri){
-      // Log::trace(LOG_PRE, req_target + " is an exact match with URI: " + location->uri);
-      return location; // Match found, stop searching
-    }
+bool accepts_encoding(const Request& req, const std::string& encoding){
+  bool wildcard = false;
+  // e.g., "Accept-Encoding: gzip, deflate;q=0.5, br;q=1.0, *;q=0"
+  for (const auto& coding : http::ext_list(req[http::field::accept_encoding])){
+    bool refused = false; // q=0 means "not acceptable"
+    for (const auto& param : coding.second)
+      if (boost::iequals(param.first, "q"))
+        refused = std::strtod(std::string(param.second).c_str(), nullptr) == 0;
+    if (boost::iequals(coding.first, encoding))
+      return !refused; // Explicit entry takes precedence over *
+    if (coding.first == "*")
+      wildcard = !refused;
   }
+  return wildcard;
+}
 
-  // Step 2. Search location blocks for longest prefix match
-  LocationBlock* longest_prefix_match = nullptr;
-  LocationBlock* longest_prefix_match_stop = nullptr;
-
-  // Search location blocks for prefix match with stop modifier
-  for (LocationBlock* location : config->locations[LocationBlock::ModifierType::PREFIX_MATCH_STOP]){
-    if (req_target.find(location->uri) == 0){ // Prefix match
-      // Log::trace(LOG_PRE, req_target + " prefix match with stop modifier: " + location->uri);
-      if (longest_prefix_match_stop == nullptr || // First prefix match OR
-          // Matched URI longer than previous longest prefix match
-          location->uri.length() > longest_prefix_match_stop->uri.length())
-        longest_prefix_match_stop = location; // Save longest prefix match
+
+/** 
+ * Checks the conditional headers of a request against the current version of
+ * the file. If-None-Match takes precedence over If-Modified-Since.
+ *
+ * @param req The incoming request.
+ * @param etag The ETag of the file, or "" if it couldn't be computed.
+ * @param last_modified The Last-Modified time of the file.
+ * @returns Boolean true if the client's copy is current (304 Not Modified).
+ * @relatesalso FileRequestHandler
+ */
+bool not_modified(const Request& req, const std::string& etag,
+                  const std::string& last_modified){
+  auto if_none_match = req.find(http::field::if_none_match);
+  if (if_none_match != req.end()){ // e.g., "If-None-Match: "a1", W/"b2""
+    std::vector<std::string> tags;
+    boost::split(tags, if_none_match->value(), boost::is_any_of(","));
+    for (std::string tag : tags){
+      boost::trim(tag);
+      if (tag == "*") // Any version of the file
+        return true;
+      if (tag.compare(0, 2, "W/") == 0) // Weak comparison ignores W/
+        tag.erase(0, 2);
+      if (!etag.empty() && tag == etag)
+        return true;
     }
+    return false;
   }
+  // Else last_modified is newer (exact match, as sent by the server)
+  auto if_modified_since = req.find(http::field::if_modified_since);
+  return if_modified_since != req.end() && if_modified_since->value() == last_modified;
+}
+
 
-  // Search location blocks for prefix match with no modifier
-  for (LocationBlock* location : config->locations[LocationBlock::ModifierType::NONE]){
-    if (req_target.find(location->uri) == 0){ // Prefix match
-      // Log::trace(LOG_PRE, req_target + " prefix match with no modifier: " + location->uri);
-      if (longest_prefix_match == nullptr || // First prefix match OR
-          // Matched URI longer than previous longest prefix match
-          location->uri.length() > longest_prefix_match->uri.length())
-        longest_prefix_match = location; // Save longest prefix match
+/** 
+ * Checks the If-Range header of a request, which makes a Range request
+ * conditional on the file being unchanged.
+ *
+ * @param req The incoming request.
+ * @param etag The ETag of the file, or "" if it couldn't be computed.
+ * @param last_modified The Last-Modified time of the file.
+ * @returns Boolean true if there is no If-Range or it matches etag (strong
+ *   comparison, so never a weak tag) or last_modified.
+ * @relatesalso FileRequestHandler
+ */
+bool if_range_matches(const Request& req, const std::string& etag,
+                      const std::string& last_modified){
+  auto if_range = req.find(http::field::if_range);
+  return if_range == req.end() || if_range->value() == last_modified ||
+         (!etag.empty() && if_range->value() == etag);
+}
+
+
+/** 
+ * Parses the Range header of a request (e.g., "bytes=0-499, -500").
+ *
+ * @param[in] header The value of the Range header.
+ * @param[in] size The size of the file in bytes.
+ * @param[out] ranges The satisfiable ranges, clamped to size.
+ * @returns Boolean false if the header is invalid and should be ignored (also
+ *   if it has more than max_ranges ranges). True otherwise, with ranges empty
+ *   if none are satisfiable.
+ * @relatesalso FileRequestHandler
+ */
+bool parse_ranges(boost::beast::string_view header, std::uint64_t size,
+                  std::vector<Response::byte_range>& ranges){
+  enum{max_ranges = 16}; // Bounds the response to 16x the file size
+  if (header.size() < 6 || !boost::iequals(header.substr(0, 6), "bytes="))
+    return false; // bytes is the only range unit
+  std::vector<std::string> specs;
+  boost::split(specs, header.substr(6), boost::is_any_of(","));
+  if (specs.size() > max_ranges)
+    return false;
+
+  // Returns true if value is a whole decimal integer (no sign, no overflow)
+  auto parse_uint = [](const std::string& value, std::uint64_t& out){
+    const char* end = value.data() + value.size();
+    auto [ptr, ec] = std::from_chars(value.data(), end, out);
+    return ec == std::errc() && ptr == end;
+  };
+
+  ranges.clear();
+  for (std::string spec : specs){
+    boost::trim(spec);
+    if (spec.empty()) // Empty list elements are allowed
+      continue;
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos)
+      return false;
+    std::string first = spec.substr(0, dash);
+    std::string last = spec.substr(dash + 1);
+    std::uint64_t start, end;
+    if (first.empty()){ // Suffix range (e.g., -500 for the last 500 bytes)
+      if (!parse_uint(last, end))
+        return false;
+      if (end == 0 || size == 0)
+        continue; // Unsatisfiable
+      start = size > end ? size - end : 0;
+      end = size - 1;
     }
+    else{ // e.g., 0-499, or 500- for the rest of the file
+      if (!parse_uint(first, start) || (last.size() && !parse_uint(last, end)))
+        return false;
+      if (last.empty())
+        end = size - 1;
+      else if (end < start)
+        return false;
+      if (start >= size)
+        continue; // Unsatisfiable
+      end = std::min(end, size - 1);
+    }
+    ranges.push_back({start, end - start + 1, ""});
   }
+  return true;
+}
 
-  // Prefix match with stop modifier exists
-  if (longest_prefix_match_stop != nullptr){
-    if (longest_prefix_match == nullptr || // No prefix match w/o modifier OR
-        // Prefix match with stop modifier is longer
-        longest_prefix_match_stop->uri.length() > longest_prefix_match->uri.length()){
-      // Longest prefix match has a stop modifier
-      // Log::trace(LOG_PRE, "Longest prefix match has a stop modifier: " + longest_prefix_match_stop->uri);
-      return longest_prefix_match_stop; // Match found, stop searching
-    }
+
+/** 
+ * Sets up a response to send only the given ranges of its body: a single range
+ * gets a Content-Range header, several become a multipart/byteranges body.
+ *
+ * @param res The response, with its body (file or shared_body) already set.
+ * @param ranges The ranges to send, as produced by parse_ranges.
+ * @param content_type The type of the file.
+ * @param size The size of the file in bytes.
+ * @relatesalso FileRequestHandler
+ */
+void set_ranges(Response& res, std::vector<Response::byte_range> ranges,
+                const std::string& content_type, std::uint64_t size){
+  auto content_range = [size](const Response::byte_range& range){
+    return "bytes " + std::to_string(range.offset) + "-" +
+           std::to_string(range.offset + range.length - 1) + "/" +
+           std::to_string(size);
+  };
+  if (ranges.size() == 1){
+    res.set(http::field::content_range, content_range(ranges[0]));
+    res.ranges = std::move(ranges);
+    return;
   }
 
-  // Prefix match with stop modifier does not exist OR is not longest
-  if (longest_prefix_match != nullptr){ // Longest prefix match has no modifier
-    // Log::trace(LOG_PRE, "Longest prefix match has no modifier: \"" + longest_prefix_match->uri + "\".");
-
-    /* TODO: Maybe implement regex matching?
-    // Log::trace(LOG_PRE, "Longest prefix match has no modifier: \"" + longest_prefix_match->uri + "\". Continuing to regex matching.");
-    // Step 3. Search location blocks for regex match. Regex match doesn't care about length, first match wins.
-    for (LocationBlock* location : config->locations[LocationBlock::ModifierType::REGEX_MATCH]){
-      // TODO: Case sensitivity
-      std::smatch matched;
-      if (std::regex_search(req_target, matched, std::regex(location->uri))){
-        for (std::string match : matched)
-          // Log::trace(LOG_PRE, "Found regex match: " + match);
-        // TODO: STOP and resolve this to a file path
-      }
-    }
-    // Step 4. Fallback to longest prefix match with no stop modifier
-    // Log::trace(LOG_PRE, "No regex match found, using longest prefix match with no stop modifier.");
-    */
+  // Random, so the boundary can't be forged by the file's contents
+  thread_local std::mt19937_64 random{std::random_device{}()};
+  char boundary[17];
+  std::snprintf(boundary, sizeof(boundary), "%016llx",
+                static_cast<unsigned long long>(random()));
+  res.set(http::field::content_type,
+          std::string("multipart/byteranges; boundary=") + boundary);
+  for (Response::byte_range& range : ranges)
+    range.prefix = std::string("\r\n--") + boundary + "\r\n"
+                   "Content-Type: " + content_type + "\r\n"
+                   "Content-Range: " + content_range(range) + "\r\n\r\n";
+  res.ranges = std::move(ranges);
+  res.ranges_suffix = std::string("\r\n--") + boundary + "--\r\n";
+}
 
-    return longest_prefix_match; // Match found, stop searching
+
+/** 
+ * Finds a precompressed sidecar of a file that the client accepts, preferring
+ * Brotli (<file>.br) over gzip (<file>.gz).
+ *
+ * @param[in] req The incoming request.
+ * @param[in] gzip_static Whether <file>.gz may be served.
+ * @param[in] brotli_static Whether <file>.br may be served.
+ * @param[in] root_fd The root directory that file_obj was found beneath.
+ * @param[in] root_length The length of the root directory in file_obj.
+ * @param[in,out] file_obj The requested file, replaced by the sidecar if found.
+ * @param[in,out] opened The lookup of file_obj, replaced like file_obj.
+ * @returns The Content-Encoding of the sidecar, or "" if none is served.
+ * @relatesalso FileRequestHandler
+ */
+std::string precompressed(const Request& req, bool gzip_static,
+                          bool brotli_static, int root_fd, size_t root_length,
+                          fs::path& file_obj,
+                          std::shared_ptr<const OpenFileCache::File>& opened){
+  std::pair<bool, std::string> encodings[] = {{brotli_static, "br"},
+                                              {gzip_static, "gzip"}};
+  for (const auto& [enabled, encoding] : encodings){
+    if (!enabled || !accepts_encoding(req, encoding))
+      continue;
+    fs::path sidecar = file_obj.string() + (encoding == "br" ? ".br" : ".gz");
+    // Missing sidecars are cached too, if open_file_cache_errors is on
+    std::shared_ptr<const OpenFileCache::File> file =
+      OpenFileCache::inst().find(root_fd, sidecar.string(), root_length);
+    if (S_ISREG(file->info.st_mode)){
+      file_obj = sidecar;
+      opened = file;
+      return encoding;
+    }
   }
-  return nullptr;
+  return "";
 }
 
 
 /** 
  * Helper function for get_file_from_loc, tests target path for matching file.
+ * Lookups go through OpenFileCache, so a path probed again within its
+ * validity period (e.g., by try_files) costs no syscalls. The part of target
+ * after its root is opened beneath root_fd, so it can't resolve to a file
+ * outside of the root (e.g., with ".." or a symlink).
  *
  * @pre ConfigParser::parse() succeeded.
  * @param[in] target The target path in the current context (not req_target)
  * @param[in] index The value of the index directive in the current context.
+ * @param[in] root_fd The root directory in the current context.
+ * @param[in] root_length The length of the root directory in target.
  * @param[out] file_obj A path object for the target file.
+ * @param[out] opened The lookup of the target file, reused to serve it.
  * @returns Boolean true if matching file found, false otherwise.
  * @relatesalso FileRequestHandler
  */
 bool resolve_path(const std::string& target, const std::string& index,
-                  fs::path& file_obj){
+                  int root_fd, size_t root_length, fs::path& file_obj,
+                  std::shared_ptr<const OpenFileCache::File>& opened){
   file_obj = target; // Set path to target being tested
 
-  if (exists(file_obj)){
-    if (is_directory(file_obj)){
+  opened = OpenFileCache::inst().find(root_fd, target, root_length);
+  if (opened->exists){
+    if (opened->directory){
       file_obj += '/' + index; // If directory, look for index
-      if (exists(file_obj))
+      opened = OpenFileCache::inst().find(root_fd, file_obj.string(), root_length);
+      if (opened->exists)
         return true; // Matched file, get_file_from_loc returns early
     }
     else // Exists and is not a directory
@@ -268,66 +725,59 @@ bool resolve_path(const std::string& target, const std::string& index,
  * Resolves request target URI to a location block in the web server config.
  *
  * @pre ConfigParser::parse() succeeded.
- * @param[in] req_target The target URI of the incoming request.
+ * @param[in] req_target The decoded path of the incoming request's target
+ *                       URI (see Config::decode_uri).
  * @param[in] location   A parsed location block in the web server config that
  *                       matches req_target.
  * @param[out] file_obj  A path object for the target file.
+ * @param[out] opened    The lookup of the target file (see resolve_path).
  * @param[out] status    HTTP status code associated with the resolved file.
  * @returns Boolean true if matching file found, false otherwise.
  * @relatesalso FileRequestHandler
  */
 bool get_file_from_loc(const std::string& req_target, LocationBlock* location,
-                       fs::path& file_obj, http::status& status){
+                       fs::path& file_obj,
+                       std::shared_ptr<const OpenFileCache::File>& opened,
+                       http::status& status){
   // Log::trace(LOG_PRE, "get_file_from_loc for req_target: \"" + req_target + "\"");
   if (location->try_files_args.size()){ // try_files directive present
-    // Try all relative paths specified by the try_files directive
-    for (std::string try_files_arg : location->try_files_args){
-      // Resolve $uri variable within try_files_arg if present
-      std::size_t uri_arg_pos = try_files_arg.find("$uri");
-      if (uri_arg_pos == std::string::npos){ // arg does not contain $uri
-        // Log::trace(LOG_PRE, "try_files_arg \"" + try_files_arg + "\" does not contain $uri, serving as-is.");
-        if (resolve_path(location->root + "/" + try_files_arg, location->index, file_obj))
-          return true; // Return early if matching file found
-      }
-      else{ // arg contains $uri, resolve
-        std::string target = try_files_arg; // Copy try_files_arg for in-place replace
-        target.replace(uri_arg_pos, 4, req_target);
-        // Log::trace(LOG_PRE, "try_files_arg contains $uri, resolved to \"" + target + "\"");
-        if (resolve_path(location->root + "/" + target, location->index, file_obj))
-          return true; // Return early if matching file found
+    /* Try all paths specified by the try_files directive, compiled by
+       Config::validate() with root prepended. $uri variables are resolved by
+       joining the segments of each path with req_target. */
+    std::string target;
+    for (const std::vector<std::string>& segments : location->try_files_paths){
+      target = segments[0];
+      for (size_t i = 1; i < segments.size(); i++){
+        target += req_target;
+        target += segments[i];
       }
+      if (resolve_path(target, location->index, location->root_fd,
+                       location->root.size(), file_obj, opened))
+        return true; // Return early if matching file found
     }
     // If no early return, no matching file found, use fallback parameter
-    if (location->try_files_fallback[0] == '='){ // Fallback is a return code
-      // Extract status code from parameter (e.g., "=404")
-      std::string fallback_status = location->try_files_fallback.substr(1, 3);
-      try{ // Convert fallback status code to boost http::status
-        // Throws boost::bad_lexical_cast if not valid integer
-        int fallback_status_int = boost::lexical_cast<int>(fallback_status);
-        // No throw on invalid status code, just sets http::status::unknown
-        status = http::int_to_status(fallback_status_int);
-      } 
-      catch (boost::bad_lexical_cast){ // Thrown by lexical_cast()
-        status = http::status::unknown;
-        Log::error(LOG_PRE, "try_files fallback return code is not a valid "
-                   "integer, please check the config file.");
-      }
+    if (location->try_files_fallback_status >= 0){ // Fallback is a return code
+      // Checked by Config::validate(), unlisted codes are http::status::unknown
+      status = http::int_to_status(location->try_files_fallback_status);
     }
     else{ // Fallback parameter is an internal redirect URI
-      // Log::trace(LOG_PRE, "Fallback " + location->root + '/' + location->try_files_fallback);
       status = http::status::not_found;
       // Attempt to resolve fallback URI to a file object
-      if (resolve_path(location->root + '/' + location->try_files_fallback,
-          location->index, file_obj))
+      if (resolve_path(location->try_files_fallback_path, location->index,
+                       location->root_fd, location->root.size(), file_obj,
+                       opened))
         return true; // Return early if matching file found
     }
   }
   else{ // try_files directive not present, serve static file using root/index
     std::string target = req_target; // Copy req_target for in-place replace
-    // Substitute location URI with location root
-    target.replace(0, location->uri.length(), location->root);
+    /* Substitute location URI with location root. A regex has no URI prefix,
+       so the whole target is looked up under root (like "location /"). */
+    target.replace(0, location->modifier == LocationBlock::ModifierType::REGEX_MATCH ?
+                   1 : location->uri.length(), location->root);
     // Attempt to resolve static file path to a file object
-    if (resolve_path(target, location->index, file_obj))
+    if (resolve_path(target, location->index, location->root_fd,
+                     location->root.size(), file_obj, opened))
       return true; // Return early if matching file found
   }
   return false; // If no early return, failed to find any matching file
@@ -0,0 +1,31 @@
+#include "handshake_pool.h"
+#include "log.h"
+
+// Standardized log prefix for this source
+#define LOG_PRE "[TLS]      "
+
+
+/// Returns a static reference to the singleton instance of HandshakePool.
+HandshakePool& HandshakePool::inst(){
+  static HandshakePool instRef;
+  return instRef;
+}
+
+
+/// Starts the pool. Until then, handshakes run on the worker threads.
+void HandshakePool::start(unsigned threads){
+  if (!threads || pool_)
+    return;
+  pool_ = std::make_unique<boost::asio::thread_pool>(threads);
+  Log::info(LOG_PRE, "Running TLS handshakes on " + std::to_string(threads) +
+            " thread(s)");
+}
+
+
+/// Waits for queued handshake steps, then joins the pool threads.
+void HandshakePool::stop(){
+  if (!pool_)
+    return;
+  pool_->join();
+  pool_.reset();
+}
\ No newline at end of file
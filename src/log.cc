@@ -1,4 +1,5 @@
 #include <boost/log/trivial.hpp> // BOOST_LOG_TRIVIAL
+#include <mutex> // lock_guard, mutex
 
 #include "log.h"
 
@@ -10,6 +11,12 @@ void Log::res_metrics(
   size_t res_bytes,
   unsigned response_code
 ){
+  /* Boost.Log records are thread-safe individually, but the response metrics
+     and the invalid request that caused them must stay on adjacent lines when
+     multiple worker threads are logging at once. */
+  static std::mutex res_metrics_mutex;
+  std::lock_guard<std::mutex> lock(res_metrics_mutex);
+
   BOOST_LOG_TRIVIAL(info) << "[Response] " <<
     "Client: " << client_ip <<
     " | Status: " << response_code <<
@@ -0,0 +1,54 @@
+#include <algorithm> // min, min_element
+#include <re2/re2.h>
+#include <re2/set.h> // RE2::Set
+
+#include "nginx_config_location_regex_set.h"
+
+
+struct LocationRegexSet::Set : re2::RE2::Set{
+  using re2::RE2::Set::Set;
+};
+
+
+LocationRegexSet::LocationRegexSet() = default;
+LocationRegexSet::~LocationRegexSet() = default;
+
+
+/// Compiles the patterns of the regex match location blocks into one set.
+bool LocationRegexSet::compile(const std::vector<LocationBlock*>& locations){
+  set_.reset();
+  locations_.clear();
+  if (locations.empty())
+    return true; // find() needs no set
+
+  re2::RE2::Options options;
+  options.set_log_errors(false); // A bad pattern fails validation instead
+  // Unanchored like Nginx's regex locations, patterns use ^ and $ to anchor
+  std::unique_ptr<Set> set = std::make_unique<Set>(options, re2::RE2::UNANCHORED);
+  for (LocationBlock* location : locations){
+    // Set indices follow config order, which decides between several matches
+    std::string pattern = location->regex_case_sensitive ? location->uri :
+                                                           "(?i)" + location->uri;
+    if (set->Add(pattern, nullptr) < 0)
+      return false; // Not valid RE2 syntax, e.g., a backreference
+  }
+  if (!set->Compile())
+    return false; // Out of memory for the combined program
+  set_ = std::move(set);
+  locations_ = locations;
+  return true;
+}
+
+
+/// Finds the first regex match location block matching req_target's path.
+LocationBlock* LocationRegexSet::find(const std::string& req_target) const{
+  if (!set_)
+    return nullptr;
+  // Only the path is matched, like Nginx's $uri
+  re2::StringPiece path(req_target.data(), std::min(req_target.find('?'),
+                                                    req_target.size()));
+  std::vector<int> matches; // Indices of every matching pattern, unordered
+  if (!set_->Match(path, &matches))
+    return nullptr;
+  return locations_[*std::min_element(matches.begin(), matches.end())];
+}
\ No newline at end of file
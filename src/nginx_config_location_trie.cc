@@ -0,0 +1,110 @@
+#include <algorithm> // lower_bound, mismatch
+
+#include "nginx_config_location_trie.h"
+
+
+/// Removes all location blocks.
+void LocationTrie::clear(){
+  exact_.clear();
+  root_ = Node();
+}
+
+
+/// Adds an exact match or prefix match location block.
+void LocationTrie::insert(LocationBlock* location){
+  const std::string& uri = location->uri;
+  if (location->modifier == LocationBlock::ModifierType::EXACT_MATCH){
+    exact_.emplace(uri, location); // Keeps the first block with this URI
+    return;
+  }
+
+  Node* node = &root_;
+  size_t depth = 0; // Characters of uri matched by the path to node
+  while (depth < uri.size()){
+    auto it = std::lower_bound(node->children.begin(), node->children.end(),
+      uri[depth], [](const std::unique_ptr<Node>& child, char c){
+        return child->edge.front() < c;
+      });
+    if (it == node->children.end() || (*it)->edge.front() != uri[depth]){
+      // No edge starts with the next character, the rest of uri becomes one
+      it = node->children.insert(it, std::make_unique<Node>());
+      (*it)->edge = uri.substr(depth);
+      node = it->get();
+      break;
+    }
+
+    const std::string& edge = (*it)->edge;
+    size_t common = std::mismatch(edge.begin(), edge.end(), uri.begin() + depth,
+                                  uri.end()).first - edge.begin();
+    if (common < edge.size()){
+      // uri leaves or ends within the edge, split it at that point
+      std::unique_ptr<Node> split = std::make_unique<Node>();
+      split->edge = edge.substr(0, common);
+      (*it)->edge.erase(0, common);
+      split->children.push_back(std::move(*it));
+      *it = std::move(split);
+    }
+    node = it->get();
+    depth += common;
+  }
+
+  LocationBlock*& slot = location->modifier ==
+    LocationBlock::ModifierType::PREFIX_MATCH_STOP ? node->prefix_stop : node->prefix;
+  if (slot == nullptr) // Keeps the first block with this URI
+    slot = location;
+}
+
+
+/// Resolves request target URI to a location block with Nginx precedence.
+LocationBlock* LocationTrie::find(const std::string& req_target) const{
+  // Step 1. Exact match
+  if (!exact_.empty()){
+    auto it = exact_.find(req_target);
+    if (it != exact_.end())
+      return it->second; // Match found, stop searching
+  }
+
+  // Step 2. Longest prefix match, the deepest blocks on the path of req_target
+  LocationBlock* longest_prefix_match = nullptr;
+  LocationBlock* longest_prefix_match_stop = nullptr;
+  size_t longest_prefix = 0;
+  size_t longest_prefix_stop = 0;
+
+  const Node* node = &root_;
+  size_t depth = 0; // Characters of req_target matched by the path to node
+  while (true){
+    if (node->prefix){
+      longest_prefix_match = node->prefix;
+      longest_prefix = depth;
+    }
+    if (node->prefix_stop){
+      longest_prefix_match_stop = node->prefix_stop;
+      longest_prefix_stop = depth;
+    }
+    if (depth == req_target.size())
+      break;
+    const Node* next = child(*node, req_target[depth]);
+    if (next == nullptr || req_target.compare(depth, next->edge.size(), next->edge))
+      break; // req_target leaves the trie
+    depth += next->edge.size();
+    node = next;
+  }
+
+  // Prefix match with stop modifier wins only if it is longer
+  if (longest_prefix_match_stop != nullptr &&
+      (longest_prefix_match == nullptr || longest_prefix_stop > longest_prefix))
+    return longest_prefix_match_stop;
+  return longest_prefix_match; // nullptr if there is no prefix match
+}
+
+
+/// Returns the child of node whose edge starts with c, or nullptr if none.
+const LocationTrie::Node* LocationTrie::child(const Node& node, char c){
+  auto it = std::lower_bound(node.children.begin(), node.children.end(), c,
+    [](const std::unique_ptr<Node>& child, char c){
+      return child->edge.front() < c;
+    });
+  if (it == node.children.end() || (*it)->edge.front() != c)
+    return nullptr;
+  return it->get();
+}
\ No newline at end of file
@@ -1,7 +1,11 @@
 #include <boost/algorithm/string/replace.hpp> // replace_all
 #include <boost/filesystem.hpp> // exists, is_directory, path
 #include <boost/lexical_cast.hpp> // lexical_cast
+#include <algorithm> // max
+#include <climits> // INT_MAX
+#include <cstdint> // SIZE_MAX
 #include <regex> // regex, regex_replace
+#include <thread> // hardware_concurrency
 
 #include "log.h"
 #include "nginx_config_parser.h"
@@ -22,6 +26,15 @@ ConfigParser& ConfigParser::inst(){
 
 /// Returns the parsed Config objects.
 std::vector<Config*> ConfigParser::configs(){
+  std::vector<Config*> configs;
+  for (const std::shared_ptr<Config>& config : configs_)
+    configs.push_back(config.get());
+  return configs;
+}
+
+
+/// Returns the parsed Config objects, shared with the caller.
+std::vector<std::shared_ptr<Config>> ConfigParser::snapshot(){
   return configs_;
 }
 
@@ -32,6 +45,57 @@ void ConfigParser::set_working_directory(const std::string& cwd){
 }
 
 
+/// Returns the number of threads that should run the IO context.
+unsigned ConfigParser::worker_threads(){
+  if (worker_threads_) // Explicitly set by worker_threads directive
+    return worker_threads_;
+  // hardware_concurrency() may return 0 if it cannot be determined
+  return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+
+/// Returns how worker threads divide up the servers' IO.
+ConfigParser::WorkerMode ConfigParser::worker_mode(){
+  return worker_mode_;
+}
+
+
+/// Returns the size of the TLS handshake thread pool (0 if disabled).
+unsigned ConfigParser::ssl_handshake_threads(){
+  return ssl_handshake_threads_;
+}
+
+
+/// Returns the memory budget of the static file cache (0 if disabled).
+size_t ConfigParser::open_cache_max_size(){
+  return open_cache_max_size_;
+}
+
+
+/// Returns the most paths OpenFileCache may hold (0 if it is off).
+size_t ConfigParser::open_file_cache_max(){
+  return open_file_cache_max_;
+}
+
+
+/// Returns how long OpenFileCache keeps paths that aren't looked up.
+long ConfigParser::open_file_cache_inactive(){
+  return open_file_cache_inactive_;
+}
+
+
+/// Returns how often OpenFileCache checks cached paths on disk.
+long ConfigParser::open_file_cache_valid(){
+  return open_file_cache_valid_;
+}
+
+
+/// Returns whether OpenFileCache caches paths that don't exist.
+bool ConfigParser::open_file_cache_errors(){
+  return open_file_cache_errors_;
+}
+
+
 /// Parses the specified config file and populates ConfigParser.configs_.
 bool ConfigParser::parse(const std::string& file_path){
   fs::path file_obj(file_path);
@@ -40,7 +104,20 @@ bool ConfigParser::parse(const std::string& file_path){
     fs::ifstream fstream(file_obj); // Attempt to open the file
     if (fstream){ // File opened successfully
       // Log::trace(LOG_PRE, "Parsing " + file_path);
-      return parse(fstream);
+      /* Parse into a new parser, so that a parse error (e.g., on reload)
+         leaves the results of the last successful parse in place. */
+      ConfigParser staged;
+      staged.cwd_ = cwd_;
+      if (staged.parse(fstream)){
+        commit(staged); // Configs of an earlier parse live on in their snapshots
+        return true;
+      }
+      // Free the blocks that were being parsed when the error occurred
+      if (staged.context == LOCATION_CONTEXT)
+        delete staged.cur_location_block;
+      if (staged.context == SERVER_CONTEXT || staged.context == LOCATION_CONTEXT)
+        delete staged.cur_config; // Also frees its finished location blocks
+      return false;
     }
     else{ // File exists, but failed to open it for some reason.
       Log::fatal(LOG_PRE, "Found file \"" + file_path + "\" but failed to open it, aborting.");
@@ -54,6 +131,20 @@ bool ConfigParser::parse(const std::string& file_path){
 }
 
 
+/// Replaces the results of the last parse with those of a staged parser.
+void ConfigParser::commit(ConfigParser& staged){
+  worker_threads_ = staged.worker_threads_;
+  worker_mode_ = staged.worker_mode_;
+  ssl_handshake_threads_ = staged.ssl_handshake_threads_;
+  open_cache_max_size_ = staged.open_cache_max_size_;
+  open_file_cache_max_ = staged.open_file_cache_max_;
+  open_file_cache_inactive_ = staged.open_file_cache_inactive_;
+  open_file_cache_valid_ = staged.open_file_cache_valid_;
+  open_file_cache_errors_ = staged.open_file_cache_errors_;
+  configs_ = std::move(staged.configs_);
+}
+
+
 /// Parses the config pointed to by cfg_in and populates ConfigParser.configs_.
 bool ConfigParser::parse(fs::ifstream& cfg_in){
   TokenType prev_type = INIT;
@@ -188,15 +279,13 @@ bool ConfigParser::parse_block_start(std::vector<std::string>& statement){
         cur_location_block->modifier = LocationBlock::ModifierType::EXACT_MATCH; // 0
       else if (modifier == "^~") // Prefix match stop
         cur_location_block->modifier = LocationBlock::ModifierType::PREFIX_MATCH_STOP; // 1
-      /* Regex modifiers are currently not implemented, ignore them (no error).
-         May be implemented in the future. */
+      // Regex patterns are compiled when the server block is validated
       else if (modifier == "~"){ // Case-sensitive regex
-        // cur_location_block->modifier = LocationBlock::ModifierType::REGEX_MATCH; // 2
-        // cur_location_block->regex_case_sensitive = true;
-      }
-      else if (modifier == "~*"){ // Case-insensitive regex
-        // cur_location_block->modifier = LocationBlock::ModifierType::REGEX_MATCH; // 2
+        cur_location_block->modifier = LocationBlock::ModifierType::REGEX_MATCH; // 2
+        cur_location_block->regex_case_sensitive = true;
       }
+      else if (modifier == "~*") // Case-insensitive regex
+        cur_location_block->modifier = LocationBlock::ModifierType::REGEX_MATCH; // 2
       else{ // Invalid modifier
         Log::fatal(LOG_PRE, "Invalid location block modifier: " + modifier);
         return false;
@@ -228,7 +317,7 @@ bool ConfigParser::parse_block_end(std::vector<std::string>& statement){
   }
   else if (context == SERVER_CONTEXT){ // Finished parsing a server block
     if (cur_config->validate()) // If valid, push cur_config to configs_ vector
-      configs_.push_back(cur_config);
+      configs_.emplace_back(cur_config);
     else{ // If invalid, return false
       Log::fatal(LOG_PRE, "Parsed server block failed validation");
       return false; // Will cause parse() to return false
@@ -252,31 +341,131 @@ bool ConfigParser::parse_block_end(std::vector<std::string>& statement){
 bool ConfigParser::parse_statement(std::vector<std::string>& statement){
   std::string arg = statement.at(0); // First token is argument type
 
+  // Valid in main context: worker_threads, worker_mode, ssl_handshake_threads
+  if (context == MAIN_CONTEXT && arg == "worker_threads"){
+    if (statement.at(1) == "auto") // e.g., worker_threads auto;
+      worker_threads_ = 0; // Resolved to hardware thread count on request
+    else{
+      try{
+        // Throws boost::bad_lexical_cast if not valid integer
+        int worker_threads = boost::lexical_cast<int>(statement.at(1));
+        if (worker_threads < 1){
+          Log::fatal(LOG_PRE, "Invalid worker_threads \"" + statement.at(1) + "\"");
+          return false;
+        }
+        worker_threads_ = worker_threads;
+        // Log::trace(LOG_PRE, "Got worker_threads " + std::to_string(worker_threads_));
+      }
+      catch(boost::bad_lexical_cast){ // Out of range, not a number, etc.
+        Log::fatal(LOG_PRE, "Invalid worker_threads \"" + statement.at(1) + "\"");
+        return false;
+      }
+    }
+  }
+  else if (context == MAIN_CONTEXT && arg == "worker_mode"){
+    if (statement.at(1) == "shared") // e.g., worker_mode shared;
+      worker_mode_ = SHARED_WORKERS;
+    else if (statement.at(1) == "sharded") // e.g., worker_mode sharded;
+      worker_mode_ = SHARDED_WORKERS;
+    else{
+      Log::fatal(LOG_PRE, "Invalid worker_mode \"" + statement.at(1) + "\"");
+      return false;
+    }
+  }
+  else if (context == MAIN_CONTEXT && arg == "ssl_handshake_threads"){
+    try{ // e.g., ssl_handshake_threads 2;
+      // Throws boost::bad_lexical_cast if not valid integer
+      int threads = boost::lexical_cast<int>(statement.at(1));
+      if (threads < 0){
+        Log::fatal(LOG_PRE, "Invalid ssl_handshake_threads \"" + statement.at(1) + "\"");
+        return false;
+      }
+      ssl_handshake_threads_ = threads;
+    }
+    catch(boost::bad_lexical_cast){ // Out of range, not a number, etc.
+      Log::fatal(LOG_PRE, "Invalid ssl_handshake_threads \"" + statement.at(1) + "\"");
+      return false;
+    }
+  }
+  /* Valid in http context: open_cache_max_size, open_file_cache,
+     open_file_cache_valid, open_file_cache_errors */
+  else if (context == HTTP_CONTEXT && arg == "open_cache_max_size"){
+    if (!parse_size(statement.at(1), open_cache_max_size_)) // e.g., 32m
+      return false;
+    // Log::trace(LOG_PRE, "Got open_cache_max_size " + std::to_string(open_cache_max_size_));
+  }
+  else if (context == HTTP_CONTEXT && arg == "open_file_cache"){
+    open_file_cache_max_ = 0;
+    open_file_cache_inactive_ = 60;
+    bool off = statement.at(1) == "off" && statement.size() == 3; // e.g., open_file_cache off;
+    // e.g., open_file_cache max=1000 inactive=20s; (max is required)
+    for (size_t i = 1; !off && i < statement.size() - 1; i++){
+      const std::string& param = statement.at(i);
+      if (param.compare(0, 4, "max=") == 0){
+        try{
+          // Throws boost::bad_lexical_cast if not valid integer
+          long long max = boost::lexical_cast<long long>(param.substr(4));
+          if (max > 0){
+            open_file_cache_max_ = max;
+            continue;
+          }
+        }
+        catch(boost::bad_lexical_cast){} // Out of range, not a number, etc.
+      }
+      else if (param.compare(0, 9, "inactive=") == 0){
+        if (!parse_time(param.substr(9), open_file_cache_inactive_))
+          return false;
+        continue;
+      }
+      Log::fatal(LOG_PRE, "Invalid open_file_cache parameter \"" + param + "\"");
+      return false;
+    }
+    if (!off && open_file_cache_max_ == 0){
+      Log::fatal(LOG_PRE, "open_file_cache needs a max parameter");
+      return false;
+    }
+  }
+  else if (context == HTTP_CONTEXT && arg == "open_file_cache_valid"){
+    if (!parse_time(statement.at(1), open_file_cache_valid_)) // e.g., 30s
+      return false;
+  }
+  else if (context == HTTP_CONTEXT && arg == "open_file_cache_errors"){
+    if (!parse_flag(statement.at(1), open_file_cache_errors_)) // e.g., on
+      return false;
+  }
   /* Valid in server context: listen, index, root, server_name, return,
-     ssl_certificate, ssl_certificate_key, ssl_protocols, ssl_ciphers,
-     ssl_session_timeout */
-  if (context == SERVER_CONTEXT){
+     client_max_body_size, gzip_static, brotli_static, ssl_certificate,
+     ssl_certificate_key, ssl_ktls, ssl_session_cache, ssl_session_tickets,
+     ssl_session_timeout, ssl_protocols, ssl_ciphers, ssl_ecdh_curve, http2 */
+  else if (context == SERVER_CONTEXT){
     if (arg == "listen"){
+      unsigned short port;
       try{
         // Throws boost::bad_lexical_cast if >65535 or not valid integer
-        cur_config->port = boost::lexical_cast<unsigned short>(statement.at(1));
+        port = boost::lexical_cast<unsigned short>(statement.at(1));
         /* lexical_cast succeeds on negative numbers by underflowing, which is
            undesired behavior. Check for negative port number manually. */
         if (boost::lexical_cast<int>(statement.at(1)) < 0){
           Log::fatal(LOG_PRE, "Invalid port \"" + statement.at(1) + "\"");
           return false;
         }
-        // Log::trace(LOG_PRE, "Got port " + std::to_string(cur_config->port));
+        // Log::trace(LOG_PRE, "Got port " + std::to_string(port));
       }
       catch(boost::bad_lexical_cast){ // Out of range, not a number, etc.
         Log::fatal(LOG_PRE, "Invalid port \"" + statement.at(1) + "\"");
         return false;
       }
-      if (statement.size() == 3) // e.g., listen 80;
+      if (statement.size() == 3){ // e.g., listen 80;
+        cur_config->port = port;
         cur_config->type = Config::ServerType::HTTP_SERVER;
+      }
       if (statement.size() == 4){ // e.g., listen 443 ssl;
-        if (statement.at(2) == "ssl")
+        if (statement.at(2) == "ssl"){
+          cur_config->port = port;
           cur_config->type = Config::ServerType::HTTPS_SERVER;
+        }
+        else if (statement.at(2) == "quic") // e.g., listen 443 quic;
+          cur_config->quic_port = port; // UDP, alongside the listen <port> ssl
         else{
           Log::fatal(LOG_PRE, "Invalid argument after port: \"" + statement.at(2) + "\"");
           return false;
@@ -317,32 +506,85 @@ bool ConfigParser::parse_statement(std::vector<std::string>& statement){
         // Log::trace(LOG_PRE, "Got ret_val " + cur_config->ret_val);
       }
     }
-    else if (arg == "ssl_certificate"){
-      cur_config->certificate = clean(statement.at(1), DIR_FILE);
-      // Log::trace(LOG_PRE, "Got ssl_certificate " + cur_config->certificate);
+    else if (arg == "client_max_body_size"){ // e.g., client_max_body_size 8m;
+      if (!parse_size(statement.at(1), cur_config->client_max_body_size))
+        return false;
+      // Log::trace(LOG_PRE, "Got client_max_body_size " + std::to_string(cur_config->client_max_body_size));
+    }
+    else if (arg == "gzip_static"){ // e.g., gzip_static on;
+      if (!parse_flag(statement.at(1), cur_config->gzip_static))
+        return false;
+    }
+    else if (arg == "brotli_static"){ // e.g., brotli_static on;
+      if (!parse_flag(statement.at(1), cur_config->brotli_static))
+        return false;
+    }
+    else if (arg == "ssl_certificate"){ // Repeatable, e.g., RSA and ECDSA
+      cur_config->certificates.push_back(clean(statement.at(1), DIR_FILE));
+      // Log::trace(LOG_PRE, "Got ssl_certificate " + cur_config->certificates.back());
     }
     else if (arg == "ssl_certificate_key"){
-      cur_config->private_key = clean(statement.at(1), DIR_FILE);
-      // Log::trace(LOG_PRE, "Got ssl_certificate_key " + cur_config->private_key);
+      cur_config->private_keys.push_back(clean(statement.at(1), DIR_FILE));
+      // Log::trace(LOG_PRE, "Got ssl_certificate_key " + cur_config->private_keys.back());
+    }
+    else if (arg == "ssl_ktls"){ // e.g., ssl_ktls off;
+      if (!parse_flag(statement.at(1), cur_config->ktls))
+        return false;
+    }
+    else if (arg == "ssl_protocols"){ // e.g., ssl_protocols TLSv1.2 TLSv1.3;
+      cur_config->ssl_protocols = 0;
+      for (size_t i = 1; i < statement.size() - 1; i++){
+        const std::string& protocol = statement.at(i);
+        if (protocol == "TLSv1")
+          cur_config->ssl_protocols |= Config::TLS_V1;
+        else if (protocol == "TLSv1.1")
+          cur_config->ssl_protocols |= Config::TLS_V1_1;
+        else if (protocol == "TLSv1.2")
+          cur_config->ssl_protocols |= Config::TLS_V1_2;
+        else if (protocol == "TLSv1.3")
+          cur_config->ssl_protocols |= Config::TLS_V1_3;
+        else{ // Including SSLv2 and SSLv3, which OpenSSL 3 no longer builds
+          Log::fatal(LOG_PRE, "Invalid ssl_protocols \"" + protocol + "\"");
+          return false;
+        }
+      }
+      if (!cur_config->ssl_protocols){
+        Log::fatal(LOG_PRE, "Missing ssl_protocols");
+        return false;
+      }
+    }
+    else if (arg == "ssl_ciphers"){ // e.g., ssl_ciphers HIGH:!aNULL:!MD5;
+      // Checked by OpenSSL when the server starts
+      cur_config->ssl_ciphers = statement.at(1);
+    }
+    else if (arg == "ssl_ecdh_curve"){ // e.g., ssl_ecdh_curve X25519:prime256v1;
+      cur_config->ssl_ecdh_curve = statement.at(1);
     }
-    else if (arg == "ssl_protocols"){
-      // Not implemented - don't do anything with it, but don't error
-      // Log::trace(LOG_PRE, "Got ssl_protocols (not implemented)");
+    else if (arg == "http2"){ // e.g., http2 on;
+      if (!parse_flag(statement.at(1), cur_config->http2))
+        return false;
     }
-    else if (arg == "ssl_ciphers"){
-      // Not implemented - don't do anything with it, but don't error
-      // Log::trace(LOG_PRE, "Got ssl_ciphers (not implemented)");
+    else if (arg == "ssl_session_cache"){ // e.g., ssl_session_cache shared:SSL:10m;
+      cur_config->ssl_session_cache = 0;
+      for (size_t i = 1; i < statement.size() - 1; i++) // Largest cache wins
+        if (!parse_session_cache(statement.at(i), cur_config->ssl_session_cache))
+          return false;
     }
-    else if (arg == "ssl_session_timeout"){
-      // Not implemented - don't do anything with it, but don't error
-      // Log::trace(LOG_PRE, "Got ssl_session_timeout (not implemented)");
+    else if (arg == "ssl_session_tickets"){ // e.g., ssl_session_tickets off;
+      if (!parse_flag(statement.at(1), cur_config->ssl_session_tickets))
+        return false;
+    }
+    else if (arg == "ssl_session_timeout"){ // e.g., ssl_session_timeout 15m;
+      if (!parse_time(statement.at(1), cur_config->ssl_session_timeout))
+        return false;
     }
     else{
       Log::fatal(LOG_PRE, "Unknown server argument: \"" + arg + "\"");
       return false;
     }
   }
-  // Valid in location context: index, root, try_files
+  /* Valid in location context: index, root, client_max_body_size, gzip_static,
+     brotli_static, try_files */
   else if (context == LOCATION_CONTEXT){
     if (arg == "index"){ // Statement size 3+ (e.g., "index index.html ;")
       cur_location_block->index = clean(statement.at(1), FILE_URI);
@@ -352,11 +594,27 @@ bool ConfigParser::parse_statement(std::vector<std::string>& statement){
       cur_location_block->root = clean(statement.at(1), DIR_ONLY);
       // Log::trace(LOG_PRE, "Got root override \"" + cur_location_block->root + "\"");
     }
+    else if (arg == "client_max_body_size"){ // e.g., client_max_body_size 0;
+      size_t size;
+      if (!parse_size(statement.at(1), size))
+        return false;
+      cur_location_block->client_max_body_size = size;
+      // Log::trace(LOG_PRE, "Got client_max_body_size override " + std::to_string(size));
+    }
+    else if (arg == "gzip_static" || arg == "brotli_static"){ // e.g., gzip_static off;
+      bool flag;
+      if (!parse_flag(statement.at(1), flag))
+        return false;
+      if (arg == "gzip_static")
+        cur_location_block->gzip_static = flag;
+      else
+        cur_location_block->brotli_static = flag;
+    }
     else if (arg == "try_files"){ // Statement size 4+ (e.g., "try_files $uri =404 ;")
       // Process parameters; exclude "try_files", fallback (last) argument, ;
       for (int i = 1; i < statement.size() - 2; i++){
-        /* Each arg represents a relative path to try serving. $uri variable
-           resolution is handled in FileRequestHandler::get_file_from_loc(). */
+        /* Each arg represents a relative path to try serving. Split at its
+           $uri variables by Config::validate(), see try_files_paths. */
         cur_location_block->try_files_args.push_back(clean(statement.at(i), FILE_URI));
         // Log::trace(LOG_PRE, "Location \"" + cur_location_block->uri + "\" registered try_files arg \"" + statement.at(i) + "\".");
       }
@@ -368,7 +626,7 @@ bool ConfigParser::parse_statement(std::vector<std::string>& statement){
       return false;
     }
   }
-  else{ // No valid arguments in http or main context
+  else{ // No other valid arguments in http or main context
     Log::fatal(LOG_PRE, "Unexpected argument: \"" + arg +
                "\" in http or main context (expected block)");
     return false;
@@ -413,6 +671,135 @@ std::string ConfigParser::clean(const std::string& path, PathType type){
 }
 
 
+/** 
+ * Parses an Nginx size value: a byte count with an optional k/m/g suffix.
+ * 
+ * @param[in] value A string containing the size (e.g., "512", "16k", "8m").
+ * @param[out] size The size in bytes.
+ * @returns true on success, false (after logging) if value is invalid.
+ */
+bool ConfigParser::parse_size(const std::string& value, size_t& size){
+  std::string digits = value;
+  size_t scale = 1;
+  switch (value.empty() ? '\0' : value.back()){
+    case 'k': // Fall through
+    case 'K':
+      scale = 1024;
+      break;
+    case 'm': // Fall through
+    case 'M':
+      scale = 1024 * 1024;
+      break;
+    case 'g': // Fall through
+    case 'G':
+      scale = 1024 * 1024 * 1024;
+  }
+  if (scale != 1)
+    digits.pop_back(); // Remove suffix
+
+  try{
+    /* Throws boost::bad_lexical_cast if not valid integer. Parse as signed to
+       reject negative sizes, which would underflow an unsigned cast. */
+    long long parsed = boost::lexical_cast<long long>(digits);
+    if (parsed >= 0 && static_cast<unsigned long long>(parsed) <= SIZE_MAX / scale){
+      size = parsed * scale;
+      return true;
+    }
+  }
+  catch(boost::bad_lexical_cast){} // Out of range, not a number, etc.
+  Log::fatal(LOG_PRE, "Invalid size \"" + value + "\"");
+  return false;
+}
+
+
+/** 
+ * Parses an Nginx time value (e.g., "90", "30s", "15m", "12h", "1d").
+ * 
+ * @param[in] value A string containing the time, in seconds unless suffixed.
+ * @param[out] seconds The parsed time in seconds.
+ * @returns true on success, false (after logging) if value is invalid or 0.
+ */
+bool ConfigParser::parse_time(const std::string& value, long& seconds){
+  std::string digits = value;
+  long scale = 1;
+  switch (value.empty() ? '\0' : value.back()){
+    case 'd':
+      scale *= 24; // Fall through
+    case 'h':
+      scale *= 60; // Fall through
+    case 'm':
+      scale *= 60; // Fall through
+    case 's':
+      digits.pop_back(); // Remove suffix
+  }
+
+  try{
+    long parsed = boost::lexical_cast<long>(digits); // Throws if not an integer
+    if (parsed > 0 && parsed <= INT_MAX / scale){ // OpenSSL takes an int (C long)
+      seconds = parsed * scale;
+      return true;
+    }
+  }
+  catch(boost::bad_lexical_cast){} // Out of range, not a number, etc.
+  Log::fatal(LOG_PRE, "Invalid time \"" + value + "\"");
+  return false;
+}
+
+
+/** 
+ * Parses one argument of the ssl_session_cache directive: off, none,
+ * builtin[:sessions] or shared:name:size. The cache is shared by all worker
+ * threads, so builtin and shared are equivalent (one session takes about 256
+ * bytes of a shared size, like Nginx).
+ * 
+ * @param[in] value A string containing the argument.
+ * @param[in,out] sessions The most sessions to cache, raised to fit value
+ *   (0 disables the cache).
+ * @returns true on success, false (after logging) if value is invalid.
+ */
+bool ConfigParser::parse_session_cache(const std::string& value, size_t& sessions){
+  size_t size = 0;
+  size_t name_end = value.find(':', 7); // End of <name> in shared:<name>:<size>
+  if (value == "off" || value == "none")
+    return true;
+  else if (value == "builtin")
+    size = 20480; // Nginx and OpenSSL default
+  else if (value.rfind("builtin:", 0) == 0){
+    if (!parse_size(value.substr(8), size))
+      return false;
+  }
+  else if (value.rfind("shared:", 0) == 0 && name_end != std::string::npos &&
+           name_end > 7){
+    if (!parse_size(value.substr(name_end + 1), size))
+      return false;
+    size /= 256;
+  }
+  else{
+    Log::fatal(LOG_PRE, "Invalid ssl_session_cache \"" + value + "\"");
+    return false;
+  }
+  sessions = std::max(sessions, size);
+  return true;
+}
+
+
+/** 
+ * Parses an Nginx flag value.
+ * 
+ * @param[in] value A string containing the flag ("on" or "off").
+ * @param[out] flag true for "on", false for "off".
+ * @returns true on success, false (after logging) if value is invalid.
+ */
+bool ConfigParser::parse_flag(const std::string& value, bool& flag){
+  if (value != "on" && value != "off"){
+    Log::fatal(LOG_PRE, "Invalid flag \"" + value + "\" (expected on or off)");
+    return false;
+  }
+  flag = value == "on";
+  return true;
+}
+
+
 /** 
  * Parses the next token in the config.
  * 
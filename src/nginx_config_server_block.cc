@@ -1,6 +1,68 @@
+#include <charconv> // from_chars
+#include <fcntl.h> // open, O_PATH
+#include <unistd.h> // close
+
 #include "nginx_config_server_block.h"
 
 
+/// Frees the location blocks, which each Config owns.
+Config::~Config(){
+	for (std::vector<LocationBlock*>& location_block_vec : locations){
+		for (LocationBlock* location : location_block_vec)
+			delete location;
+	}
+	for (auto& [dir, fd] : root_fds_){
+		if (fd >= 0)
+			::close(fd);
+	}
+}
+
+
+/// Opens a root directory once, returns its descriptor or -1 on failure.
+int Config::open_root(const std::string& dir){
+	auto it = root_fds_.find(dir);
+	if (it == root_fds_.end()) // O_PATH, only used to resolve files beneath it
+		it = root_fds_.emplace(dir, ::open(dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC)).first;
+	return it->second;
+}
+
+
+/* Compiles the try_files directive of a location block with its root set.
+   Returns false if a return code fallback isn't a 3 digit status code. */
+static bool compile_try_files(LocationBlock* location){
+	location->try_files_paths.clear();
+	for (const std::string& try_files_arg : location->try_files_args){
+		// Segments between $uri variables (one segment if there are none)
+		std::vector<std::string> segments{location->root + "/"};
+		for (size_t start = 0;;){
+			size_t uri_arg_pos = try_files_arg.find("$uri", start);
+			segments.back() += try_files_arg.substr(start, uri_arg_pos - start);
+			if (uri_arg_pos == std::string::npos)
+				break;
+			segments.emplace_back(); // Request target goes before the next
+			start = uri_arg_pos + 4;
+		}
+		location->try_files_paths.push_back(std::move(segments));
+	}
+
+	const std::string& fallback = location->try_files_fallback;
+	location->try_files_fallback_path.clear();
+	if (fallback[0] == '='){ // Return code (e.g., "=404")
+		const char* code_end = fallback.data() + fallback.size();
+		int status;
+		auto [end, error] = std::from_chars(fallback.data() + 1, code_end, status);
+		if (error != std::errc() || end != code_end || status < 100 || status > 999)
+			return false;
+		location->try_files_fallback_status = status;
+	}
+	else{ // Internal redirect URI
+		location->try_files_fallback_status = -1;
+		location->try_files_fallback_path = location->root + "/" + fallback;
+	}
+	return true;
+}
+
+
 /// Validates the individual server block stored by the Config object.
 bool Config::validate(){
 	if (ret / 100 == 3){ // If 3xx return directive specified,
@@ -16,23 +78,117 @@ bool Config::validate(){
 		}
 	}
 	if (type == HTTP_SERVER){ // If non SSL, must not define SSL parameters
-		if (certificate != "" || private_key != "")
+		if (!certificates.empty() || !private_keys.empty())
 			return false;
 	}
 	else{ // Conversely, if SSL, must define SSL parameters
-		if (certificate == "" || private_key == "")
+		if (certificates.empty() || private_keys.empty())
+			return false;
+		// Each ssl_certificate needs the ssl_certificate_key at the same position
+		if (certificates.size() != private_keys.size())
 			return false;
 	}
+	// listen quic serves files with the certificate of an HTTPS server block
+	if (quic_port && (type != HTTPS_SERVER || ret))
+		return false;
 
-	// Ensure each location block within this server block defines root and index
+	// Ensure each location block within this server block defines root, index,
+	// client_max_body_size, gzip_static, and brotli_static
 	for (int i = 0; i < 4; i++){ // For all 4 location block types
 		for (LocationBlock* location : locations[i]){
 			if (location->root == "") // No root directive in location block
 				location->root = root; // Use server block root value
 			if (location->index == "") // No index directive in location block
 				location->index = index; // Use server block index value
+			if (!location->client_max_body_size) // No client_max_body_size
+				location->client_max_body_size = client_max_body_size; // Use server's
+			if (!location->gzip_static) // No gzip_static in location block
+				location->gzip_static = gzip_static; // Use server block value
+			if (!location->brotli_static) // No brotli_static in location block
+				location->brotli_static = brotli_static; // Use server block value
+			if (location->try_files_args.size() && !compile_try_files(location))
+				return false; // Needs root, set above
+			location->root_fd = open_root(location->root);
 		}
 	}
+	/* Files are opened beneath these, so that requests can't leave root. A
+	   missing root isn't an error, nothing is found beneath it. */
+	root_fd = open_root(root);
+
+	// Compile exact and prefix match location blocks for get_location()
+	location_trie.clear();
+	for (LocationBlock* location : locations[LocationBlock::ModifierType::EXACT_MATCH])
+		location_trie.insert(location);
+	for (LocationBlock* location : locations[LocationBlock::ModifierType::PREFIX_MATCH_STOP])
+		location_trie.insert(location);
+	for (LocationBlock* location : locations[LocationBlock::ModifierType::NONE])
+		location_trie.insert(location);
+	// Fails if a regex isn't valid RE2 syntax
+	if (!location_regexes.compile(locations[LocationBlock::ModifierType::REGEX_MATCH]))
+		return false;
 
   return true; // Validation succeeded
+}
+
+
+/** 
+ * Resolves request target URI to a location block in this server block.
+ *
+ * @pre ConfigParser::parse() succeeded.
+ * @param req_target The target URI of the incoming request.
+ * @returns A pointer to the matching location block, or nullptr if none.
+ */
+LocationBlock* Config::get_location(const std::string& req_target){
+  // Log::trace(LOG_PRE, "Resolving path for request target \"" + req_target + "\".");
+
+  // Step 1. Exact match, else longest prefix match (see LocationTrie::find)
+  LocationBlock* location = location_trie.find(req_target);
+  if (location != nullptr && location->modifier != LocationBlock::ModifierType::NONE)
+    return location; // Exact match or stop modifier, stop searching
+
+  // Step 2. Regex match, first match in config order wins
+  LocationBlock* regex_match = location_regexes.find(req_target);
+  if (regex_match != nullptr)
+    return regex_match;
+
+  // Step 3. Fallback to longest prefix match with no stop modifier, if any
+  return location;
+}
+
+
+/// Decodes the path of a request target, false if it is invalid.
+bool Config::decode_uri(std::string_view req_target, std::string& uri){
+  auto hex = [](char c){ // Value of a hex digit (either case), or -1
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  };
+  req_target = req_target.substr(0, req_target.find('?'));
+  uri.clear();
+  uri.reserve(req_target.size());
+  for (size_t i = 0; i < req_target.size(); i++){
+    if (req_target[i] != '%'){
+      uri += req_target[i];
+      continue;
+    }
+    int high = i + 2 < req_target.size() ? hex(req_target[i + 1]) : -1;
+    int low = high >= 0 ? hex(req_target[i + 2]) : -1;
+    if (low < 0 || (high == 0 && low == 0)) // Truncated, not hex, or %00
+      return false;
+    uri += static_cast<char>(high * 16 + low);
+    i += 2;
+  }
+  return true;
+}
+
+
+/// Returns the body size limit of the location a request target is routed to.
+size_t Config::body_limit(std::string_view req_target){
+  std::string uri;
+  // An invalid target is answered with 400 (see FileRequestHandler)
+  LocationBlock* location = decode_uri(req_target, uri) ? get_location(uri) : nullptr;
+  if (location != nullptr) // Set from the server block if not overridden
+    return *location->client_max_body_size;
+  return client_max_body_size;
 }
\ No newline at end of file
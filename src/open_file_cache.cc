@@ -0,0 +1,192 @@
+#include <algorithm> // min
+#include <atomic>
+#include <cerrno> // errno, EACCES, ENOSYS, EXDEV
+#include <cstring> // strstr
+#include <fcntl.h> // O_*, posix_fadvise
+#include <linux/openat2.h> // open_how, RESOLVE_*
+#include <sys/syscall.h> // SYS_openat2
+#include <unistd.h> // close, syscall
+
+#include "log.h"
+#include "open_file_cache.h"
+
+// Standardized log prefix for this source
+#define LOG_PRE "[OpenFileCache] "
+
+
+/// Returns true if two stat(2) results are of the same version of a file.
+static bool same_version(const struct stat& a, const struct stat& b){
+  return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size &&
+         a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+
+/* Opens path beneath the root directory root_fd. The kernel refuses to
+   resolve ".." above the root, absolute symlinks and /proc magic links. */
+static int open_beneath(int root_fd, const char* path, std::uint64_t flags){
+  static std::atomic<bool> openat2_missing = false; // Linux < 5.6, or seccomp
+  if (!openat2_missing){
+    open_how how = {};
+    how.flags = flags;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+    int fd = ::syscall(SYS_openat2, root_fd, path, &how, sizeof(how));
+    if (fd >= 0 || errno != ENOSYS)
+      return fd;
+    if (!openat2_missing.exchange(true))
+      Log::warn(LOG_PRE, "openat2 unavailable, falling back to openat");
+  }
+  /* Without openat2, refuse ".." segments (verify_req rejects them anyway).
+     Unlike above, symlinks inside the root may still lead out of it. */
+  for (const char* dots = std::strstr(path, ".."); dots; dots = std::strstr(dots + 2, "..")){
+    if ((dots == path || dots[-1] == '/') && (dots[2] == '\0' || dots[2] == '/')){
+      errno = EXDEV;
+      return -1;
+    }
+  }
+  return ::openat(root_fd, path, flags);
+}
+
+
+/* Looks up a path beneath root_fd, opening it if it is a regular file. The
+   descriptor of previous is kept if it is still the same version of the
+   file. */
+static std::shared_ptr<const OpenFileCache::File> lookup(
+    int root_fd, const char* path, const std::shared_ptr<const OpenFileCache::File>& previous){
+  auto file = std::make_shared<OpenFileCache::File>();
+  while (*path == '/') // Relative to root_fd, an absolute path would escape it
+    path++;
+  if (*path == '\0')
+    path = "."; // The root itself
+
+  // Non-blocking, so that opening a FIFO can't stall the worker thread
+  int fd = open_beneath(root_fd, path, O_RDONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+  if (fd < 0 && errno == EACCES){ // Exists, but can't be read
+    fd = open_beneath(root_fd, path, O_PATH | O_CLOEXEC);
+    file->exists = fd >= 0 && !::fstat(fd, &file->info);
+    if (fd >= 0)
+      ::close(fd);
+    return file;
+  }
+  if (fd < 0 || ::fstat(fd, &file->info)){ // Missing, or outside of root
+    if (fd >= 0)
+      ::close(fd);
+    file->info = {};
+    return file;
+  }
+  file->exists = true;
+  file->directory = S_ISDIR(file->info.st_mode);
+  if (!S_ISREG(file->info.st_mode)){
+    ::close(fd);
+    return file;
+  }
+
+  if (previous && previous->body && same_version(previous->info, file->info)){
+    ::close(fd); // Keep the descriptor already shared by responses
+    file->body = previous->body;
+    return file;
+  }
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL); // Like file_mode::scan
+  boost::beast::file opened;
+  opened.native_handle(fd); // Closed with body
+  auto body = std::make_shared<boost::beast::http::file_body::value_type>();
+  boost::system::error_code ec;
+  body->reset(std::move(opened), ec);
+  if (!ec)
+    file->body = body;
+  return file;
+}
+
+
+/// Returns a static reference to the singleton instance of OpenFileCache.
+OpenFileCache& OpenFileCache::inst(){
+  static OpenFileCache instRef;
+  return instRef;
+}
+
+
+/// Sets the limits of the cache, dropping entries that no longer fit.
+void OpenFileCache::configure(size_t max, std::chrono::seconds inactive,
+                              std::chrono::seconds valid, bool errors){
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_ = max;
+  inactive_ = inactive;
+  valid_ = valid;
+  errors_ = errors;
+  evict(std::chrono::steady_clock::now());
+}
+
+
+/// Returns the number of cached paths.
+size_t OpenFileCache::size(){
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+
+/// Looks up a path beneath its root, from the cache if it is still valid.
+std::shared_ptr<const OpenFileCache::File> OpenFileCache::find(
+    int root_fd, const std::string& path, size_t root_length){
+  auto now = std::chrono::steady_clock::now();
+  std::shared_ptr<const File> previous;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    // Looked up beneath another root (e.g., a location's), resolve it again
+    if (it != entries_.end() && it->second.root_length == root_length){
+      Slot& slot = it->second;
+      if (now - slot.used <= inactive_ && now - slot.validated < valid_){
+        slot.used = now;
+        lru_.splice(lru_.begin(), lru_, slot.lru); // Move to front
+        return slot.file;
+      }
+      previous = slot.file; // Expired, check it on disk
+    }
+  }
+
+  // Not holding mutex_, other lookups don't wait for these syscalls
+  std::shared_ptr<const File> file = root_fd < 0 ? std::make_shared<const File>() :
+    lookup(root_fd, path.c_str() + std::min(root_length, path.size()), previous);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(path);
+  if (!max_ || (!file->exists && !errors_)){
+    if (it != entries_.end()){ // No longer cacheable, e.g., it was deleted
+      lru_.erase(it->second.lru);
+      entries_.erase(it);
+    }
+    return file;
+  }
+  if (it == entries_.end()){
+    lru_.push_front(path);
+    it = entries_.emplace(path, Slot{nullptr, 0, now, now, lru_.begin()}).first;
+  }
+  else
+    lru_.splice(lru_.begin(), lru_, it->second.lru); // Move to front
+  it->second.file = file;
+  it->second.root_length = root_length;
+  it->second.validated = now;
+  it->second.used = now;
+  evict(now);
+  return file;
+}
+
+
+/// Drops all cached paths, closing descriptors no response is using.
+void OpenFileCache::clear(){
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  lru_.clear();
+}
+
+
+/* Drops least recently used entries until the cache fits, and entries that
+   have been inactive too long. Caller holds mutex_. */
+void OpenFileCache::evict(std::chrono::steady_clock::time_point now){
+  while (!lru_.empty()){
+    auto it = entries_.find(lru_.back());
+    if (entries_.size() <= max_ && now - it->second.used <= inactive_)
+      break; // Fits, and the rest were used more recently
+    entries_.erase(it);
+    lru_.pop_back();
+  }
+}
\ No newline at end of file
@@ -4,6 +4,9 @@
 #include <boost/process/v2/stdio.hpp> // process_stdio
 #include <boost/property_tree/json_parser.hpp> // read_json
 #include <boost/property_tree/ptree.hpp> // ptree
+#include <fstream> // ifstream, ofstream
+#include <memory> // make_unique, unique_ptr
+#include <mutex> // mutex, unique_lock
 
 #include "analytics.h"
 #include "post_request_handler.h"
@@ -15,6 +18,9 @@
 
 namespace procv2 = boost::process::v2;
 
+// Serializes use of the shared simulation input file across worker threads
+static std::mutex input_file_mutex;
+
 
 /// Generates a response to a given POST request.
 Response* PostRequestHandler::handle_request(const Request& req){
@@ -23,11 +29,15 @@ Response* PostRequestHandler::handle_request(const Request& req){
 
   // Parse JSON data received in req.body()
   boost::property_tree::ptree req_json;
-  std::istringstream req_body(req.body());
+  std::unique_ptr<std::istream> req_body;
+  if (body_file_.empty()) // Small body, buffered in memory by the session
+    req_body = std::make_unique<std::istringstream>(req.body());
+  else // Large or chunked body, streamed from the file the session spilled to
+    req_body = std::make_unique<std::ifstream>(body_file_, std::ios::binary);
 
   try{
     // Throws boost::property_tree::json_parser_error
-    read_json(req_body, req_json);
+    read_json(*req_body, req_json);
 
     try{
       // Throws boost::property_tree::ptree_error if named nodes not present
@@ -44,7 +54,12 @@ Response* PostRequestHandler::handle_request(const Request& req){
         boost::asio::basic_readable_pipe stdout_pipe(child_proc_io_context);
         boost::asio::basic_readable_pipe stderr_pipe(child_proc_io_context);
 
+        /* Held until the input file is cleared below, so concurrent requests
+           can't overwrite each other's input before the simulation reads it. */
+        std::unique_lock<std::mutex> input_file_lock(input_file_mutex,
+                                                     std::defer_lock);
         if (input_as_file){ // Sim expects file input, write raw input to file
+          input_file_lock.lock();
           std::string input_file = config_->root + "/simulations/temp_input.txt";
           std::ofstream input_file_stream(input_file);
           input_file_stream << input;
@@ -0,0 +1,138 @@
+#include <chrono> // milliseconds
+#include <mutex>
+#include <unordered_map> // erase_if
+
+#include "log.h"
+#include "server/certificate_reloader.h"
+
+// Standardized log prefix for this source
+#define LOG_PRE "[Server]   "
+
+using namespace boost::asio;
+
+// Files are replaced in place (IN_CLOSE_WRITE) or renamed over (IN_MOVED_TO,
+// e.g., certbot's symlinks, which it creates under a temporary name)
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE)
+
+
+/// Returns the reloader of a server block, creating it on first use.
+std::shared_ptr<certificate_reloader> certificate_reloader::get(
+    const std::shared_ptr<Config>& config, io_context& io_context){
+  static std::mutex mutex;
+  static std::unordered_map<Config*, std::weak_ptr<certificate_reloader>> reloaders;
+  std::lock_guard<std::mutex> lock(mutex);
+  // Drops the reloaders of configs replaced by a reload
+  std::erase_if(reloaders, [](const auto& entry){return entry.second.expired();});
+  std::shared_ptr<certificate_reloader> reloader = reloaders[config.get()].lock();
+  if (!reloader){
+    reloader = std::make_shared<certificate_reloader>(config, io_context);
+    if (reloader->events_) // Needs weak_from_this, so not in ctor
+      post(reloader->strand_, [reloader]{reloader->read_events();});
+    reloaders[config.get()] = reloader;
+  }
+  return reloader;
+}
+
+
+/// Builds the first tls_context and starts watching.
+certificate_reloader::certificate_reloader(std::shared_ptr<Config> config,
+                                           io_context& io_context)
+  : config_(std::move(config)), io_context_(io_context),
+    context_(tls_context::create(config_.get(), io_context)),
+    strand_(make_strand(io_context)), delay_timer_(strand_){
+  files_.insert(config_->certificates.begin(), config_->certificates.end());
+  files_.insert(config_->private_keys.begin(), config_->private_keys.end());
+
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0){
+    Log::error(LOG_PRE, "inotify unavailable, certificate changes on port " +
+               std::to_string(config_->port) + " need a restart");
+    return;
+  }
+  events_ = std::make_unique<posix::stream_descriptor>(strand_, fd);
+  // Directories rather than files, whose watches end when they are replaced
+  for (const std::string& file : files_){
+    std::string dir = file.substr(0, file.rfind('/'));
+    int wd = inotify_add_watch(fd, dir.c_str(), WATCH_MASK);
+    if (wd < 0) // e.g., out of watches (fs.inotify.max_user_watches)
+      Log::error(LOG_PRE, "Failed to watch " + dir + ", changes to " + file +
+                 " need a restart");
+    else
+      watches_[wd] = dir; // Same descriptor if dir is already watched
+  }
+}
+
+
+/// Waits for a reload in progress, then stops watching.
+certificate_reloader::~certificate_reloader(){
+  reload_thread_.join(); // reload() uses this
+}
+
+
+/// Reads the next batch of inotify events on the strand.
+void certificate_reloader::read_events(){
+  events_->async_read_some(buffer(event_buffer_),
+    [weak = weak_from_this()](const boost::system::error_code& error, size_t bytes){
+      if (std::shared_ptr<certificate_reloader> reloader = weak.lock())
+        reloader->handle_events(error, bytes);
+    });
+}
+
+
+/// Schedules a reload after reload_delay_ms if a certificate or key changed.
+void certificate_reloader::handle_events(const boost::system::error_code& error,
+                                         size_t bytes){
+  if (error){
+    if (error == error::operation_aborted)
+      return; // IO context shutting down
+    Log::error(LOG_PRE, "Failed to read inotify events: " + error.message() +
+               ", certificate changes on port " + std::to_string(config_->port) +
+               " need a restart");
+    events_.reset(); // Closes the inotify descriptor, removing all watches
+    return;
+  }
+
+  bool changed = false;
+  for (size_t i = 0; i < bytes;){
+    const inotify_event* event = reinterpret_cast<const inotify_event*>(event_buffer_ + i);
+    i += sizeof(inotify_event) + event->len;
+    auto watch = watches_.find(event->wd);
+    if (event->mask & IN_Q_OVERFLOW) // Events were lost, assume the worst
+      changed = true;
+    else if (watch != watches_.end() && event->len &&
+             files_.count(watch->second + "/" + event->name))
+      changed = true;
+  }
+
+  if (changed){ // Restarts the delay, cancelling the wait of an earlier change
+    delay_timer_.expires_after(std::chrono::milliseconds(reload_delay_ms));
+    delay_timer_.async_wait(
+      [weak = weak_from_this()](const boost::system::error_code& error){
+        std::shared_ptr<certificate_reloader> reloader = weak.lock();
+        if (error || !reloader)
+          return; // Another change restarted the delay, or shutting down
+        post(reloader->reload_thread_, [reloader = reloader.get()]{
+          reloader->reload();
+        });
+      });
+  }
+  read_events();
+}
+
+
+/* Builds a tls_context from the certificate and key files, and publishes it
+   for new sessions. Keeps the current context if OpenSSL rejects the files,
+   e.g., a certificate whose new key hasn't been written yet. */
+void certificate_reloader::reload(){
+  std::shared_ptr<tls_context> current = context_.load();
+  try{
+    context_.store(tls_context::create(config_.get(), io_context_, current.get()));
+  }
+  catch(std::exception& e){ // boost::system::system_error from OpenSSL
+    Log::error(LOG_PRE, "Failed to reload certificates on port " +
+               std::to_string(config_->port) + ", keeping the current ones: " +
+               e.what());
+    return;
+  }
+  Log::info(LOG_PRE, "Reloaded certificates on port " + std::to_string(config_->port));
+}
\ No newline at end of file
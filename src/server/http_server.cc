@@ -12,17 +12,35 @@ using namespace boost::asio;
 
 
 /// Initializes the server and starts listening for incoming connections.
-http_server::http_server(Config* config, io_context& io_context)
-  : server(config, io_context){ // Call superclass constructor
-  Log::info(LOG_PRE, "HTTP server listening on port " + std::to_string(config->port));
+http_server::http_server(std::shared_ptr<Config> config, io_context& io_context,
+                         bool shared_port)
+  : server(std::move(config), io_context, shared_port){ // Call superclass constructor
+  Log::info(LOG_PRE, "HTTP server listening on port " + std::to_string(port_));
   start_accept();  // Start listening for incoming connections
 }
 
 
-/// Accepts incoming connection, creates new session, then calls handle_accept.
+/// Accepts incoming connection, creates new session, then calls handle_http_accept.
 void http_server::start_accept(){
-  session_base* new_session = new http_session(config_, io_context_);
+  std::shared_ptr<session_base> new_session =
+    std::make_shared<http_session>(config_, io_context_);
   acceptor_.async_accept(new_session->socket(),
-                         boost::bind(&http_server::handle_accept, this,
-                                     new_session, placeholders::error));
+                         boost::bind(&http_server::handle_http_accept, this,
+                                     new_session, config_, placeholders::error));
+}
+
+
+/* Accept handler. The session waiting for a connection was created before
+   the config may have been reloaded, so a connection accepted after a reload
+   moves to a session with the new config. */
+void http_server::handle_http_accept(std::shared_ptr<session_base> new_session,
+                                     std::shared_ptr<Config> config,
+                                     const boost::system::error_code& error){
+  if (!error && config != config_){
+    std::shared_ptr<session_base> reloaded_session =
+      std::make_shared<http_session>(config_, io_context_);
+    reloaded_session->socket() = std::move(new_session->socket());
+    new_session = reloaded_session;
+  }
+  handle_accept(new_session, error);
 }
\ No newline at end of file
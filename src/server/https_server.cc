@@ -12,24 +12,84 @@ using namespace boost::asio;
 
 
 /// Initializes the server and starts listening for incoming connections.
-https_server::https_server(Config* config, io_context& io_context)
-  : server(config, io_context), // Call superclass constructor
-    ssl_context_(ssl::context::tlsv12_server){
+https_server::https_server(std::shared_ptr<Config> config, io_context& io_context,
+                           bool shared_port)
+  : server(config, io_context, shared_port), // Call superclass constructor
+    // Watches the certificate files, swapping the context when they change
+    certificates_(certificate_reloader::get(config, io_context)),
+    quic_port_(config->quic_port){
+  Log::info(LOG_PRE, "HTTPS server listening on port " + std::to_string(port_));
+  if (quic_port_){ // HTTP/3 on UDP, advertised to HTTPS clients by Alt-Svc
+#ifdef ENABLE_HTTP3
+    quic_server_ = std::make_unique<quic_server>(config, certificates_, io_context,
+                                                 shared_port);
+    Log::info(LOG_PRE, "HTTP/3 server listening on UDP port " +
+              std::to_string(quic_port_));
+#else
+    Log::warn(LOG_PRE, "listen quic requires building with -DENABLE_HTTP3=ON, "
+              "ignoring UDP port " + std::to_string(quic_port_));
+#endif
+  }
+  start_accept();
+}
 
-  // Configure SSL context
-  ssl_context_.use_certificate_file(config->certificate, ssl::context::pem);
-  ssl_context_.use_private_key_file(config->private_key, ssl::context::pem);
 
-  Log::info(LOG_PRE, "HTTPS server listening on port " + std::to_string(config->port));
-  start_accept();
+/* Builds the TLS context of config before swapping it in on the acceptor's
+   strand, so that a certificate error keeps the current config. */
+void https_server::reconfigure(std::shared_ptr<Config> config){
+  std::shared_ptr<certificate_reloader> certificates =
+    certificate_reloader::get(config, io_context_); // Throws on OpenSSL errors
+  if (config->quic_port != quic_port_)
+    Log::warn(LOG_PRE, "listen quic changes on port " + std::to_string(port_) +
+              " need a restart");
+#ifdef ENABLE_HTTP3
+  else if (quic_server_)
+    quic_server_->reconfigure(config, certificates);
+#endif
+  post(acceptor_.get_executor(),
+       [this, config = std::move(config), certificates = std::move(certificates)]{
+    config_ = config;
+    certificates_ = certificates;
+  });
 }
 
 
-/// Accepts incoming connection, creates new session, then calls handle_accept.
+/// Closes the acceptor, and the QUIC endpoint once its connections finish.
+void https_server::close(){
+  server::close();
+#ifdef ENABLE_HTTP3
+  if (quic_server_)
+    quic_server_->close();
+#endif
+}
+
+
+/// Accepts incoming connection, creates new session, then calls handle_tls_accept.
 void https_server::start_accept(){
-  session_base* new_session = new https_session(
-    config_, io_context_, ssl_context_);
+  std::shared_ptr<tls_context> context = certificates_->context();
+  std::shared_ptr<session_base> new_session =
+    std::make_shared<https_session>(config_, io_context_, context);
   acceptor_.async_accept(new_session->socket(),
-                         boost::bind(&https_server::handle_accept, this,
-                                     new_session, placeholders::error));
+                         boost::bind(&https_server::handle_tls_accept, this,
+                                     new_session, config_, context,
+                                     placeholders::error));
+}
+
+
+/* Accept handler. The session waiting for a connection was created before
+   the config or certificates may have been reloaded, so a connection
+   accepted after a reload moves to a session with the new config and
+   context before its handshake. */
+void https_server::handle_tls_accept(std::shared_ptr<session_base> new_session,
+                                     std::shared_ptr<Config> config,
+                                     std::shared_ptr<tls_context> context,
+                                     const boost::system::error_code& error){
+  std::shared_ptr<tls_context> current = certificates_->context();
+  if (!error && (config != config_ || context != current)){
+    std::shared_ptr<session_base> reloaded_session =
+      std::make_shared<https_session>(config_, io_context_, current);
+    reloaded_session->socket() = std::move(new_session->socket());
+    new_session = reloaded_session;
+  }
+  handle_accept(new_session, error);
 }
\ No newline at end of file
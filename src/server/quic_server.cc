@@ -0,0 +1,565 @@
+#include <boost/algorithm/string/case_conv.hpp> // to_lower_copy
+#include <boost/bind/bind.hpp> // bind
+#include <openssl/rand.h> // RAND_bytes
+#include <algorithm> // min
+#include <chrono> // milliseconds
+#include <cstdlib> // strtoull
+#include <limits> // numeric_limits
+#include <stdexcept> // runtime_error
+#include <unistd.h> // pread
+
+#include "analytics.h"
+#include "request_handler_interface.h" // RequestHandler
+#include "server/quic_server.h"
+#include "session/session_base.h" // session_base::append_body
+#include "typedefs/socket.h" // reuse_port
+
+// Standardized log prefix for this source
+#define LOG_PRE "[Server]   "
+
+using namespace boost::asio;
+using boost::asio::ip::udp;
+using boost::system::error_code;
+
+
+int verify_req(Request& req); // Defined in session_base.cc
+RequestHandler* dispatch(Request& req, Config* config_);
+void remove_body_file(std::string& body_file); // Defined in session_base.cc
+
+
+/// Binds the UDP socket and starts receiving packets.
+quic_server::quic_server(std::shared_ptr<Config> config,
+                         std::shared_ptr<certificate_reloader> certificates,
+                         io_context& io_context, bool shared_port)
+  : socket_(make_strand(io_context)), config_(std::move(config)),
+    certificates_(std::move(certificates)),
+    receive_buffer_(std::make_unique<uint8_t[]>(receive_buffer_size)),
+    send_buffer_(std::make_unique<uint8_t[]>(max_datagram_size)),
+    chunk_(std::make_unique<char[]>(chunk_size)){
+  h3_config_ = quiche_h3_config_new();
+  if (!h3_config_)
+    throw std::bad_alloc();
+  loaded_context_ = certificates_->context();
+  quic_config_ = load_config();
+
+  // Same steps as server::server, for a UDP socket
+  udp::endpoint endpoint(udp::v4(), config_->quic_port);
+  socket_.open(endpoint.protocol());
+  socket_.set_option(udp::socket::reuse_address(true));
+  if (shared_port) // Kernel hashes each client's address to one socket
+    socket_.set_option(reuse_port(true));
+  socket_.bind(endpoint);
+  local_ = socket_.local_endpoint();
+  start_receive();
+}
+
+
+/// Removes the spilled body of a stream, if any.
+quic_server::stream::~stream(){
+  remove_body_file(body_file);
+}
+
+
+/// Frees the quiche configs. Connections still open are dropped.
+quic_server::~quic_server(){
+  connections_.clear(); // Before the configs they were created from
+  quiche_h3_config_free(h3_config_);
+}
+
+
+/* Swaps in config on the socket's strand, for requests dispatched after it.
+   New connections load its certificate, as certificates differs from the
+   reloader whose context was loaded. The UDP port stays that of the first
+   config. */
+void quic_server::reconfigure(std::shared_ptr<Config> config,
+                              std::shared_ptr<certificate_reloader> certificates){
+  post(socket_.get_executor(), [this, config = std::move(config),
+                                certificates = std::move(certificates)]{
+    config_ = config;
+    certificates_ = certificates;
+  });
+}
+
+
+/**
+ * Creates the quiche config of new connections from config_. QUIC always uses
+ * TLS 1.3, through quiche's own TLS library, so only the first certificate
+ * applies, and ssl_protocols and ssl_ciphers don't.
+ *
+ * @returns The config, freed once no connection created from it remains.
+ * @throws std::runtime_error If the certificate or key fails to load.
+ */
+std::shared_ptr<quiche_config> quic_server::load_config(){
+  quiche_config* created = quiche_config_new(QUICHE_PROTOCOL_VERSION);
+  if (!created)
+    throw std::bad_alloc();
+  std::shared_ptr<quiche_config> quic_config(created, quiche_config_free);
+  if (quiche_config_load_cert_chain_from_pem_file(
+        created, config_->certificates.front().c_str()) < 0 ||
+      quiche_config_load_priv_key_from_pem_file(
+        created, config_->private_keys.front().c_str()) < 0)
+    throw std::runtime_error("listen quic: failed to load " +
+                             config_->certificates.front());
+  quiche_config_set_application_protos(
+    created, reinterpret_cast<const uint8_t*>(QUICHE_H3_APPLICATION_PROTOCOL),
+    sizeof(QUICHE_H3_APPLICATION_PROTOCOL) - 1);
+  quiche_config_set_max_idle_timeout(created, idle_timeout_ms);
+  quiche_config_set_max_recv_udp_payload_size(created, max_datagram_size);
+  quiche_config_set_max_send_udp_payload_size(created, max_datagram_size);
+  // Flow control windows, large enough that a window outlasts a round trip
+  quiche_config_set_initial_max_data(created, 16777216);
+  quiche_config_set_initial_max_stream_data_bidi_local(created, 1048576);
+  quiche_config_set_initial_max_stream_data_bidi_remote(created, 1048576);
+  quiche_config_set_initial_max_stream_data_uni(created, 1048576);
+  quiche_config_set_initial_max_streams_bidi(created, max_concurrent_streams);
+  quiche_config_set_initial_max_streams_uni(created, 3); // Control, QPACK
+  // Packets are sent to the address the connection started from
+  quiche_config_set_disable_active_migration(created, true);
+  return quic_config;
+}
+
+
+/// Stops accepting connections on the socket's strand, see close_if_done.
+void quic_server::close(){
+  post(socket_.get_executor(), [this]{
+    closing_ = true;
+    if (connections_.empty()){
+      error_code ec;
+      socket_.close(ec); // Cancels the pending receive
+    }
+  });
+}
+
+
+/// Receives the next packet, then calls handle_receive.
+void quic_server::start_receive(){
+  if (!socket_.is_open())
+    return; // Closed after close(), by the last connection's packet
+  socket_.async_receive_from(buffer(receive_buffer_.get(), receive_buffer_size),
+                             sender_,
+                             boost::bind(&quic_server::handle_receive, this,
+                                         placeholders::error,
+                                         placeholders::bytes_transferred));
+}
+
+
+/* Passes a packet to its connection, accepting a new connection for the
+   Initial packet of an unknown connection ID. Anything quiche rejects is
+   dropped, as QUIC expects of packets it can't process. */
+void quic_server::handle_receive(const error_code& error, size_t bytes){
+  if (error == error::operation_aborted)
+    return; // Server shutting down
+  if (error){
+    Log::error(LOG_PRE, "Error receiving on UDP port " +
+               std::to_string(config_->quic_port) + ": " + error.message());
+    start_receive();
+    return;
+  }
+
+  uint8_t* packet = receive_buffer_.get();
+  uint32_t version = 0;
+  uint8_t type = 0;
+  uint8_t scid[QUICHE_MAX_CONN_ID_LEN], dcid[QUICHE_MAX_CONN_ID_LEN], token[256];
+  size_t scid_length = sizeof(scid), dcid_length = sizeof(dcid),
+         token_length = sizeof(token);
+  // Short headers don't encode the ID length, ours are local_id_length bytes
+  if (quiche_header_info(packet, bytes, local_id_length, &version, &type,
+                         scid, &scid_length, dcid, &dcid_length,
+                         token, &token_length) < 0){
+    start_receive();
+    return;
+  }
+
+  std::string id(reinterpret_cast<char*>(dcid), dcid_length);
+  std::shared_ptr<connection> conn;
+  auto it = connections_.find(id);
+  if (it != connections_.end())
+    conn = it->second;
+  else if (!(packet[0] & 0x80) || closing_){
+    /* Short header of a closed connection, or a new connection after close(),
+       the client times out on its own (or falls back to TCP) */
+  }
+  else if (!quiche_version_is_supported(version)){
+    // Lists the versions we support, the client retries with one of them
+    ssize_t length = quiche_negotiate_version(scid, scid_length, dcid,
+                                              dcid_length, send_buffer_.get(),
+                                              max_datagram_size);
+    error_code ignored;
+    if (length > 0)
+      socket_.send_to(buffer(send_buffer_.get(), length), sender_, 0, ignored);
+  }
+  else
+    conn = accept(id);
+
+  if (conn){
+    quiche_recv_info info = {
+      reinterpret_cast<sockaddr*>(sender_.data()),
+      static_cast<socklen_t>(sender_.size()),
+      reinterpret_cast<sockaddr*>(local_.data()),
+      static_cast<socklen_t>(local_.size())
+    };
+    if (quiche_conn_recv(conn->conn, packet, bytes, &info) >= 0)
+      process(*conn);
+    flush(*conn); // ACKs, handshake data and responses
+    close_if_done(conn);
+  }
+  start_receive();
+}
+
+
+/**
+ * Creates a connection for the first Initial packet from a client. There is
+ * no Retry round trip; until the client's address is validated, quiche sends
+ * at most three times the bytes received from it.
+ *
+ * @param dcid The client's original destination connection ID.
+ * @returns The connection, or nullptr if quiche rejected it.
+ */
+std::shared_ptr<quic_server::connection> quic_server::accept(
+    const std::string& dcid){
+  uint8_t id[local_id_length];
+  if (RAND_bytes(id, sizeof(id)) != 1)
+    return nullptr;
+  // The reloader swapped its context, so the files on disk changed
+  std::shared_ptr<tls_context> context = certificates_->context();
+  if (context != loaded_context_){
+    loaded_context_ = context;
+    try{
+      quic_config_ = load_config();
+      Log::info(LOG_PRE, "Reloaded the certificate of UDP port " +
+                std::to_string(local_.port()));
+    }
+    catch (const std::exception& e){
+      Log::error(LOG_PRE, std::string(e.what()) + ", keeping the current one");
+    }
+  }
+  std::shared_ptr<connection> conn =
+    std::make_shared<connection>(socket_.get_executor());
+  conn->conn = quiche_accept(id, sizeof(id), nullptr, 0,
+                             reinterpret_cast<sockaddr*>(local_.data()),
+                             local_.size(),
+                             reinterpret_cast<sockaddr*>(sender_.data()),
+                             sender_.size(), quic_config_.get());
+  if (!conn->conn)
+    return nullptr;
+  conn->config = quic_config_;
+  conn->peer = sender_;
+  conn->client_ip = sender_.address().to_string();
+  // Until it sees ours, the client keeps sending to its original ID
+  conn->ids = {std::string(reinterpret_cast<char*>(id), sizeof(id)), dcid};
+  for (const std::string& key : conn->ids)
+    connections_[key] = conn;
+  return conn;
+}
+
+
+/// Handles the HTTP/3 events of a connection, and resumes blocked responses.
+void quic_server::process(connection& conn){
+  if (!conn.h3 && quiche_conn_is_established(conn.conn)){
+    conn.h3 = quiche_h3_conn_new_with_transport(conn.conn, h3_config_);
+    if (!conn.h3)
+      return; // quiche closes the connection
+    Analytics::inst().http3_connections++;
+  }
+  if (!conn.h3)
+    return; // Handshake in progress
+
+  quiche_h3_event* event;
+  int64_t stream_id;
+  while ((stream_id = quiche_h3_conn_poll(conn.h3, conn.conn, &event)) >= 0){
+    auto it = conn.streams.find(stream_id);
+    switch (quiche_h3_event_type(event)){
+      case QUICHE_H3_EVENT_HEADERS:{
+        stream& stream = conn.streams[stream_id];
+        stream.req.version(30);
+        quiche_h3_event_for_each_header(event, on_header, &stream);
+        // Same limit as session_base::prepare_body(), location blocks override it
+        stream.body_limit = config_->body_limit(stream.req.target());
+        auto length = stream.req.find(http::field::content_length);
+        if (stream.body_limit && length != stream.req.end() &&
+            std::strtoull(std::string(length->value()).c_str(), nullptr, 10) > stream.body_limit)
+          respond(conn, stream_id, stream, 413); // Before the body
+        break;
+      }
+      case QUICHE_H3_EVENT_DATA:{
+        ssize_t bytes;
+        while ((bytes = quiche_h3_recv_body(conn.h3, conn.conn, stream_id,
+                                            reinterpret_cast<uint8_t*>(chunk_.get()),
+                                            chunk_size)) > 0){
+          if (it == conn.streams.end() || it->second.res)
+            continue; // Rest of a rejected body, read to return flow control
+          stream& stream = it->second;
+          stream.received += bytes;
+          stream.body_size += bytes;
+          if (stream.body_limit && stream.body_size > stream.body_limit)
+            respond(conn, stream_id, stream, 413); // Bodies without Content-Length
+          // Spilled to a file past session_base::body_buffer_size, like HTTP/1
+          else if (!session_base::append_body(stream.req.body(), stream.body_file,
+                                              stream.body_out, chunk_.get(), bytes)){
+            Log::error(LOG_PRE, "Failed to spill a request body to a temporary file");
+            respond(conn, stream_id, stream, 500);
+          }
+          it = conn.streams.find(stream_id); // respond() may have finished it
+        }
+        break;
+      }
+      case QUICHE_H3_EVENT_FINISHED: // Request complete
+        if (it != conn.streams.end() && !it->second.res){
+          // HTTP/3 needs no Content-Length, but verify_req() wants one for POST
+          if (!it->second.req.has_content_length() && it->second.body_size)
+            it->second.req.content_length(it->second.body_size);
+          else if (!it->second.req.has_content_length())
+            it->second.req.prepare_payload();
+          respond(conn, stream_id, it->second, 0);
+        }
+        break;
+      case QUICHE_H3_EVENT_RESET: // Client cancelled the request
+        conn.streams.erase(stream_id);
+        break;
+      default: // GOAWAY, PRIORITY_UPDATE
+        break;
+    }
+    quiche_h3_event_free(event);
+  }
+
+  // Continue responses that filled the stream or connection window
+  quiche_stream_iter* writable = quiche_conn_writable(conn.conn);
+  uint64_t id;
+  while (quiche_stream_iter_next(writable, &id)){
+    auto it = conn.streams.find(id);
+    if (it != conn.streams.end() && it->second.res &&
+        send_response(conn, id, it->second))
+      finish(conn, id);
+  }
+  quiche_stream_iter_free(writable);
+}
+
+
+/**
+ * Creates the response of a stream, like session_base::create_response(),
+ * and sends as much of it as flow control allows.
+ *
+ * @param status 0 for a complete request, else an error status (e.g., 413)
+ *   to answer without dispatching.
+ */
+void quic_server::respond(connection& conn, std::uint64_t stream_id,
+                          stream& stream, int status){
+  Request& req = stream.req;
+  if (!status)
+    status = verify_req(req); // Returns 0 if request valid, else err code
+  std::string summary;
+  if (status){
+    stream.res = std::make_unique<Response>();
+    stream.res->result(status);
+    if (status == 413 || status == 403){
+      Analytics::inst().malicious++;
+      summary = status == 413 ? "(Content Too Large)" : "(Forbidden)";
+    }
+    else{
+      Analytics::inst().invalid++;
+      summary = "(Invalid)";
+    }
+  }
+  else{ // Valid request, dispatch a request handler to obtain response
+    RequestHandler* handler = dispatch(req, config_.get());
+    error_code ec;
+    stream.body_out.close(ec); // The handler reads the spilled body by its path
+    handler->init_body_file(stream.body_file); // "" unless the body was spilled
+    stream.res.reset(handler->handle_request(req));
+    delete handler; // Free memory used by request handler
+    summary = std::string(req.method_string()) + " " + std::string(req.target());
+  }
+  stream.req_info = {stream.received, std::move(summary), ""};
+  const Response& res = *stream.res;
+
+  // Field names must be lowercase, and connection-specific fields are banned
+  stream.names.reserve(std::distance(res.begin(), res.end()) + 2); // No moves
+  stream.names.push_back(":status");
+  stream.names.push_back(std::to_string(res.result_int()));
+  auto add = [&stream](boost::beast::string_view name, boost::beast::string_view value){
+    stream.headers.push_back({reinterpret_cast<const uint8_t*>(name.data()), name.size(),
+                              reinterpret_cast<const uint8_t*>(value.data()), value.size()});
+  };
+  add(stream.names[0], stream.names[1]);
+  for (const auto& field : res){
+    std::string& name = stream.names.emplace_back(
+      boost::algorithm::to_lower_copy(std::string(field.name_string())));
+    if (name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+        name == "transfer-encoding" || name == "upgrade")
+      continue;
+    add(name, field.value());
+  }
+
+  // Same body sources as http2_connection::respond()
+  const std::string& body = res.shared_body ? *res.shared_body : res.body();
+  int fd = res.file ? res.file->file().native_handle() : -1;
+  auto add_bytes = [&](std::uint64_t offset, std::uint64_t length){
+    if (length)
+      stream.body.push_back(res.file ? segment{nullptr, fd, offset, length} :
+                                       segment{body.data() + offset, -1, 0, length});
+  };
+  auto add_text = [&stream](const std::string& text){
+    if (text.size())
+      stream.body.push_back({text.data(), -1, 0, text.size()});
+  };
+  if (res.ranges.empty())
+    add_bytes(0, res.payload_size());
+  for (const Response::byte_range& range : res.ranges){
+    add_text(range.prefix);
+    add_bytes(range.offset, range.length);
+  }
+  add_text(res.ranges_suffix);
+
+  if (send_response(conn, stream_id, stream))
+    finish(conn, stream_id);
+}
+
+
+/**
+ * Sends the HEADERS and body of a response until done or blocked by flow
+ * control. File bytes are read with pread(2), at most chunk_size at a time.
+ *
+ * @returns true once the stream needs nothing more (sent, or reset because
+ *   the file shrank), false to resume when the stream is writable again.
+ */
+bool quic_server::send_response(connection& conn, std::uint64_t stream_id,
+                                stream& stream){
+  if (!stream.headers.empty()){
+    int result = quiche_h3_send_response(conn.h3, conn.conn, stream_id,
+                                         stream.headers.data(),
+                                         stream.headers.size(),
+                                         stream.body.empty());
+    if (result == QUICHE_H3_ERR_STREAM_BLOCKED)
+      return false; // No room for the QPACK-encoded header yet
+    if (result < 0)
+      return true; // e.g., the client reset the stream
+    stream.headers.clear();
+  }
+
+  while (stream.next < stream.body.size()){
+    segment& part = stream.body[stream.next];
+    size_t bytes = std::min<std::uint64_t>(part.length, chunk_size);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(part.data);
+    if (!part.data){
+      ssize_t read = ::pread(part.fd, chunk_.get(), bytes, part.offset);
+      if (read <= 0){ // File shrank after Content-Length was sent
+        quiche_conn_stream_shutdown(conn.conn, stream_id, QUICHE_SHUTDOWN_WRITE,
+                                    0x102); // H3_INTERNAL_ERROR
+        return true;
+      }
+      bytes = read;
+      data = reinterpret_cast<const uint8_t*>(chunk_.get());
+    }
+    bool fin = stream.next + 1 == stream.body.size() && bytes == part.length;
+    ssize_t written = quiche_h3_send_body(conn.h3, conn.conn, stream_id, data,
+                                          bytes, fin);
+    if (written == QUICHE_H3_ERR_DONE)
+      return false; // Window full, quiche_conn_writable() lists it again
+    if (written < 0)
+      return true;
+    if (part.data)
+      part.data += written;
+    part.offset += written;
+    part.length -= written;
+    if (!part.length)
+      stream.next++;
+  }
+  return true;
+}
+
+
+/// Logs the response of a stream that needs nothing more, then frees it.
+void quic_server::finish(connection& conn, std::uint64_t stream_id){
+  auto it = conn.streams.find(stream_id);
+  if (it == conn.streams.end())
+    return;
+  stream& stream = it->second;
+  // QPACK compresses the header, so only the body is counted
+  Log::res_metrics(conn.client_ip, stream.req_info, stream.res->payload_size(),
+                   stream.res->result_int());
+  conn.streams.erase(it);
+}
+
+
+/// Sends every packet quiche has ready for a connection.
+void quic_server::flush(connection& conn){
+  quiche_send_info info;
+  while (true){
+    ssize_t length = quiche_conn_send(conn.conn, send_buffer_.get(),
+                                      max_datagram_size, &info);
+    if (length == QUICHE_ERR_DONE)
+      break;
+    if (length < 0){
+      Log::error(LOG_PRE, "Client: " + conn.client_ip + " | Failed to create "
+                 "QUIC packet, error " + std::to_string(length));
+      break;
+    }
+    /* A full socket buffer drops the packet, which quiche detects as lost
+       and retransmits, as if the network had dropped it. */
+    error_code ignored;
+    socket_.send_to(buffer(send_buffer_.get(), length), conn.peer, 0, ignored);
+  }
+}
+
+
+/// Wakes a connection when quiche's next timer (loss, idle, ...) expires.
+void quic_server::schedule_timeout(const std::shared_ptr<connection>& conn){
+  uint64_t timeout = quiche_conn_timeout_as_millis(conn->conn);
+  if (timeout == std::numeric_limits<uint64_t>::max())
+    return; // No timer armed
+  // Replaces the previous wait, which completes with operation_aborted
+  conn->timer.expires_after(std::chrono::milliseconds(timeout));
+  conn->timer.async_wait(boost::bind(&quic_server::handle_timeout, this,
+                                     conn->ids.front(), placeholders::error));
+}
+
+
+/* Timer handler of a connection. Looks the connection up by ID rather than
+   holding it, so a closed connection is freed without waiting for its timer. */
+void quic_server::handle_timeout(const std::string& id, const error_code& error){
+  if (error)
+    return; // Rescheduled, or the connection or server was freed
+  auto it = connections_.find(id);
+  if (it == connections_.end())
+    return;
+  std::shared_ptr<connection> conn = it->second;
+  quiche_conn_on_timeout(conn->conn);
+  flush(*conn); // e.g., retransmissions, or CONNECTION_CLOSE
+  close_if_done(conn);
+}
+
+
+/// Frees a closed connection, else rearms its timer.
+void quic_server::close_if_done(const std::shared_ptr<connection>& conn){
+  if (!quiche_conn_is_closed(conn->conn)){
+    schedule_timeout(conn);
+    return;
+  }
+  Log::info(LOG_PRE, "Client: " + conn->client_ip + " | QUIC connection closed.");
+  for (const std::string& key : conn->ids)
+    connections_.erase(key);
+  if (closing_ && connections_.empty()){ // Last connection after close()
+    error_code ec;
+    socket_.close(ec);
+  }
+}
+
+
+/// Adds a header field, decoded by QPACK, to the request of its stream.
+int quic_server::on_header(uint8_t* name, size_t name_length, uint8_t* value,
+                           size_t value_length, void* argp){
+  stream& stream = *static_cast<quic_server::stream*>(argp);
+  boost::beast::string_view field(reinterpret_cast<const char*>(name), name_length);
+  boost::beast::string_view field_value(reinterpret_cast<const char*>(value), value_length);
+  stream.received += name_length + value_length;
+  // quiche has already checked the pseudo-header fields of a request
+  if (field == ":method")
+    stream.req.method_string(field_value);
+  else if (field == ":path")
+    stream.req.target(field_value);
+  else if (field == ":authority")
+    stream.req.set(http::field::host, field_value);
+  else if (field[0] != ':') // Not :scheme
+    stream.req.insert(field, field_value);
+  return 0;
+}
\ No newline at end of file
@@ -2,7 +2,7 @@
 
 #include "log.h"
 #include "server/server.h"
-#include "typedefs/socket.h" // http_socket, https_socket
+#include "typedefs/socket.h" // http_socket, https_socket, reuse_port
 
 // Standardized log prefix for this source
 #define LOG_PRE "[Server]   "
@@ -13,19 +13,47 @@ using boost::system::error_code;
 
 
 /// Initializes the server instance.
-server::server(Config* config, io_context& io_context)
-  : acceptor_(io_context, tcp::endpoint(tcp::v4(), config->port)),
-    config_(config), io_context_(io_context){}
+server::server(std::shared_ptr<Config> config, io_context& io_context,
+               bool shared_port)
+  : acceptor_(make_strand(io_context)), config_(std::move(config)),
+    io_context_(io_context), port_(config_->port), type_(config_->type){
+  // Same steps as the acceptor's endpoint constructor, plus SO_REUSEPORT
+  tcp::endpoint endpoint(tcp::v4(), port_);
+  acceptor_.open(endpoint.protocol());
+  acceptor_.set_option(tcp::acceptor::reuse_address(true));
+  if (shared_port) // Kernel load-balances connections across acceptors
+    acceptor_.set_option(reuse_port(true));
+  acceptor_.bind(endpoint);
+  acceptor_.listen();
+}
 
 
 /// Accept handler, called after start_accept() accepts incoming connection.
-void server::handle_accept(session_base* new_session, const error_code& error){
+void server::handle_accept(std::shared_ptr<session_base> new_session,
+                           const error_code& error){
+  if (error == error::operation_aborted)
+    return; // Acceptor closed by close(), or shutting down
   start_accept(); // Immediately continue listening for incoming connections.
   if (!error) // Connection accepted successfully
-    new_session->start(); // Entry point varies based on override
-  else{
+    new_session->start(); // Session coroutine takes shared ownership
+  else // new_session is freed when the last shared_ptr goes out of scope
     Log::error(LOG_PRE, "Error accepting connection on port " +
-               std::to_string(config_->port) + ": " + error.message());
-    delete new_session;
-  }
+               std::to_string(port_) + ": " + error.message());
+}
+
+
+/// Swaps in config on the acceptor's strand, for sessions accepted after it.
+void server::reconfigure(std::shared_ptr<Config> config){
+  post(acceptor_.get_executor(), [this, config = std::move(config)]{
+    config_ = config;
+  });
+}
+
+
+/// Closes the acceptor on its strand, cancelling the pending accept.
+void server::close(){
+  post(acceptor_.get_executor(), [this]{
+    error_code ec;
+    acceptor_.close(ec);
+  });
 }
\ No newline at end of file
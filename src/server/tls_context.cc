@@ -0,0 +1,253 @@
+#include <openssl/core_names.h> // OSSL_MAC_PARAM_DIGEST, OSSL_MAC_PARAM_KEY
+#include <openssl/evp.h> // EVP_EncryptInit_ex, EVP_MAC_CTX_set_params
+#include <openssl/rand.h> // RAND_bytes
+#include <algorithm> // min
+#include <cstring> // memcmp, memcpy
+#include <sstream> // istringstream
+
+#include "log.h"
+#include "server/tls_context.h"
+
+// Standardized log prefix for this source
+#define LOG_PRE "[Server]   "
+
+using namespace boost::asio;
+
+
+/// Returns the ex_data index of SSL_CTX that points back to its tls_context.
+static int context_index(){
+  // Not app_data, which boost::asio::ssl::context uses for verify callbacks
+  static int index = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+
+/// Throws the error of a failed OpenSSL call, naming the directive it applies.
+static void check(int result, const char* directive){
+  if (result != 1)
+    throw boost::system::system_error(boost::system::error_code(
+      static_cast<int>(ERR_get_error()), error::get_ssl_category()), directive);
+}
+
+
+/// Limits the protocol versions to the ssl_protocols bits (Config::SSLProtocol).
+static void set_protocols(SSL_CTX* ctx, int protocols){
+  static const struct{int bit; int version; uint64_t disable;} versions[] = {
+    {Config::TLS_V1, TLS1_VERSION, SSL_OP_NO_TLSv1},
+    {Config::TLS_V1_1, TLS1_1_VERSION, SSL_OP_NO_TLSv1_1},
+    {Config::TLS_V1_2, TLS1_2_VERSION, SSL_OP_NO_TLSv1_2},
+    {Config::TLS_V1_3, TLS1_3_VERSION, SSL_OP_NO_TLSv1_3}
+  };
+  int min = 0, max = 0;
+  for (const auto& version : versions){
+    if (protocols & version.bit){
+      min = min ? min : version.version;
+      max = version.version;
+    }
+  }
+  check(SSL_CTX_set_min_proto_version(ctx, min), "ssl_protocols");
+  check(SSL_CTX_set_max_proto_version(ctx, max), "ssl_protocols");
+  for (const auto& version : versions) // Gaps, e.g., TLSv1 TLSv1.2
+    if (!(protocols & version.bit) && version.version > min && version.version < max)
+      SSL_CTX_set_options(ctx, version.disable);
+}
+
+
+/* Applies ssl_ciphers. OpenSSL configures TLS 1.3 cipher suites separately,
+   so TLS_* names (e.g., TLS_AES_128_GCM_SHA256) go to the cipher suites, and
+   the rest to the cipher list of older versions. Either keeps OpenSSL's
+   default if ssl_ciphers names none of it. */
+static void set_ciphers(SSL_CTX* ctx, const std::string& ssl_ciphers){
+  std::istringstream stream(ssl_ciphers);
+  std::string cipher, ciphers, suites;
+  while (std::getline(stream, cipher, ':')){
+    std::string& list = cipher.rfind("TLS_", 0) == 0 ? suites : ciphers;
+    list += (list.empty() ? "" : ":") + cipher;
+  }
+  if (!ciphers.empty())
+    check(SSL_CTX_set_cipher_list(ctx, ciphers.c_str()), "ssl_ciphers");
+  if (!suites.empty())
+    check(SSL_CTX_set_ciphersuites(ctx, suites.c_str()), "ssl_ciphers");
+}
+
+
+#ifdef ENABLE_HTTP2
+/// Selects h2 with ALPN if the client offers it, else http/1.1.
+static int select_protocol(SSL* ssl, const unsigned char** out,
+                           unsigned char* out_length, const unsigned char* in,
+                           unsigned int in_length, void* arg){
+  static const unsigned char protocols[] = "\x02h2\x08http/1.1"; // By preference
+  if (SSL_select_next_proto(const_cast<unsigned char**>(out), out_length,
+                            protocols, sizeof(protocols) - 1, in, in_length) !=
+      OPENSSL_NPN_NEGOTIATED)
+    return SSL_TLSEXT_ERR_NOACK; // No common protocol, assume HTTP/1.1
+  return SSL_TLSEXT_ERR_OK;
+}
+#endif
+
+
+/// Configures an SSL context from a server block, and starts rotating keys.
+std::shared_ptr<tls_context> tls_context::create(Config* config,
+                                                 io_context& io_context,
+                                                 tls_context* previous){
+  std::shared_ptr<tls_context> context =
+    std::make_shared<tls_context>(config, io_context);
+  if (previous && config->ssl_session_tickets){
+    std::scoped_lock lock(previous->ticket_keys_mutex_, context->ticket_keys_mutex_);
+    std::memcpy(context->ticket_keys_, previous->ticket_keys_,
+                sizeof(ticket_keys_));
+    context->ticket_keys_valid_ = previous->ticket_keys_valid_;
+  }
+  context->schedule_rotation(); // Needs shared_from_this, so not in ctor
+  return context;
+}
+
+
+/// Configures an SSL context from a server block.
+tls_context::tls_context(Config* config, io_context& io_context)
+  : ssl_context_(ssl::context::tls_server), rotation_timer_(io_context),
+    rotation_interval_(config->ssl_session_timeout){
+  /* OpenSSL keeps one certificate per key type (RSA, ECDSA, ...) and picks
+     one per handshake from the client's signature algorithms (or cipher,
+     before TLS 1.3), so clients that support ECDSA skip the costlier RSA
+     signature. Each key must match the certificate loaded before it, which
+     OpenSSL only checks for keys of the same type. */
+  SSL_CTX* ctx = ssl_context_.native_handle();
+  for (size_t i = 0; i < config->certificates.size(); i++){
+    ssl_context_.use_certificate_chain_file(config->certificates.at(i));
+    ssl_context_.use_private_key_file(config->private_keys.at(i), ssl::context::pem);
+    check(SSL_CTX_check_private_key(ctx), "ssl_certificate_key");
+  }
+  set_protocols(ctx, config->ssl_protocols);
+  set_ciphers(ctx, config->ssl_ciphers);
+  /* A TLS 1.3 client guesses a group and sends its key share with the
+     ClientHello. Listing X25519 first matches what browsers send, so the
+     server never asks for another share (HelloRetryRequest), keeping full
+     handshakes at one round trip. */
+  check(SSL_CTX_set1_groups_list(ctx, config->ssl_ecdh_curve == "auto" ?
+          "X25519:P-256:P-384" : config->ssl_ecdh_curve.c_str()),
+        "ssl_ecdh_curve");
+#ifdef SSL_OP_ENABLE_KTLS
+  /* Let OpenSSL hand the record layer to the kernel after each handshake, so
+     files are sent with SSL_sendfile. Sessions stay in userspace if the
+     kernel lacks the tls module or the cipher (see tls_stream). */
+  if (config->ktls)
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+  // Offer HTTP/2, so browsers multiplex requests over one connection
+  if (config->http2){
+#ifdef ENABLE_HTTP2
+    SSL_CTX_set_alpn_select_cb(ctx, select_protocol, nullptr);
+#else
+    Log::warn(LOG_PRE, "http2 requires building with -DENABLE_HTTP2=ON, "
+              "serving HTTP/1.1 on port " + std::to_string(config->port));
+#endif
+  }
+
+  /* Resumed sessions skip the asymmetric crypto of a full handshake. Both
+     the session cache and tickets expire after ssl_session_timeout. */
+  SSL_CTX_set_timeout(ctx, config->ssl_session_timeout);
+  if (config->ssl_session_cache){
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, config->ssl_session_cache);
+  }
+  else
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+
+  if (config->ssl_session_tickets){
+    rotate_ticket_keys();
+    SSL_CTX_set_ex_data(ctx, context_index(), this);
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, ticket_key_callback);
+  }
+  else
+    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+}
+
+
+/// Replaces the ticket key, keeping the previous one to decrypt tickets.
+void tls_context::rotate_ticket_keys(){
+  ticket_key key;
+  if (RAND_bytes(reinterpret_cast<unsigned char*>(&key), sizeof(key)) != 1){
+    Log::error(LOG_PRE, "Failed to generate session ticket key, keeping the current one");
+    return;
+  }
+  std::lock_guard<std::mutex> lock(ticket_keys_mutex_);
+  ticket_keys_[1] = ticket_keys_[0];
+  ticket_keys_[0] = key;
+  ticket_keys_valid_ = std::min(ticket_keys_valid_ + 1, 2);
+}
+
+
+/* Rotates the ticket key every ssl_session_timeout. A ticket can outlive its
+   key by at most one interval, by which time the ticket has expired anyway. */
+void tls_context::schedule_rotation(){
+  if (!SSL_CTX_get_ex_data(ssl_context_.native_handle(), context_index()))
+    return; // ssl_session_tickets off
+  rotation_timer_.expires_after(rotation_interval_);
+  rotation_timer_.async_wait(
+    [weak = weak_from_this()](const boost::system::error_code& error){
+      std::shared_ptr<tls_context> context = weak.lock();
+      if (error || !context)
+        return; // Server shutting down
+      context->rotate_ticket_keys();
+      context->schedule_rotation();
+    });
+}
+
+
+/**
+ * Encrypts new session tickets with the current key, and decrypts tickets
+ * presented by clients (see SSL_CTX_set_tlsext_ticket_key_evp_cb(3)).
+ *
+ * @returns 1 on success, 2 to also renew a ticket of the previous key, 0 for
+ *   an unknown (expired) key, which falls back to a full handshake.
+ */
+int tls_context::ticket_key_callback(SSL* ssl, unsigned char* name,
+                                     unsigned char* iv, EVP_CIPHER_CTX* cipher,
+                                     EVP_MAC_CTX* mac, int encrypt){
+  tls_context* context = static_cast<tls_context*>(
+    SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), context_index()));
+  ticket_key key;
+  int result = 1;
+  {
+    std::lock_guard<std::mutex> lock(context->ticket_keys_mutex_);
+    /* Slots not yet rotated into are zeros, which anyone could forge a
+       ticket with, so they are never used (no ticket is issued without a
+       key, the handshake goes on without one). */
+    int valid = context->ticket_keys_valid_;
+    if (encrypt && valid > 0)
+      key = context->ticket_keys_[0];
+    else if (encrypt)
+      return 0;
+    else if (valid > 0 &&
+             !std::memcmp(name, context->ticket_keys_[0].name, sizeof(key.name)))
+      key = context->ticket_keys_[0];
+    else if (valid > 1 &&
+             !std::memcmp(name, context->ticket_keys_[1].name, sizeof(key.name))){
+      key = context->ticket_keys_[1];
+      result = 2;
+    }
+    else
+      return 0;
+  }
+
+  OSSL_PARAM params[] = {
+    OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key,
+                                      sizeof(key.hmac_key)),
+    OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                     const_cast<char*>("sha256"), 0),
+    OSSL_PARAM_construct_end()
+  };
+  if (!EVP_MAC_CTX_set_params(mac, params))
+    return -1;
+  if (encrypt){
+    std::memcpy(name, key.name, sizeof(key.name));
+    if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1 ||
+        !EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key, iv))
+      return -1;
+  }
+  else if (!EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key, iv))
+    return -1;
+  return result;
+}
\ No newline at end of file
@@ -1,25 +1,183 @@
 #include <boost/asio.hpp> // io_context, signal_set
 #include <boost/filesystem.hpp> // parent_path, system_complete
+#include <chrono> // steady_clock
+#include <set>
+#include <thread> // thread
+#include <unordered_map>
 
+#include "file_cache.h" // FileCache
+#include "handshake_pool.h" // HandshakePool
 #include "log.h"
 #include "nginx_config_parser.h" // Config, ConfigParser, LocationBlock
+#include "open_file_cache.h" // OpenFileCache
 #include "server/http_server.h" // http_server
 #include "server/https_server.h" // https_server
 
 // Standardized log prefix for this source
 #define LOG_PRE "[Main]     "
 
-// Made global so that it can be stopped gracefully by signal_handler.
+/* Made global so that it can be stopped gracefully by signal_handler. Run by
+   every worker thread; sessions serialize their own handlers with strands. */
 boost::asio::io_context io_context_;
+/* In sharded worker mode, io_context_ is the main thread's shard and each
+   additional worker thread runs its own IO context from this vector. */
+std::vector<boost::asio::io_context*> shard_contexts_;
 
+/* Dynamically allocate server instances to prevent lifetime from expiring
+   while still in use (manifests as error message "Operation canceled").
+   Servers whose port a reload removed stop accepting, but are only freed
+   after the IO contexts stop, like the others. */
+std::vector<server*> servers_;
+std::vector<server*> closed_servers_;
+std::string config_path_; // Reparsed on SIGHUP
+bool shared_port_ = false; // Servers bind with SO_REUSEPORT (sharded workers)
 
-// Used by signals.async_wait, stops the IO context upon receiving a signal.
-void signal_handler(const boost::system::error_code& ec, int sig){
+
+/// Launches a server instance on io_context for config.
+server* launch_server(std::shared_ptr<Config> config,
+                      boost::asio::io_context& io_context, bool shared_port){
+  switch (config->type){
+    case Config::ServerType::HTTPS_SERVER:
+      return new https_server(config, io_context, shared_port);
+    default:
+      return new http_server(config, io_context, shared_port);
+  }
+}
+
+
+/// Launches a server instance on io_context for each parsed config.
+void launch_servers(boost::asio::io_context& io_context){
+  for (std::shared_ptr<Config> config : ConfigParser::inst().snapshot())
+    servers_.push_back(launch_server(config, io_context, shared_port_));
+}
+
+
+/// Applies the open_file_cache directives, on startup and on every reload.
+void configure_open_file_cache(){
+  ConfigParser& parser = ConfigParser::inst();
+  OpenFileCache::inst().configure(parser.open_file_cache_max(),
+                                  std::chrono::seconds(parser.open_file_cache_inactive()),
+                                  std::chrono::seconds(parser.open_file_cache_valid()),
+                                  parser.open_file_cache_errors());
+}
+
+
+/* Reparses the config file and applies it without dropping connections.
+   Servers on ports that are still listened on swap in their new Config for
+   the sessions they accept from now on, servers on removed ports stop
+   accepting, and new ports get a server on every IO context. Sessions keep
+   the Config they started with until they close. If the file fails to parse,
+   the current config stays in effect. */
+void reload_config(){
+  auto start = std::chrono::steady_clock::now();
+  ConfigParser& parser = ConfigParser::inst();
+  // Thread counts and the FileCache size are applied once at startup
+  unsigned worker_threads = parser.worker_threads();
+  ConfigParser::WorkerMode worker_mode = parser.worker_mode();
+  unsigned ssl_handshake_threads = parser.ssl_handshake_threads();
+  size_t open_cache_max_size = parser.open_cache_max_size();
+
+  // Logs the parse error as fatal, which it is at startup but not here
+  if (!parser.parse(config_path_)){
+    Log::error(LOG_PRE, "Failed to reload " + config_path_ +
+               ", keeping the current config (see the error above)");
+    return;
+  }
+  if (parser.worker_threads() != worker_threads ||
+      parser.worker_mode() != worker_mode ||
+      parser.ssl_handshake_threads() != ssl_handshake_threads ||
+      parser.open_cache_max_size() != open_cache_max_size)
+    Log::warn(LOG_PRE, "worker_threads, worker_mode, ssl_handshake_threads and "
+              "open_cache_max_size changes need a restart");
+  configure_open_file_cache(); // Unlike FileCache, resized in place
+
+  std::unordered_map<unsigned short, std::shared_ptr<Config>> configs;
+  for (std::shared_ptr<Config> config : parser.snapshot())
+    configs.emplace(config->port, config);
+
+  std::vector<server*> servers;
+  std::set<unsigned short> closed_ports; // One server per IO context
+  for (server* server : servers_){
+    auto it = configs.find(server->port());
+    if (it == configs.end()){ // Port removed, connections already accepted stay
+      server->close();
+      closed_servers_.push_back(server);
+      closed_ports.insert(server->port());
+      continue;
+    }
+    servers.push_back(server);
+    if (it->second->type != server->type()){
+      Log::error(LOG_PRE, "Switching port " + std::to_string(server->port()) +
+                 " between HTTP and HTTPS needs a restart, keeping its current config");
+      continue;
+    }
+    try{
+      server->reconfigure(it->second);
+    }
+    catch (std::exception& e){ // e.g., certificate and key don't match
+      Log::error(LOG_PRE, "Failed to reload port " + std::to_string(server->port()) +
+                 ", keeping its current config: " + e.what());
+    }
+  }
+  for (server* server : servers)
+    configs.erase(server->port());
+  for (unsigned short port : closed_ports)
+    Log::info(LOG_PRE, "Stopped listening on port " + std::to_string(port));
+
+  // Remaining configs are on new ports, served like those at startup
+  std::vector<boost::asio::io_context*> contexts{&io_context_};
+  contexts.insert(contexts.end(), shard_contexts_.begin(), shard_contexts_.end());
+  for (auto& [port, config] : configs){
+    size_t launched = servers.size();
+    for (boost::asio::io_context* io_context : contexts){
+      try{
+        servers.push_back(launch_server(config, *io_context, shared_port_));
+      }
+      catch (std::exception& e){ // e.g., port already in use
+        Log::error(LOG_PRE, "Failed to listen on port " + std::to_string(port) +
+                   ": " + e.what());
+        /* Close the port on the IO contexts it was opened on, so that it
+           isn't served by only some of the shards. */
+        for (size_t i = launched; i < servers.size(); i++){
+          servers[i]->close();
+          closed_servers_.push_back(servers[i]);
+        }
+        servers.resize(launched);
+        break;
+      }
+    }
+  }
+  servers_ = servers;
+
+  double latency = std::chrono::duration<double, std::milli>(
+    std::chrono::steady_clock::now() - start).count();
+  Log::info(LOG_PRE, "Reloaded " + config_path_ + " in " +
+            std::to_string(latency) + " ms, listening on " +
+            std::to_string(servers_.size()) + " socket(s)");
+}
+
+
+/* Used by signals.async_wait, stops the IO context upon receiving SIGINT or
+   SIGTERM, and reloads the config upon receiving SIGHUP. */
+void signal_handler(boost::asio::signal_set& signals,
+                    const boost::system::error_code& ec, int sig){
+  if (ec)
+    return; // signal_set cancelled, shutting down
+  if (sig == SIGHUP){
+    Log::info(LOG_PRE, "SIGHUP received, reloading the config.");
+    reload_config();
+    signals.async_wait([&signals](const boost::system::error_code& ec, int sig){
+      signal_handler(signals, ec, sig);
+    });
+    return;
+  }
   if (sig == SIGINT)
     Log::info(LOG_PRE, "SIGINT received, shutting down gracefully.");
   else
     Log::info(LOG_PRE, "SIGTERM received, shutting down gracefully.");
-  io_context_.stop(); // Causes io_context_.run() to stop blocking main
+  io_context_.stop(); // Causes io_context_.run() to return in all threads
+  for (boost::asio::io_context* shard_context : shard_contexts_)
+    shard_context->stop();
 }
 
 
@@ -30,9 +188,11 @@ int main(int argc, char* argv[]){
       return 1; // Exit with non-zero exit code
     }
 
-    // Register signal_handler to handle SIGINT and SIGTERM.
-    boost::asio::signal_set signals(io_context_, SIGINT, SIGTERM);
-    signals.async_wait(signal_handler);
+    // Register signal_handler to handle SIGINT, SIGTERM and SIGHUP.
+    boost::asio::signal_set signals(io_context_, SIGINT, SIGTERM, SIGHUP);
+    signals.async_wait([&signals](const boost::system::error_code& ec, int sig){
+      signal_handler(signals, ec, sig);
+    });
 
     /* Find root directory from binary path argv[0], works regardless of cwd.
        Binary is built at <root>/build/bin/server, so calling parent_path()
@@ -45,36 +205,71 @@ int main(int argc, char* argv[]){
 
     /* Parse the config file given in argv[1]. If a parse error occurs,
        ConfigParser will handle the fatal log, so just exit here. */
-    if (!ConfigParser::inst().parse(root_dir + "/" + argv[1]))
+    config_path_ = root_dir + "/" + argv[1];
+    if (!ConfigParser::inst().parse(config_path_))
       return 1; // Exit with non-zero exit code
 
-    /* Dynamically allocate server instances to prevent lifetime from expiring
-       while still in use (manifests as error message "Operation canceled"). */
-    std::vector<server*> servers;
-
-    // For each config, launch a server instance
-    for (Config* config : ConfigParser::inst().configs()){
-      switch (config->type){
-        case Config::ServerType::HTTP_SERVER:
-          servers.push_back(new http_server(config, io_context_));
-          break;
-        case Config::ServerType::HTTPS_SERVER:
-          servers.push_back(new https_server(config, io_context_));
+    /* Size the static file cache from open_cache_max_size. io_context_ reads
+       inotify events so that cache hits don't need to stat the file. */
+    FileCache::inst().max_size(ConfigParser::inst().open_cache_max_size());
+    if (FileCache::inst().max_size()){
+      FileCache::inst().watch(io_context_);
+      Log::info(LOG_PRE, "Caching static files in up to " +
+                std::to_string(FileCache::inst().max_size()) + " bytes");
+    }
+
+    // Caches file lookups (descriptors, stat results and missing paths)
+    configure_open_file_cache();
+    if (ConfigParser::inst().open_file_cache_max())
+      Log::info(LOG_PRE, "Caching up to " +
+                std::to_string(ConfigParser::inst().open_file_cache_max()) +
+                " open files");
+
+    // Moves the asymmetric crypto of TLS handshakes off the worker threads
+    HandshakePool::inst().start(ConfigParser::inst().ssl_handshake_threads());
+
+    /* The main thread counts as the first worker, so only worker_threads - 1
+       threads are spawned. */
+    unsigned worker_threads = ConfigParser::inst().worker_threads();
+    std::vector<std::thread> workers;
+
+    if (ConfigParser::inst().worker_mode() == ConfigParser::SHARDED_WORKERS){
+      /* Each worker thread owns an IO context with its own SO_REUSEPORT
+         acceptor for every config. The kernel load-balances connections
+         between them and a session never leaves the thread that accepted it. */
+      Log::info(LOG_PRE, "Running " + std::to_string(worker_threads) +
+                " sharded worker thread(s)");
+      shared_port_ = true;
+      launch_servers(io_context_);
+      for (unsigned i = 1; i < worker_threads; i++){
+        // Concurrency hint 1: each shard is only ever run by one thread
+        shard_contexts_.push_back(new boost::asio::io_context(1));
+        launch_servers(*shard_contexts_.back());
       }
+      for (boost::asio::io_context* shard_context : shard_contexts_)
+        workers.emplace_back([shard_context]{shard_context->run();});
+    }
+    else{ // Shared workers: all threads run io_context_
+      Log::info(LOG_PRE, "Running with " + std::to_string(worker_threads) +
+                " worker thread(s)");
+      launch_servers(io_context_);
+      for (unsigned i = 1; i < worker_threads; i++)
+        workers.emplace_back([]{io_context_.run();});
     }
 
     io_context_.run(); // Blocks until signal_handler calls io_context_.stop()
+    for (std::thread& worker : workers)
+      worker.join(); // Wait for remaining workers to return from run()
+    HandshakePool::inst().stop();
 
-    // After IO context stops blocking, free all dynamically allocated memory.
-    for (server* server : servers)
+    /* After IO context stops blocking, free all dynamically allocated memory.
+       Each Config is freed with the last server or session that shares it. */
+    for (server* server : servers_)
       delete server;
-    for (Config* config : ConfigParser::inst().configs()){
-      for (std::vector<LocationBlock*> location_block_vec : config->locations){
-        for (LocationBlock* location : location_block_vec)
-          delete location;
-      }
-      delete config;
-    }
+    for (server* server : closed_servers_)
+      delete server;
+    for (boost::asio::io_context* shard_context : shard_contexts_)
+      delete shard_context;
   }
   catch (std::exception& e){
     Log::fatal(LOG_PRE, "Exception " + std::string(e.what()));
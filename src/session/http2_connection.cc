@@ -0,0 +1,322 @@
+#include <boost/algorithm/string/case_conv.hpp> // to_lower_copy
+#include <boost/asio.hpp> // async_write, buffer, redirect_error, use_awaitable
+#include <algorithm> // min
+#include <cstring> // memcpy
+#include <unistd.h> // pread
+
+#include "session/http2_connection.h"
+#include "session/session_base.h" // session_base::append_body
+
+// Standardized log prefix for this source
+#define LOG_PRE "[Session]  "
+
+using namespace boost::asio;
+using boost::system::error_code;
+
+
+void remove_body_file(std::string& body_file); // Defined in session_base.cc
+
+
+/// Sets up the nghttp2 server session.
+http2_connection::http2_connection(https_socket& socket, Config* config,
+                                   const std::string& client_ip,
+                                   handler_type handler)
+  : socket_(socket), config_(config), client_ip_(client_ip),
+    handler_(std::move(handler)),
+    read_buffer_(std::make_unique<char[]>(read_buffer_size)){
+  nghttp2_session_callbacks* callbacks;
+  if (nghttp2_session_callbacks_new(&callbacks))
+    throw std::bad_alloc();
+  nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks, on_begin_headers);
+  nghttp2_session_callbacks_set_on_header_callback(callbacks, on_header);
+  nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, on_frame_recv);
+  nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, on_data_chunk_recv);
+  nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, on_stream_close);
+  int result = nghttp2_session_server_new(&session_, callbacks, this);
+  nghttp2_session_callbacks_del(callbacks);
+  if (result)
+    throw std::bad_alloc();
+
+  // Sent first, right after the client's connection preface
+  nghttp2_settings_entry settings[] = {
+    {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, max_concurrent_streams}
+  };
+  nghttp2_submit_settings(session_, NGHTTP2_FLAG_NONE, settings, 1);
+}
+
+
+/// Frees the nghttp2 session. Streams still open are dropped.
+http2_connection::~http2_connection(){
+  nghttp2_session_del(session_);
+}
+
+
+/// Removes the spilled body of a stream, if any.
+http2_connection::stream::~stream(){
+  remove_body_file(body_file);
+}
+
+
+/// Serves request streams until the connection ends.
+awaitable<void> http2_connection::run(error_code& error){
+  while (nghttp2_session_want_read(session_) || nghttp2_session_want_write(session_)){
+    co_await flush(error);
+    /* Without reads, queued DATA can't get the WINDOW_UPDATEs it waits for.
+       nghttp2 stops reading after GOAWAY once all streams are closed. */
+    if (error || !nghttp2_session_want_read(session_))
+      break;
+    size_t bytes = co_await socket_.async_read_some(
+      buffer(read_buffer_.get(), read_buffer_size), redirect_error(use_awaitable, error));
+    if (error)
+      break;
+    // Runs the callbacks below, which respond to each complete request
+    ssize_t consumed = nghttp2_session_mem_recv(
+      session_, reinterpret_cast<const uint8_t*>(read_buffer_.get()), bytes);
+    if (consumed < 0){ // e.g., bad connection preface, nghttp2 queued GOAWAY
+      error_code ignored;
+      co_await flush(ignored);
+      error = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+      break;
+    }
+  }
+}
+
+
+/// Writes every frame nghttp2 has ready, gathered into large TLS writes.
+awaitable<void> http2_connection::flush(error_code& error){
+  while (true){
+    write_buffer_.clear();
+    while (write_buffer_.size() < write_batch_size){
+      const uint8_t* data;
+      ssize_t length = nghttp2_session_mem_send(session_, &data);
+      if (length < 0){
+        error = boost::system::errc::make_error_code(boost::system::errc::protocol_error);
+        co_return;
+      }
+      if (length == 0) // Nothing ready, or DATA waiting for flow control
+        break;
+      write_buffer_.append(reinterpret_cast<const char*>(data), length);
+    }
+    if (write_buffer_.empty())
+      co_return;
+    co_await async_write(socket_, buffer(write_buffer_),
+                         redirect_error(use_awaitable, error));
+    if (error)
+      co_return;
+  }
+}
+
+
+/// Creates the response of a stream and submits its HEADERS and body.
+void http2_connection::respond(int32_t stream_id, stream& stream, int status){
+  stream.responded = true;
+  error_code ec;
+  stream.body_out.close(ec); // The handler reads the spilled body by its path
+  stream.res.reset(handler_(stream.req, stream.body_file, status, stream.received,
+                            stream.req_info));
+  const Response& res = *stream.res;
+
+  // Field names must be lowercase, and connection-specific fields are banned
+  std::string status_value = std::to_string(res.result_int());
+  std::vector<std::string> names;
+  names.reserve(std::distance(res.begin(), res.end()));
+  std::vector<nghttp2_nv> headers;
+  auto add = [&headers](boost::beast::string_view name, boost::beast::string_view value){
+    headers.push_back({(uint8_t*)name.data(), (uint8_t*)value.data(),
+                       name.size(), value.size(), NGHTTP2_NV_FLAG_NONE});
+  };
+  add(":status", status_value);
+  for (const auto& field : res){
+    std::string& name = names.emplace_back(
+      boost::algorithm::to_lower_copy(std::string(field.name_string())));
+    if (name == "connection" || name == "keep-alive" || name == "proxy-connection" ||
+        name == "transfer-encoding" || name == "upgrade")
+      continue;
+    add(name, field.value());
+  }
+
+  // Same body sources as session_base::prepare_batch() and send_file()
+  const std::string& body = res.shared_body ? *res.shared_body : res.body();
+  int fd = res.file ? res.file->file().native_handle() : -1;
+  auto add_bytes = [&](std::uint64_t offset, std::uint64_t length){
+    if (length)
+      stream.body.push_back(res.file ? segment{nullptr, fd, offset, length} :
+                                       segment{body.data() + offset, -1, 0, length});
+  };
+  auto add_text = [&stream](const std::string& text){
+    if (text.size())
+      stream.body.push_back({text.data(), -1, 0, text.size()});
+  };
+  if (res.ranges.empty())
+    add_bytes(0, res.payload_size());
+  for (const Response::byte_range& range : res.ranges){
+    add_text(range.prefix);
+    add_bytes(range.offset, range.length);
+  }
+  add_text(res.ranges_suffix);
+
+  nghttp2_data_provider provider;
+  provider.source.ptr = &stream;
+  provider.read_callback = read_body;
+  // Copies the header fields. No body ends the stream with HEADERS
+  nghttp2_submit_response(session_, stream_id, headers.data(), headers.size(),
+                          stream.body.empty() ? nullptr : &provider);
+}
+
+
+/// Starts a request stream when its HEADERS frame arrives.
+int http2_connection::on_begin_headers(nghttp2_session* session,
+                                       const nghttp2_frame* frame,
+                                       void* user_data){
+  http2_connection* connection = static_cast<http2_connection*>(user_data);
+  if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST)
+    return 0;
+  std::unique_ptr<stream>& stream = connection->streams_[frame->hd.stream_id];
+  stream = std::make_unique<http2_connection::stream>();
+  stream->req.version(20);
+  return 0;
+}
+
+
+/// Adds a header field, decoded by HPACK, to the request of its stream.
+int http2_connection::on_header(nghttp2_session* session,
+                                const nghttp2_frame* frame, const uint8_t* name,
+                                size_t name_length, const uint8_t* value,
+                                size_t value_length, uint8_t flags,
+                                void* user_data){
+  http2_connection* connection = static_cast<http2_connection*>(user_data);
+  auto it = connection->streams_.find(frame->hd.stream_id);
+  if (it == connection->streams_.end() || it->second->responded)
+    return 0;
+  stream& stream = *it->second;
+  boost::beast::string_view field(reinterpret_cast<const char*>(name), name_length);
+  boost::beast::string_view field_value(reinterpret_cast<const char*>(value), value_length);
+  stream.received += name_length + value_length;
+  // nghttp2 has already checked the pseudo-header fields of a request
+  if (field == ":method")
+    stream.req.method_string(field_value);
+  else if (field == ":path")
+    stream.req.target(field_value);
+  else if (field == ":authority")
+    stream.req.set(http::field::host, field_value);
+  else if (field[0] != ':') // Not :scheme
+    stream.req.insert(field, field_value);
+  return 0;
+}
+
+
+/// Applies client_max_body_size, and responds once a request is complete.
+int http2_connection::on_frame_recv(nghttp2_session* session,
+                                    const nghttp2_frame* frame,
+                                    void* user_data){
+  http2_connection* connection = static_cast<http2_connection*>(user_data);
+  if (frame->hd.type != NGHTTP2_HEADERS && frame->hd.type != NGHTTP2_DATA)
+    return 0;
+  auto it = connection->streams_.find(frame->hd.stream_id);
+  if (it == connection->streams_.end() || it->second->responded)
+    return 0;
+  stream& stream = *it->second;
+
+  if (frame->hd.type == NGHTTP2_HEADERS && frame->headers.cat == NGHTTP2_HCAT_REQUEST){
+    // Same limit as session_base::prepare_body(), location blocks override it
+    Config* config = connection->config_;
+    stream.body_limit = config->body_limit(stream.req.target());
+    auto length = stream.req.find(http::field::content_length);
+    if (stream.body_limit && length != stream.req.end() &&
+        std::strtoull(std::string(length->value()).c_str(), nullptr, 10) > stream.body_limit){
+      connection->respond(frame->hd.stream_id, stream, 413); // Before the body
+      return 0;
+    }
+  }
+  if (frame->hd.flags & NGHTTP2_FLAG_END_STREAM){
+    // HTTP/2 needs no Content-Length, but verify_req() wants one for POST
+    if (!stream.req.has_content_length() && stream.body_size)
+      stream.req.content_length(stream.body_size);
+    else if (!stream.req.has_content_length())
+      stream.req.prepare_payload();
+    connection->respond(frame->hd.stream_id, stream, 0);
+  }
+  return 0;
+}
+
+
+/* Appends a DATA frame to the request body, up to client_max_body_size.
+   Bodies past session_base::body_buffer_size are spilled to a file. */
+int http2_connection::on_data_chunk_recv(nghttp2_session* session,
+                                         uint8_t flags, int32_t stream_id,
+                                         const uint8_t* data, size_t length,
+                                         void* user_data){
+  http2_connection* connection = static_cast<http2_connection*>(user_data);
+  auto it = connection->streams_.find(stream_id);
+  if (it == connection->streams_.end() || it->second->responded)
+    return 0; // Rest of a rejected body, nghttp2 still updates the window
+  stream& stream = *it->second;
+  stream.received += length;
+  stream.body_size += length;
+  if (stream.body_limit && stream.body_size > stream.body_limit){
+    connection->respond(stream_id, stream, 413); // Chunks without Content-Length
+    return 0;
+  }
+  if (!session_base::append_body(stream.req.body(), stream.body_file, stream.body_out,
+                                 reinterpret_cast<const char*>(data), length)){
+    Log::error(LOG_PRE, "Failed to spill a request body to a temporary file");
+    connection->respond(stream_id, stream, 500);
+  }
+  return 0;
+}
+
+
+/// Logs the response of a closed stream, then frees the stream.
+int http2_connection::on_stream_close(nghttp2_session* session,
+                                      int32_t stream_id, uint32_t error_code,
+                                      void* user_data){
+  http2_connection* connection = static_cast<http2_connection*>(user_data);
+  auto it = connection->streams_.find(stream_id);
+  if (it == connection->streams_.end())
+    return 0;
+  stream& stream = *it->second;
+  if (stream.res) // HPACK compresses the header, so only the body is counted
+    Log::res_metrics(connection->client_ip_, stream.req_info,
+                     stream.res->payload_size(), stream.res->result_int());
+  connection->streams_.erase(it);
+  return 0;
+}
+
+
+/**
+ * Copies the next bytes of a response body into a DATA frame. nghttp2 calls
+ * it whenever flow control and stream priorities let the stream send.
+ *
+ * @returns The number of bytes copied, or NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE
+ *   to reset the stream if the file can't be read (e.g., it shrank).
+ */
+ssize_t http2_connection::read_body(nghttp2_session* session, int32_t stream_id,
+                                    uint8_t* buf, size_t length,
+                                    uint32_t* data_flags,
+                                    nghttp2_data_source* source,
+                                    void* user_data){
+  stream& stream = *static_cast<http2_connection::stream*>(source->ptr);
+  size_t copied = 0;
+  while (copied < length && stream.next < stream.body.size()){
+    segment& part = stream.body[stream.next];
+    size_t bytes = std::min<std::uint64_t>(length - copied, part.length);
+    if (part.data){
+      std::memcpy(buf + copied, part.data, bytes);
+      part.data += bytes;
+    }
+    else{
+      ssize_t read = ::pread(part.fd, buf + copied, bytes, part.offset);
+      if (read <= 0)
+        return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+      bytes = read;
+      part.offset += bytes;
+    }
+    part.length -= bytes;
+    copied += bytes;
+    if (!part.length)
+      stream.next++;
+  }
+  if (stream.next == stream.body.size())
+    *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+  return copied;
+}
\ No newline at end of file
@@ -1,8 +1,12 @@
-#include <boost/asio.hpp> // io_context, placeholders
-#include <boost/asio/ssl.hpp> // ssl::context, ssl::stream
-#include <boost/bind/bind.hpp> // bind
+#include <boost/asio.hpp> // redirect_error, use_awaitable
+#include <boost/asio/ssl.hpp> // ssl::error
+#include <chrono> // steady_clock
 
+#include "analytics.h" // Analytics::inst()
 #include "session/https_session.h"
+#ifdef ENABLE_HTTP2
+#include "session/http2_connection.h" // http2_connection
+#endif
 
 // Standardized log prefix for this source
 #define LOG_PRE "[Session]  "
@@ -11,25 +15,57 @@ using namespace boost::asio;
 using boost::system::error_code;
 
 
-/// Asynchronously performs SSL handshake, then calls handle_handshake.
-void https_session::do_handshake(){
-  socket_->async_handshake(ssl::stream_base::server,
-                           boost::bind(&https_session::handle_handshake,
-                                       this, placeholders::error));
+/// Performs SSL handshake. Returns false (after closing) if it failed.
+awaitable<bool> https_session::do_handshake(){
+  error_code ec;
+  auto start = std::chrono::steady_clock::now();
+  co_await socket_->async_handshake(redirect_error(use_awaitable, ec));
+  if (ec && ec != ssl::error::stream_truncated){ // Ignore stream truncated
+    close(2, "Got error \"" + ec.message() + "\" while performing SSL handshake, shutting down.");
+    co_return false;
+  }
+  SSL* ssl = socket_->native_handle();
+  if (!ec) // Latency includes the client's round trips
+    Analytics::inst().record_handshake(SSL_get_version(ssl),
+      SSL_get_cipher_name(ssl), SSL_session_reused(ssl),
+      std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start));
+  co_return true;
 }
 
+#ifdef ENABLE_HTTP2
+/// Serves the connection with HTTP/2 if the client selected h2 with ALPN.
+awaitable<bool> https_session::run_negotiated(){
+  const unsigned char* protocol = nullptr;
+  unsigned int length = 0;
+  SSL_get0_alpn_selected(socket_->native_handle(), &protocol, &length);
+  if (std::string_view(reinterpret_cast<const char*>(protocol), length) != "h2")
+    co_return false;
 
-/// Checks if the SSL handshake succeeded, then calls do_read.
-void https_session::handle_handshake(const error_code& error){
-  if (error && error != ssl::error::stream_truncated) // Ignore stream truncated
-    close(2, "Got error \"" + error.message() + "\" while performing SSL handshake, shutting down.");
+  Analytics::inst().http2_connections++;
+  // Each stream is answered like an HTTP/1.1 request, see handle_read()
+  http2_connection connection(*socket_, config_.get(), client_ip_,
+    [this](Request& req, const std::string& body_file, int status,
+           size_t received, Log::req_info& req_info){
+      received_bytes_ = received;
+      if (status)
+        return create_response(status, "", req_info);
+      return config_->ret ? create_return_response(req, req_info) :
+                            create_response(req, req_info, body_file);
+    });
+  error_code ec;
+  co_await connection.run(ec);
+  if (ec)
+    handle_read_error(ec); // Also logs write and protocol errors
   else
-    do_read();
+    close(0, "HTTP/2 connection ended with GOAWAY, shutting down.");
+  co_return true;
 }
+#endif
+
 
 /// Closes the current session.
 void https_session::do_close(){
   error_code ec;
-  socket_->shutdown(ec); // Shut down gracefully
-  delete this;
-}
\ No newline at end of file
+  socket_->shutdown(ec); // Send close_notify
+}
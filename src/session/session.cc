@@ -1,5 +1,10 @@
-#include <boost/asio.hpp> // buffer, placeholders
-#include <boost/bind/bind.hpp> // bind
+#include <boost/asio.hpp> // async_write, redirect_error, use_awaitable
+#include <sys/sendfile.h> // sendfile
+#include <algorithm> // min
+#include <cerrno> // errno, EAGAIN, EINTR
+#include <memory> // make_unique
+#include <type_traits> // is_same_v
+#include <unistd.h> // pread
 
 #include "session/session.h"
 #include "typedefs/socket.h" // http_socket, https_socket
@@ -8,32 +13,206 @@
 #define LOG_PRE "[Session]  "
 
 using namespace boost::asio;
+using boost::system::error_code;
 
+// Interim response sent to clients that send Expect: 100-continue
+static const std::string_view continue_response = "HTTP/1.1 100 Continue\r\n\r\n";
 
-/// Asynchronously reads incoming data from socket_, then calls handle_read.
+
+/** 
+ * Session loop: handshake, then read, parse, dispatch and write until the
+ * connection closes. Coroutine frames come from asio's per-thread recycling
+ * allocator, so a keep-alive request allocates no completion handlers.
+ */
 template <class AsyncWriteStream>
-void session<AsyncWriteStream>::do_read(){
-  socket_->async_read_some(buffer(data_, max_length),
-                           boost::bind(&session::handle_read, this,
-                                       placeholders::error,
-                                       placeholders::bytes_transferred));
+awaitable<void> session<AsyncWriteStream>::run(){
+  try{ // Throws boost::system::system_error
+    client_ip_ = socket().remote_endpoint().address().to_string();
+  }
+  catch(boost::system::system_error){ // Thrown by socket::remote_endpoint()
+    close(0, "Client disconnected from session.");
+    co_return;
+  }
+
+  if (!co_await do_handshake())
+    co_return; // do_handshake() already closed the session
+  if (co_await run_negotiated())
+    co_return; // e.g., HTTP/2 selected with ALPN, already closed
+
+  error_code ec;
+  while (true){
+    /* Read the header, then the body, until the request is complete. Only
+       newly received bytes are parsed; anything past the end of this request
+       stays in buffer_. A parser left incomplete by the pipelining loop below
+       is resumed rather than replaced. */
+    if (!parser_ || request_done())
+      init_parser();
+    if (!header_done()){
+      received_bytes_ += co_await http::async_read_header(
+        *socket_, buffer_, *parser_, redirect_error(use_awaitable, ec));
+      if (!ec) // Applies client_max_body_size, may spill the body to a file
+        ec = prepare_body();
+    }
+    if (!ec && !request_done()){
+      /* Expect: 100-continue, the client waits for approval before sending
+         the body. Oversized bodies were already rejected by prepare_body(). */
+      if (expects_continue())
+        co_await boost::asio::async_write(
+          *socket_, buffer(continue_response), redirect_error(use_awaitable, ec));
+      if (!ec && file_parser_) // Body streams into the spill file
+        received_bytes_ += co_await http::async_read(
+          *socket_, buffer_, *file_parser_, redirect_error(use_awaitable, ec));
+      else if (!ec)
+        received_bytes_ += co_await http::async_read(
+          *socket_, buffer_, *parser_, redirect_error(use_awaitable, ec));
+    }
+
+    // Returns false if the session was closed due to a read error
+    if (!queue_response(ec))
+      co_return;
+
+    /* Pipelining: answer every complete request the client already sent
+       in the same batch, without waiting for another read. */
+    while (pipeline_ready()){
+      init_parser();
+      if (!parse_buffered(ec))
+        break; // Incomplete request, finish reading it on the next iteration
+      if (!queue_response(ec))
+        co_return; // Spill file couldn't be created, session already closed
+    }
+
+    /* Write all queued responses in order with gathered writes. Only a body
+       file splits the batch, since it is sent separately after its headers. */
+    ec = {}; // Read errors were already answered by queue_response()
+    for (size_t next = 0; !ec && next < batch_.size();){
+      std::vector<const_buffer>& buffers = prepare_batch(next);
+      if (batch_[next - 1].res->file) // Ends with a body file's headers
+        co_await send_file(buffers, *batch_[next - 1].res, ec);
+      else
+        co_await boost::asio::async_write(
+          *socket_, buffers, redirect_error(use_awaitable, ec));
+    }
+    if (!handle_write(ec))
+      co_return; // handle_write() already closed the session
+  }
 }
 
 
-/// Given a pointer to a Response object, writes the response to the client.
+/** 
+ * Writes the gathered headers, then a response body file. Plain TCP sockets
+ * use sendfile(2), so the body goes from the page cache to the socket without
+ * being copied to userspace. So do TLS streams with kTLS, through
+ * SSL_sendfile. Otherwise, TLS streams read it in chunks and encrypt it in
+ * userspace.
+ *
+ * @param headers Buffers ending with the headers of the body file's response.
+ * @param res The response, whose res.ranges (or the whole file) are sent.
+ * @param[out] error Set if the write fails or the file shrank.
+ */
 template <class AsyncWriteStream>
-void session<AsyncWriteStream>::do_write(Response* res,
-                                         Log::req_info& req_info){
-  total_received_data_ = ""; // Clear total received data
-  // async_write returns immediately, res must be kept alive for handle_write.
-  http::async_write(*socket_, *res,
-                    boost::bind(&session::handle_write, this,
-                                placeholders::error,
-                                placeholders::bytes_transferred,
-                                res, req_info));
+awaitable<void> session<AsyncWriteStream>::send_file(
+    const std::vector<const_buffer>& headers, const Response& res,
+    error_code& error){
+  http::file_body::value_type& file = *res.file;
+  const std::vector<Response::byte_range> whole{{0, file.size(), ""}};
+  const std::vector<Response::byte_range>& ranges =
+    res.ranges.empty() ? whole : res.ranges;
+
+  if constexpr (std::is_same_v<AsyncWriteStream, http_socket>){
+    /* Cork so the headers don't go out as a lone segment, which Nagle's
+       algorithm would hold until the client's delayed ACK (~40 ms) before
+       sending the file. Uncorking below flushes the last partial segment. */
+    socket_->set_option(tcp_cork(true), error);
+    if (!error)
+      co_await boost::asio::async_write(
+        *socket_, headers, redirect_error(use_awaitable, error));
+    // Wait for writability on EAGAIN instead of blocking the worker thread
+    if (!error)
+      socket_->native_non_blocking(true, error);
+    for (const Response::byte_range& range : ranges){
+      if (!error && range.prefix.size())
+        co_await boost::asio::async_write(
+          *socket_, buffer(range.prefix), redirect_error(use_awaitable, error));
+      off_t offset = range.offset;
+      std::uint64_t remaining = range.length;
+      while (!error && remaining){
+        ssize_t sent = ::sendfile(socket_->native_handle(),
+                                  file.file().native_handle(), &offset,
+                                  remaining);
+        if (sent > 0)
+          remaining -= sent;
+        else if (sent == 0) // File shrank after Content-Length was sent
+          error = boost::asio::error::eof;
+        else if (errno == EAGAIN) // Socket send buffer is full
+          co_await socket_->async_wait(http_socket::wait_write,
+                                       redirect_error(use_awaitable, error));
+        else if (errno != EINTR)
+          error.assign(errno, boost::system::system_category());
+      }
+    }
+    if (!error && res.ranges_suffix.size())
+      co_await boost::asio::async_write(
+        *socket_, buffer(res.ranges_suffix), redirect_error(use_awaitable, error));
+    error_code uncork_error; // Only matters if sending succeeded
+    socket_->set_option(tcp_cork(false), uncork_error);
+    if (!error)
+      error = uncork_error;
+  }
+  else{
+    // The kernel encrypts records (kTLS), so it can send the file by itself
+    bool ktls = socket_->ktls_send();
+    if (ktls) // Cork as above, so the headers share a segment with the body
+      socket_->next_layer().set_option(tcp_cork(true), error);
+    if (!error)
+      co_await boost::asio::async_write(
+        *socket_, headers, redirect_error(use_awaitable, error));
+    enum{chunk_size = 65536};
+    std::unique_ptr<char[]> chunk;
+    if (!ktls)
+      chunk = std::make_unique<char[]>(chunk_size);
+    for (const Response::byte_range& range : ranges){
+      if (!error && range.prefix.size())
+        co_await boost::asio::async_write(
+          *socket_, buffer(range.prefix), redirect_error(use_awaitable, error));
+      off_t offset = range.offset;
+      std::uint64_t remaining = range.length;
+      while (!error && remaining){
+        size_t bytes = 0;
+        if (ktls)
+          bytes = co_await socket_->async_sendfile(
+            file.file().native_handle(), offset, remaining,
+            redirect_error(use_awaitable, error));
+        else{
+          /* pread(2) rather than seek and read, as OpenFileCache shares the
+             descriptor with other responses */
+          ssize_t read = ::pread(file.file().native_handle(), chunk.get(),
+                                 std::min<std::uint64_t>(remaining, chunk_size), offset);
+          if (read < 0)
+            error.assign(errno, boost::system::system_category());
+          bytes = read > 0 ? read : 0;
+          if (!error && bytes)
+            co_await boost::asio::async_write(
+              *socket_, buffer(chunk.get(), bytes), redirect_error(use_awaitable, error));
+        }
+        if (!error && bytes == 0) // File shrank after Content-Length was sent
+          error = boost::asio::error::eof;
+        offset += bytes;
+        remaining -= bytes;
+      }
+    }
+    if (!error && res.ranges_suffix.size())
+      co_await boost::asio::async_write(
+        *socket_, buffer(res.ranges_suffix), redirect_error(use_awaitable, error));
+    if (ktls){
+      error_code uncork_error;
+      socket_->next_layer().set_option(tcp_cork(false), uncork_error);
+      if (!error)
+        error = uncork_error;
+    }
+  }
 }
 
 
 // Explicit instantiation of template types
 template class session<http_socket>;
-template class session<https_socket>;
\ No newline at end of file
+template class session<https_socket>;
@@ -1,6 +1,10 @@
+#include <boost/algorithm/string/find.hpp> // ifind_first
 #include <boost/algorithm/string/replace.hpp> // replace_all
-#include <boost/asio.hpp> // buffer
+#include <boost/asio.hpp> // buffer, co_spawn, const_buffer, detached
 #include <boost/asio/ssl.hpp> // ssl::error
+#include <boost/filesystem.hpp> // remove, temp_directory_path, unique_path
+#include <limits> // numeric_limits
+#include <sstream> // ostringstream
 
 #include "analytics.h"
 #include "log.h"
@@ -13,87 +17,221 @@
 
 using namespace boost::asio;
 using boost::system::error_code;
+namespace fs = boost::filesystem;
 
 
-Request parse_req(const std::string& received);
 int verify_req(Request& req);
 RequestHandler* dispatch(Request& req, Config* config_);
 std::string proc_invalid_req(const std::string& received); // Helper function for invalid request logging
+void remove_body_file(std::string& body_file);
 
 
-/// Parses incoming data from do_read() into HTTP request and creates response.
-void session_base::handle_read(const error_code& error, size_t bytes){
-  try{ // Throws boost::system::system_error
-    client_ip_ = socket().remote_endpoint().address().to_string();
+/// Spawns the session coroutine on the socket's strand.
+void session_base::start(){
+  // The lambda keeps the session alive until the coroutine returns
+  co_spawn(socket().get_executor(),
+           [self = shared_from_this()]{return self->run();}, detached);
+}
+
+
+/// Removes the spilled body of an unfinished request, if any.
+session_base::~session_base(){
+  remove_body_file(body_file_);
+}
+
+
+/// Prepares a fresh parser for the next request on this session.
+void session_base::init_parser(){
+  received_bytes_ = 0;
+  file_parser_.reset();
+  remove_body_file(body_file_); // Left behind if the last request failed
+  parser_.emplace();
+  parser_->header_limit(max_length);
+  /* The limit depends on the target's location, which isn't known until the
+     header is parsed. prepare_body() sets it, so don't reject anything yet
+     (a maximum rather than boost::none, which older Beast compares wrongly). */
+  parser_->body_limit(std::numeric_limits<std::uint64_t>::max());
+}
+
+
+/// Returns true once the header of the current request has been parsed.
+bool session_base::header_done(){
+  return file_parser_ || parser_->is_header_done();
+}
+
+
+/// Returns true once the current request has been parsed (or failed to).
+bool session_base::request_done(){
+  return file_parser_ ? file_parser_->is_done() : parser_->is_done();
+}
+
+
+/** 
+ * Applies client_max_body_size once the header is parsed, and moves the
+ * request into file_parser_ if its body may not fit in body_buffer_size.
+ *
+ * @returns http::error::body_limit if Content-Length exceeds the limit, an
+ *   error if the spill file can't be created, or success.
+ */
+error_code session_base::prepare_body(){
+  // Location blocks may override the server block's limit (0 is unlimited)
+  size_t limit = config_->body_limit(parser_->get().target());
+
+  boost::optional<std::uint64_t> length = parser_->content_length();
+  if (limit && length && *length > limit)
+    return http::error::body_limit; // Reject before the body is transmitted
+  if (limit) // Still needed for chunked bodies, which have no Content-Length
+    parser_->body_limit(limit);
+
+  if (parser_->is_done())
+    return {}; // No body
+  // Chunked bodies can only stay in memory if the limit keeps them small
+  if (length ? *length <= body_buffer_size : limit && limit <= body_buffer_size)
+    return {}; // Small enough to read into req.body()
+
+  // Stream the body into a temporary file instead of one large string
+  error_code error;
+  fs::path temp_dir = fs::temp_directory_path(error);
+  if (error)
+    return error;
+  body_file_ = (temp_dir / fs::unique_path("webserver-body-%%%%-%%%%-%%%%")).string();
+  file_parser_.emplace(std::move(*parser_)); // Keeps header and limits
+  file_parser_->get().body().open(body_file_.c_str(),
+                                  boost::beast::file_mode::write, error);
+  return error;
+}
+
+
+/// Appends a framed body to body, or to a temporary file past body_buffer_size.
+bool session_base::append_body(std::string& body, std::string& body_file,
+                               boost::beast::file& file, const char* data,
+                               size_t length){
+  if (body_file.empty() && body.size() + length <= body_buffer_size){
+    body.append(data, length);
+    return true;
   }
-  catch(boost::system::system_error){ // Thrown by socket::remote_endpoint()
-    close(0, "Client disconnected from session.");
-    return; // close() deletes this session, return to avoid segfault
+  error_code error;
+  if (body_file.empty()){ // Move what was buffered into the file first
+    fs::path temp_dir = fs::temp_directory_path(error);
+    if (error)
+      return false;
+    body_file = (temp_dir / fs::unique_path("webserver-body-%%%%-%%%%-%%%%")).string();
+    file.open(body_file.c_str(), boost::beast::file_mode::write, error);
+    if (!error)
+      file.write(body.data(), body.size(), error);
+    std::string().swap(body); // Frees the buffer
   }
+  if (!error)
+    file.write(data, length, error);
+  return !error;
+}
 
-  if (!error){ // do_read successfully read data
-    // Append incoming data from read buffer (data_) to total received data
-    total_received_data_ += std::string(data_, bytes);
 
-    // Treat excessively large requests as malicious
-    if (total_received_data_.length() >= max_length * 4){
-      create_response(413); // 413 Content Too Large
-      return; // Do not continue processing the request
-    }
+/// Returns true if the client waits for 100 Continue before sending the body.
+bool session_base::expects_continue(){
+  const Request::header_type& header = file_parser_ ?
+    file_parser_->get().base() : parser_->get().base();
+  /* HTTP/1.0 clients can't ask for 100 Continue. If body bytes have already
+     arrived, the client stopped waiting and the interim response is moot. */
+  return header.version() >= 11 && buffer_.size() == 0 &&
+         boost::beast::iequals(header[http::field::expect], "100-continue");
+}
 
-    Request req = parse_req(total_received_data_);
 
-    /* Config defines return directive, ignore all other processing and create
-       appropriate response. Validation offloaded to destination server. */
-    if (config_->ret){
-      create_return_response(req);
-      return; // Do not continue processing the request
+/** 
+ * Feeds already-buffered (pipelined) bytes into parser_ without reading.
+ *
+ * @param[out] error Set if the buffered request is malformed.
+ * @returns true if a complete (or malformed) request was parsed, false if
+ *   more data must be read first.
+ */
+bool session_base::parse_buffered(error_code& error){
+  while (buffer_.size() && !request_done()){
+    bool had_header = header_done();
+    size_t bytes = file_parser_ ? file_parser_->put(buffer_.data(), error) :
+                                  parser_->put(buffer_.data(), error);
+    buffer_.consume(bytes);
+    received_bytes_ += bytes;
+    if (error == http::error::need_more){ // Rest of request not received yet
+      error = {};
+      return false;
     }
+    if (!error && !had_header && header_done()) // put() stops after header
+      error = prepare_body();
+    if (error) // Malformed request, queue_response() creates error response
+      return true;
+  }
+  return request_done();
+}
 
-    /* Check parsed request for completeness. Because only max_length bytes may
-       be read at a time, it is possible to read an incomplete request. */
-    if (req.has_content_length()){
-      /* If the Content-Length header is present, we know the complete
-         request has been read when payload size matches Content-Length. */
-
-      /* Throws std::invalid_argument if non-numeric, but has_content_length()
-         ensures it is numeric, so no further handling required. */
-      int content_length = std::stoi(req.at(http::field::content_length));
-      
-      // Treat excessively large requests as malicious
-      if (content_length >= max_length * 4){
-        create_response(413); // 413 Content Too Large
-        return; // Do not continue processing the request
-      }
-
-      // Compare payload size to value in Content-Length header
-      boost::optional<uint64_t> payload_size_opt = req.payload_size();
-      if (payload_size_opt && *payload_size_opt < content_length)
-        do_read(); // Request is incomplete, continue reading incoming data
-      else
-        create_response(req); // Request is complete, create response
-    }
-    else{
-      /* If the Content-Length header is not present, there should be no body,
-         so we know the complete request has been read when bytes < max_length
-         or the request ends with \r\n\r\n. */
-      if (bytes < max_length)
-        create_response(req); // Request is complete, create response
-      else if (total_received_data_.substr(
-        total_received_data_.length() - 4) == "\r\n\r\n")
-        /* This condition would suffice for all requests with no body. However,
-           there is a very problematic edge case (complete request length
-           perfectly divisible by max_length), so the above comparison is
-           preferred and this is left as a fallback. */
-        create_response(req); // Request is complete, create response
-      else
-        do_read(); // Request is incomplete, continue reading incoming data
-    }
+
+/// Queues a response to parser_'s request. Returns false if session closed.
+bool session_base::queue_response(const error_code& error){
+  queued_response& queued = batch_.emplace_back();
+  queued.res.reset(handle_read(error, queued.req_info));
+  if (!queued.res){ // Read error, handle_read() closed the session
+    batch_.pop_back();
+    return false;
+  }
+  return true;
+}
+
+
+/// Returns true if another buffered request should join the current batch.
+bool session_base::pipeline_ready(){
+  /* Stop at the batch limit, and after any response that closes the
+     connection, since requests after it will never be answered. */
+  return buffer_.size() && batch_.size() < max_pipeline &&
+         batch_.back().res->keep_alive();
+}
+
+
+/// Creates a response to the request read by parser_, or nullptr on error.
+Response* session_base::handle_read(const error_code& error,
+                                    Log::req_info& req_info){
+  if (error == http::error::header_limit || error == http::error::body_limit){
+    // Header over max_length or body over client_max_body_size, don't read the rest
+    Response* res = create_response(413, "", req_info); // 413 Content Too Large
+    res->keep_alive(false);
+    return res;
+  }
+  if (error == http::error::end_of_stream ||
+      error == http::error::partial_message || (error && error.category() !=
+      http::make_error_code(http::error::bad_method).category())){
+    handle_read_error(error); // Closed by client, socket or SSL error
+    return nullptr;
   }
-  else if (error == error::eof)
+  if (error){ // Malformed request, any remaining bytes are unusable
+    std::string received(static_cast<const char*>(buffer_.data().data()),
+                         buffer_.size());
+    buffer_.consume(buffer_.size());
+    Response* res = create_response(400, received, req_info); // Bad Request
+    res->keep_alive(false);
+    return res;
+  }
+
+  if (file_parser_) // Body was spilled to body_file_
+    return create_spilled_response(req_info);
+
+  Request& req = parser_->get();
+
+  /* Config defines return directive, ignore all other processing and create
+     appropriate response. Validation offloaded to destination server. */
+  if (config_->ret)
+    return create_return_response(req, req_info);
+  return create_response(req, req_info, body_file_); // Request is complete
+}
+
+
+/// Logs a read error and closes the session.
+void session_base::handle_read_error(const error_code& error){
+  if (error == http::error::end_of_stream || error == error::eof)
     /* Client sends EOF when closed or keep-alive times out.
        Expected behavior, log as info rather than error and shut down. */
     close(0, "Keep-alive connection closed by client, shutting down.");
+  else if (error == http::error::partial_message)
+    // Client closed the connection partway through sending a request.
+    close(1, "Client disconnected before completing request, shutting down.");
   else if (error == ssl::error::stream_truncated)
     /* Many HTTP clients do not exchange SSL shutdown notifications correctly.
        Log as info rather than error and shut down. */
@@ -105,7 +243,9 @@ void session_base::handle_read(const error_code& error, size_t bytes){
 
 /* Overload 1 of 2:
    Create an error response to a given status code. */
-void session_base::create_response(int status){
+Response* session_base::create_response(int status,
+                                        const std::string& received,
+                                        Log::req_info& req_info){
   Response* res = new Response();
   res->result(status); // Set response status code to specified error status
   res->version(11);
@@ -119,50 +259,74 @@ void session_base::create_response(int status){
     case 403: // Forbidden
       Analytics::inst().malicious++;
       summary = "(Forbidden)";
-      invalid = proc_invalid_req(total_received_data_);
+      invalid = proc_invalid_req(received);
       break;
     default:
       Analytics::inst().invalid++;
       summary = "(Invalid)";
-      invalid = proc_invalid_req(total_received_data_);
+      invalid = proc_invalid_req(received);
   }
 
-  // Initializer list for request info struct for logging
-  Log::req_info req_info = {total_received_data_.length(), summary, invalid};
-
-  do_write(res, req_info); // Continue to write response
+  // Fill in request info struct for logging, moving strings rather than copying
+  req_info = {received_bytes_, std::move(summary), std::move(invalid)};
+  return res;
 }
 
 
 /* Overload 2 of 2:
    Create a response to a request that parsed successfully (may not be valid!)
    For a valid request, dispatches a RequestHandler to create the response.
-   For an invalid request, create an error response and log the request. */
-void session_base::create_response(Request& req){
+   For an invalid request, create an error response and log the request.
+   body_file is the path of the spilled body, "" if it is in req.body(). */
+Response* session_base::create_response(Request& req,
+                                        Log::req_info& req_info,
+                                        const std::string& body_file){
   int req_error = verify_req(req); // Returns 0 if request valid, else err code
 
-  if (req_error) // Invalid request
-    create_response(req_error); // Create error response for given status code
-  else{ // Valid request, dispatch a request handler to obtain response
-    RequestHandler* handler = dispatch(req, config_);
-    Response* res = handler->handle_request(req);
-    delete handler; // Free memory used by request handler
+  if (req_error){ // Invalid request
+    std::ostringstream received; // Reconstruct request for logging
+    received << req;
+    return create_response(req_error, received.str(), req_info);
+  }
 
-    std::string summary = req.method_string(); // Must convert string_view to
-    summary += " " + std::string(req.target()); // string before adding target
+  // Valid request, dispatch a request handler to obtain response
+  RequestHandler* handler = dispatch(req, config_.get());
+  handler->init_body_file(body_file); // "" unless the body was spilled
+  Response* res = handler->handle_request(req);
+  delete handler; // Free memory used by request handler
+#ifdef ENABLE_HTTP3
+  // Clients switch to HTTP/3 for later requests, or stay here if UDP is blocked
+  if (config_->quic_port)
+    res->set(http::field::alt_svc, "h3=\":" + std::to_string(config_->quic_port) +
+                                   "\"; ma=86400");
+#endif
 
-    // Initializer list for request info struct for logging
-    Log::req_info req_info = {total_received_data_.length(), summary, ""};
+  std::string summary = req.method_string(); // Must convert string_view to
+  summary += " " + std::string(req.target()); // string before adding target
 
-    do_write(res, req_info); // Continue to write response
-  }
-  /* Invalid request invokes create_response(int) which calls do_write(...),
-     so we simply allow it to fall through and end this branch here. */
+  // Fill in request info struct for logging, moving strings rather than copying
+  req_info = {received_bytes_, std::move(summary), ""};
+  return res;
+}
+
+
+/// Creates a response to a request whose body was spilled to body_file_.
+Response* session_base::create_spilled_response(Log::req_info& req_info){
+  // Close the file so the handler reads the whole body, and keep the header
+  http::request<http::file_body> spilled = file_parser_->release();
+  spilled.body().close();
+  Request req(std::move(spilled.base())); // Empty req.body()
+
+  Response* res = config_->ret ? create_return_response(req, req_info) :
+                                 create_response(req, req_info, body_file_);
+  remove_body_file(body_file_); // Handler is done with the body
+  return res;
 }
 
 
 /// Create an appropriate response based on a return directive.
-void session_base::create_return_response(Request& req){
+Response* session_base::create_return_response(Request& req,
+                                               Log::req_info& req_info){
   /* Redirect server doesn't care about validating the request, the request
      will be verified by destination server if applicable. */
 
@@ -192,32 +356,102 @@ void session_base::create_return_response(Request& req){
   std::string summary = req.method_string(); // Must convert string_view to
   summary += " " + std::string(req.target()); // string before adding target
 
-  // Initializer list for request info struct for logging
-  Log::req_info req_info = {total_received_data_.length(), summary, ""};
-
-  do_write(res, req_info); // Continue to write response
+  // Fill in request info struct for logging, moving strings rather than copying
+  req_info = {received_bytes_, std::move(summary), ""};
+  return res;
 }
 
 
-/// Write handler, decides what to do next after writing response to client.
-void session_base::handle_write(const error_code& error, size_t res_bytes,
-                                Response* res, Log::req_info& req_info){
-  int result_int = res->result_int();  // Extract necessary info from HTTP
-  bool keep_alive = res->keep_alive(); // response object before freeing
-  delete res; // Free memory used by HTTP response object
-
-  if (!error){ // Successful write
-    if (keep_alive) // Connection: keep-alive was requested
-      do_read(); // Continue listening for requests (bypasses SSL handshake)
-    else if (result_int == 413) // 413 Payload Too Large
-      close(1, "Client attempted to send an excessive payload, shutting down.");
-    else // Connection: close was requested
-      close(0, "Connection: close specified, shutting down.");
-    // Write machine-parseable formatted log
-    Log::res_metrics(client_ip_, req_info, res_bytes, result_int);
+/** 
+ * Serializes the headers of the queued responses from next onward, and
+ * gathers them with their bodies so they go out in one write (writev). A
+ * response with a body file ends the gather after its headers, the session
+ * then sends the file itself with send_file().
+ *
+ * @param[in,out] next Index of the first response to gather, advanced past
+ *   the last gathered response.
+ * @returns The buffer sequence, valid until the next call or batch_ clears.
+ */
+std::vector<const_buffer>& session_base::prepare_batch(size_t& next){
+  size_t first = next;
+  batch_headers_.clear();
+  while (next < batch_.size()){
+    queued_response& queued = batch_[next++];
+    size_t start = batch_headers_.size();
+    const Response& res = *queued.res;
+    // Same layout as http::serializer: start line, fields, blank line
+    batch_headers_ += "HTTP/" + std::to_string(res.version() / 10) + "." +
+                      std::to_string(res.version() % 10) + " " +
+                      std::to_string(res.result_int()) + " ";
+    batch_headers_.append(res.reason());
+    batch_headers_ += "\r\n";
+    for (const auto& field : res){
+      batch_headers_.append(field.name_string());
+      batch_headers_ += ": ";
+      batch_headers_.append(field.value());
+      batch_headers_ += "\r\n";
+    }
+    batch_headers_ += "\r\n";
+    queued.header_size = batch_headers_.size() - start;
+    if (res.file)
+      break; // Body file must follow its headers, stop gathering here
+  }
+
+  // batch_headers_ no longer grows, so buffers into it stay valid
+  batch_buffers_.clear();
+  const char* header = batch_headers_.data();
+  for (size_t i = first; i < next; i++){
+    queued_response& queued = batch_[i];
+    batch_buffers_.push_back(buffer(header, queued.header_size));
+    header += queued.header_size;
+    if (queued.res->file)
+      continue; // Body is sent by send_file() after these buffers
+    // Cached files are written in place, without a copy
+    const std::string& body = queued.res->shared_body ?
+      *queued.res->shared_body : queued.res->body();
+    if (queued.res->ranges.empty()){
+      if (body.size())
+        batch_buffers_.push_back(buffer(body));
+      continue;
+    }
+    for (const Response::byte_range& range : queued.res->ranges){
+      if (range.prefix.size())
+        batch_buffers_.push_back(buffer(range.prefix));
+      batch_buffers_.push_back(buffer(body.data() + range.offset, range.length));
+    }
+    if (queued.res->ranges_suffix.size())
+      batch_buffers_.push_back(buffer(queued.res->ranges_suffix));
   }
-  else // Error during write
+  return batch_buffers_;
+}
+
+
+/// Decides what to do after writing a batch. Returns true to keep reading.
+bool session_base::handle_write(const error_code& error){
+  if (error){ // Error during write
+    batch_.clear();
     close(2, "Got error \"" + error.message() + "\" while writing response, shutting down.");
+    return false;
+  }
+
+  // Write machine-parseable formatted log for each response in the batch
+  for (queued_response& queued : batch_)
+    Log::res_metrics(client_ip_, queued.req_info,
+                     queued.header_size + queued.res->payload_size(),
+                     queued.res->result_int());
+
+  // Only the last response can close the connection (see pipeline_ready())
+  bool keep_alive = batch_.back().res->keep_alive();
+  int result_int = batch_.back().res->result_int();
+  batch_.clear(); // Free responses, keep capacity for the next batch
+
+  if (keep_alive) // Connection: keep-alive was requested
+    return true; // Continue listening for requests (bypasses SSL handshake)
+  else if (result_int == 413) // 413 Payload Too Large
+    close(1, "Client attempted to send an excessive payload, shutting down.");
+  else // Connection: close was requested
+    close(0, "Connection: close specified, shutting down.");
+  return false;
 }
 
 
@@ -238,18 +472,6 @@ void session_base::close(int severity, const std::string& message){
 }
 
 
-/// Parses a Request object given data received from the client.
-Request parse_req(const std::string& received){
-  Request req;
-  http::parser<true, http::string_body> parser{std::move(req)};
-  error_code ec;
-  parser.eager(true); // Tells parser to read request body for POST requests
-  parser.put(buffer(received, received.length()), ec);
-  req = parser.release();
-  return req;
-}
-
-
 /// Verifies a given Request object. Returns status code if an error is found.
 int verify_req(Request& req){
   http::verb method = req.method();
@@ -268,10 +490,14 @@ int verify_req(Request& req){
     return 403; // 403 Forbidden
   /* These HTML encodings resolve to single '.'s, but it is difficult to
      imagine a legitmate use case for these. Assume the request is malicious
-     if one is present so we don't have to check all possible permutations. */
-  if (req.target().find("%2e") != std::string::npos) [[unlikely]]
+     if one is present so we don't have to check all possible permutations.
+     Hex digits are case-insensitive (%2E too). This only rejects requests
+     early, files are opened beneath their root regardless (see
+     OpenFileCache). */
+  boost::beast::string_view target = req.target();
+  if (boost::ifind_first(target, "%2e")) [[unlikely]]
     return 403; // 403 Forbidden
-  if (req.target().find("%%32%65") != std::string::npos) [[unlikely]]
+  if (boost::ifind_first(target, "%%32%65")) [[unlikely]]
     return 403; // 403 Forbidden
 
   // Verify HTTP version: HTTP/0.9, HTTP/1.0, HTTP/1.1, HTTP/2.0, or HTTP/3.0
@@ -285,10 +511,10 @@ int verify_req(Request& req){
     default:
       return 505; // 505 HTTP Version Not Supported
   }
-  /* Verify POST request has Content-Length header. Payload length limit and
-     matching are already enforced in handle_read, no need to handle here. */
+  /* Verify POST request has a Content-Length header or a chunked body.
+     client_max_body_size and matching are already enforced by the parser. */
   if (method == http::verb::post){
-    if (!req.has_content_length()) [[unlikely]]
+    if (!req.has_content_length() && !req.chunked()) [[unlikely]]
       return 411; // 411 Length Required
   }
   return 0;
@@ -316,6 +542,16 @@ RequestHandler* dispatch(Request& req, Config* config_){
 }
 
 
+/// Deletes a spilled request body, if any, and clears its path.
+void remove_body_file(std::string& body_file){
+  if (body_file.empty())
+    return;
+  error_code ec; // Ignore errors, there is nothing left to clean up
+  fs::remove(body_file, ec);
+  body_file.clear();
+}
+
+
 /// Helper function for invalid request logging.
 /// Converts CRLF characters in received data to keep the log to a single line.
 std::string proc_invalid_req(const std::string& received){
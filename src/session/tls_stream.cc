@@ -0,0 +1,74 @@
+#include "session/tls_stream.h"
+
+using boost::system::error_code;
+
+
+/// Creates the stream and its SSL object.
+tls_stream::tls_stream(const executor_type& executor,
+                       boost::asio::ssl::context& context)
+  : socket_(executor), ssl_(SSL_new(context.native_handle())){
+  if (!ssl_)
+    throw boost::system::system_error(error_code(
+      static_cast<int>(ERR_get_error()), boost::asio::error::get_ssl_category()));
+  // Same modes as boost::asio::ssl::stream, writes may be retried partially
+  SSL_set_mode(ssl_, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                     SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                     SSL_MODE_RELEASE_BUFFERS); // Idle keep-alives free buffers
+}
+
+
+/// Frees the SSL object. The socket closes itself.
+tls_stream::~tls_stream(){
+  SSL_free(ssl_);
+}
+
+
+/// Returns true if the kernel encrypts writes (kTLS).
+bool tls_stream::ktls_send() const{
+#ifndef OPENSSL_NO_KTLS
+  return BIO_get_ktls_send(SSL_get_wbio(ssl_));
+#else
+  return false;
+#endif
+}
+
+
+/// Sends close_notify, without waiting for the client's reply.
+void tls_stream::shutdown(error_code& error){
+  if (failed_ || !SSL_is_init_finished(ssl_))
+    return; // OpenSSL forbids SSL_shutdown after a fatal error
+  ERR_clear_error();
+  int ret = SSL_shutdown(ssl_);
+  if (ret < 0 && SSL_get_error(ssl_, ret) != SSL_ERROR_WANT_WRITE)
+    error = translate_error(ret);
+}
+
+
+/* Binds the SSL object to the accepted socket. With SSL_OP_ENABLE_KTLS, the
+   socket BIO lets OpenSSL install the session keys in the kernel once the
+   handshake completes. If the kernel lacks the tls module, it silently stays
+   in userspace. */
+void tls_stream::attach(){
+  error_code ignored; // Any failure makes SSL_accept fail with an error
+  socket_.non_blocking(true, ignored);
+  SSL_set_fd(ssl_, socket_.native_handle());
+}
+
+
+/// Converts the result of a failed OpenSSL call into an error code.
+error_code tls_stream::translate_error(int result){
+  int ssl_error = SSL_get_error(ssl_, result);
+  if (ssl_error == SSL_ERROR_ZERO_RETURN) // Client sent close_notify
+    return boost::asio::error::eof;
+  failed_ = true;
+  unsigned long error = ERR_get_error();
+  if (ssl_error == SSL_ERROR_SYSCALL && error == 0){
+    if (errno) // e.g., ECONNRESET
+      return error_code(errno, boost::system::system_category());
+    return boost::asio::ssl::error::stream_truncated; // EOF without close_notify
+  }
+  if (ERR_GET_LIB(error) == ERR_LIB_SSL &&
+      ERR_GET_REASON(error) == SSL_R_UNEXPECTED_EOF_WHILE_READING)
+    return boost::asio::ssl::error::stream_truncated;
+  return error_code(static_cast<int>(error), boost::asio::error::get_ssl_category());
+}
\ No newline at end of file
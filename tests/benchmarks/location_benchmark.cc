@@ -0,0 +1,118 @@
+#include <chrono> // steady_clock
+#include <cstdlib> // atoi
+#include <iostream> // cout
+#include <random> // mt19937, uniform_int_distribution
+#include <string>
+#include <vector>
+
+#include "nginx_config_server_block.h" // Config, LocationBlock
+
+/* Location block resolution with thousands of generated location blocks,
+   Config::get_location() against a scan of every block (how it resolved them
+   before LocationTrie). Usage: location_benchmark [locations] [lookups] */
+
+
+/// Resolves req_target by scanning every exact and prefix match block.
+LocationBlock* scan_locations(Config& config, const std::string& req_target){
+  for (LocationBlock* location : config.locations[LocationBlock::ModifierType::EXACT_MATCH])
+    if (req_target == location->uri)
+      return location;
+  LocationBlock* longest_prefix_match = nullptr;
+  LocationBlock* longest_prefix_match_stop = nullptr;
+  for (LocationBlock* location : config.locations[LocationBlock::ModifierType::PREFIX_MATCH_STOP])
+    if (req_target.find(location->uri) == 0 && (longest_prefix_match_stop == nullptr ||
+        location->uri.length() > longest_prefix_match_stop->uri.length()))
+      longest_prefix_match_stop = location;
+  for (LocationBlock* location : config.locations[LocationBlock::ModifierType::NONE])
+    if (req_target.find(location->uri) == 0 && (longest_prefix_match == nullptr ||
+        location->uri.length() > longest_prefix_match->uri.length()))
+      longest_prefix_match = location;
+  if (longest_prefix_match_stop != nullptr && (longest_prefix_match == nullptr ||
+      longest_prefix_match_stop->uri.length() > longest_prefix_match->uri.length()))
+    return longest_prefix_match_stop;
+  return longest_prefix_match;
+}
+
+
+/// Times lookups of every target, returns nanoseconds per lookup.
+template <class Resolve>
+double time_lookups(const std::vector<std::string>& targets, int lookups,
+                    Resolve resolve, size_t& matched){
+  matched = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < lookups; i++)
+    matched += resolve(targets[i % targets.size()]) != nullptr;
+  std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count() / lookups;
+}
+
+
+int main(int argc, char* argv[]){
+  int locations = argc > 1 ? std::atoi(argv[1]) : 5000;
+  int lookups = argc > 2 ? std::atoi(argv[2]) : 200000;
+
+  /* Blocks like a site with many sections: /section<i>/ prefixes, some with
+     ^~ or a nested /section<i>/api/ prefix, and = blocks for some pages. */
+  Config config;
+  std::mt19937 random(42); // Fixed seed, the same blocks and targets every run
+  for (int i = 0; i < locations; i++){
+    LocationBlock* location = new LocationBlock(); // Freed by ~Config
+    switch (i % 4){
+      case 0:
+        location->modifier = LocationBlock::ModifierType::EXACT_MATCH;
+        location->uri = "/section" + std::to_string(i) + "/index.html";
+        break;
+      case 1:
+        location->modifier = LocationBlock::ModifierType::PREFIX_MATCH_STOP;
+        location->uri = "/static/v" + std::to_string(i) + "/";
+        break;
+      case 2:
+        location->uri = "/section" + std::to_string(i - 2) + "/api/";
+        break;
+      default:
+        location->uri = "/section" + std::to_string(i - 3) + "/";
+    }
+    config.locations[location->modifier].push_back(location);
+  }
+  LocationBlock* fallback = new LocationBlock();
+  fallback->uri = "/";
+  config.locations[LocationBlock::ModifierType::NONE].push_back(fallback);
+  config.validate();
+
+  // Targets hit every kind of block, plus some only matched by the fallback
+  std::vector<std::string> targets;
+  std::uniform_int_distribution<int> section(0, locations / 4 - 1);
+  for (int i = 0; i < 1000; i++){
+    std::string id = std::to_string(section(random) * 4);
+    switch (i % 5){
+      case 0: targets.push_back("/section" + id + "/index.html"); break;
+      case 1: targets.push_back("/static/v" + std::to_string(std::stoi(id) + 1) +
+                                "/main.js"); break;
+      case 2: targets.push_back("/section" + id + "/api/users/7"); break;
+      case 3: targets.push_back("/section" + id + "/about/team.html"); break;
+      default: targets.push_back("/unknown/" + id);
+    }
+  }
+
+  // Both must resolve every target to the same block
+  for (const std::string& target : targets){
+    if (config.get_location(target) != scan_locations(config, target)){
+      std::cout << "Mismatch for " << target << "\n";
+      return 1;
+    }
+  }
+
+  size_t scan_matched, trie_matched;
+  double scan_ns = time_lookups(targets, lookups, [&](const std::string& target){
+    return scan_locations(config, target);
+  }, scan_matched);
+  double trie_ns = time_lookups(targets, lookups, [&](const std::string& target){
+    return config.get_location(target);
+  }, trie_matched);
+
+  std::cout << "Locations: " << locations + 1 << ", lookups: " << lookups << "\n"
+            << "Scan       ns/lookup: " << scan_ns << "\n"
+            << "Trie       ns/lookup: " << trie_ns << "\n"
+            << "Speedup:   " << scan_ns / trie_ns << "x\n";
+  return scan_matched == trie_matched ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include <boost/asio.hpp> // io_context, ip::tcp, write
+#include <boost/beast.hpp> // flat_buffer, http::read
+#include <boost/filesystem.hpp> // parent_path, system_complete
+#include <boost/log/core.hpp> // core::set_logging_enabled
+#include <atomic>
+#include <chrono> // steady_clock
+#include <cstdlib> // free, malloc
+#include <iostream> // cout
+#include <memory> // make_shared
+#include <new> // bad_alloc
+#include <thread> // thread
+
+#include "nginx_config_server_block.h" // Config
+#include "server/http_server.h" // http_server
+
+/* Keep-alive request throughput and heap allocations per request for the
+   session pipeline. Usage: session_benchmark [requests] [port] */
+
+namespace http = boost::beast::http;
+using boost::asio::ip::tcp;
+
+// Allocations are only counted on the thread running the server's io_context
+std::atomic<std::thread::id> server_thread_id;
+std::atomic<size_t> server_allocations = 0;
+
+
+void* operator new(size_t size){
+  if (std::this_thread::get_id() == server_thread_id.load(std::memory_order_relaxed))
+    server_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+
+void operator delete(void* ptr) noexcept{
+  std::free(ptr);
+}
+
+
+void operator delete(void* ptr, size_t) noexcept{
+  std::free(ptr);
+}
+
+
+/// Sends one keep-alive GET request and reads the complete response.
+void round_trip(tcp::socket& client, const std::string& request,
+                boost::beast::flat_buffer& buffer){
+  boost::asio::write(client, boost::asio::buffer(request));
+  http::response<http::string_body> res;
+  http::read(client, buffer, res);
+}
+
+
+int main(int argc, char* argv[]){
+  int requests = argc > 1 ? std::atoi(argv[1]) : 20000;
+  unsigned short port = argc > 2 ? std::atoi(argv[2]) : 8090;
+
+  /* Binary is built at <root>/build/bin/session_benchmark, so calling
+     parent_path() thrice from binary lands in the webserver root directory. */
+  std::string root_dir = boost::filesystem::system_complete(argv[0]).
+    parent_path().parent_path().parent_path().string();
+
+  // Per-request logging would dominate the measurement, disable it
+  boost::log::core::get()->set_logging_enabled(false);
+
+  auto config = std::make_shared<Config>(); // Plain HTTP server serving the test frontend
+  config->port = port;
+  config->root = root_dir + "/tests/inputs/";
+  config->index = "small.html";
+  config->validate();
+
+  boost::asio::io_context io_context;
+  http_server server(config, io_context);
+  std::thread server_thread([&io_context]{
+    server_thread_id = std::this_thread::get_id();
+    io_context.run();
+  });
+
+  boost::asio::io_context client_context;
+  tcp::socket client(client_context);
+  client.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+  std::string request = "GET /small.html HTTP/1.1\r\n"
+                        "Host: localhost\r\n"
+                        "Connection: keep-alive\r\n\r\n";
+  boost::beast::flat_buffer buffer;
+
+  for (int i = 0; i < 1000; i++) // Warm up caches and recycled allocations
+    round_trip(client, request, buffer);
+
+  size_t allocations_before = server_allocations.load();
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < requests; i++)
+    round_trip(client, request, buffer);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  size_t allocations = server_allocations.load() - allocations_before;
+
+  std::cout << "Requests:                " << requests << "\n"
+            << "Requests/s:              " << requests / elapsed.count() << "\n"
+            << "Server allocations/req:  " << double(allocations) / requests << "\n";
+
+  client.close();
+  io_context.stop();
+  server_thread.join();
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include <boost/asio.hpp> // io_context, ip::tcp, write
+#include <boost/asio/ssl.hpp> // ssl::context, ssl::stream
+#include <boost/beast.hpp> // flat_buffer, http::read
+#include <boost/filesystem.hpp> // file_size, parent_path, system_complete
+#include <boost/log/core.hpp> // core::set_logging_enabled
+#include <chrono> // steady_clock
+#include <ctime> // clock_gettime
+#include <fstream> // ifstream
+#include <iostream> // cout
+#include <limits> // numeric_limits
+#include <memory> // make_shared
+#include <pthread.h> // pthread_getcpuclockid
+#include <thread> // thread
+
+#include "nginx_config_server_block.h" // Config
+#include "server/https_server.h" // https_server
+
+/* HTTPS static file throughput and server CPU time per GB, with kTLS
+   (SSL_sendfile) and with userspace encryption. Usage:
+   tls_benchmark [requests] [port] */
+
+namespace http = boost::beast::http;
+namespace ssl = boost::asio::ssl;
+using boost::asio::ip::tcp;
+
+
+/// Returns the CPU time (user and kernel) used by a thread, in seconds.
+double thread_cpu_seconds(std::thread& thread){
+  clockid_t clock;
+  timespec time{};
+  if (pthread_getcpuclockid(thread.native_handle(), &clock) == 0)
+    clock_gettime(clock, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+
+/// Returns true if the kernel can take over TLS records (tls module loaded).
+bool kernel_tls_available(){
+  std::ifstream ulp("/proc/sys/net/ipv4/tcp_available_ulp");
+  std::string name;
+  while (ulp >> name)
+    if (name == "tls")
+      return true;
+  return false;
+}
+
+
+/// Downloads a file over one keep-alive connection, prints MB/s and CPU/GB.
+void run(std::shared_ptr<Config> config, const std::string& target,
+         int requests, std::uint64_t file_size){
+  boost::asio::io_context io_context;
+  https_server server(config, io_context);
+  std::thread server_thread([&io_context]{
+    io_context.run();
+  });
+
+  ssl::context client_context(ssl::context::tls_client);
+  client_context.set_verify_mode(ssl::verify_none); // Self-signed test cert
+  boost::asio::io_context client_io_context;
+  ssl::stream<tcp::socket> client(client_io_context, client_context);
+  client.next_layer().connect(
+    tcp::endpoint(boost::asio::ip::address_v4::loopback(), config->port));
+  client.handshake(ssl::stream_base::client);
+  std::string request = "GET " + target + " HTTP/1.1\r\n"
+                        "Host: localhost\r\n"
+                        "Connection: keep-alive\r\n\r\n";
+  boost::beast::flat_buffer buffer;
+
+  auto round_trip = [&]{
+    boost::asio::write(client, boost::asio::buffer(request));
+    http::response_parser<http::string_body> parser;
+    parser.body_limit(std::numeric_limits<std::uint64_t>::max()); // Default is 8 MB
+    http::read(client, buffer, parser);
+  };
+  round_trip(); // Warm up the page cache
+
+  double cpu_before = thread_cpu_seconds(server_thread);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < requests; i++)
+    round_trip();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  double cpu = thread_cpu_seconds(server_thread) - cpu_before;
+  double gigabytes = double(file_size) * requests / 1e9;
+
+  std::cout << (config->ktls ? "kTLS on   " : "kTLS off  ")
+            << "MB/s: " << gigabytes * 1000 / elapsed.count()
+            << "  Server CPU s/GB: " << cpu / gigabytes << "\n";
+
+  boost::system::error_code ec;
+  client.next_layer().close(ec);
+  io_context.stop();
+  server_thread.join();
+}
+
+
+int main(int argc, char* argv[]){
+  int requests = argc > 1 ? std::atoi(argv[1]) : 200;
+  unsigned short port = argc > 2 ? std::atoi(argv[2]) : 8091;
+
+  /* Binary is built at <root>/build/bin/tls_benchmark, so calling
+     parent_path() thrice from binary lands in the webserver root directory. */
+  std::string root_dir = boost::filesystem::system_complete(argv[0]).
+    parent_path().parent_path().parent_path().string();
+
+  // Per-request logging would dominate the measurement, disable it
+  boost::log::core::get()->set_logging_enabled(false);
+
+  auto config = std::make_shared<Config>(); // HTTPS server serving the test frontend
+  config->type = Config::ServerType::HTTPS_SERVER;
+  config->root = root_dir + "/tests/inputs/";
+  config->index = "small.html";
+  config->certificates = {root_dir + "/tests/certs/localhost.crt"};
+  config->private_keys = {root_dir + "/tests/certs/localhost.key"};
+  config->validate();
+  // Larger than FileCache::max_entry_size, so it is always sent from the file
+  std::uint64_t file_size = boost::filesystem::file_size(config->root + "large.html");
+
+  std::cout << "Requests:  " << requests << " x " << file_size << " bytes\n"
+            << "Kernel TLS available: " << (kernel_tls_available() ? "yes" :
+               "no (modprobe tls), both runs encrypt in userspace") << "\n";
+  for (bool ktls : {true, false}){
+    config->ktls = ktls;
+    config->port = port++; // Fresh port, the last one may be in TIME_WAIT
+    run(config, "/large.html", requests, file_size);
+  }
+  return 0;
+}
\ No newline at end of file
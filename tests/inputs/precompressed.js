@@ -0,0 +1,2 @@
+// Placeholder JavaScript bundle for precompressed sidecar tests
+console.log("This is a placeholder JavaScript file for testing purposes.");
\ No newline at end of file
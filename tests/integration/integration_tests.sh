@@ -70,10 +70,27 @@ sleep 0.1 # Give the server time to start up
 # Function call  $1: Expected output file                       $2: Command   $3: Options                                                         $4 Netcat input file (omit for curl)
 integration_test "${FRONTEND_DIR}${FRONTEND_INDEX}"             "curl"        "-k -o $OUTPUT_FILE -s https://localhost:8080/"
 integration_test "${FRONTEND_DIR}${STATIC_TEST_FILE}"           "curl"        "-k -o $OUTPUT_FILE -s https://localhost:8080/${STATIC_TEST_FILE}"
+integration_test "${FRONTEND_DIR}large.html"                     "curl"        "-o $OUTPUT_FILE -s http://localhost:8081/large.html"
+integration_test "${FRONTEND_DIR}precompressed.js.gz"           "curl"        "-o $OUTPUT_FILE -s -H Accept-Encoding:gzip http://localhost:8081/precompressed.js"
+integration_test "tests/nc/outputs/range_small_html.txt"        "curl"        "-k -o $OUTPUT_FILE -s -r 0-14 https://localhost:8080/small.html"
+integration_test "${FRONTEND_DIR}large.html"                     "curl"        "-k -o $OUTPUT_FILE -s --http2 https://localhost:8080/large.html"
+integration_test "tests/nc/outputs/range_small_html.txt"        "curl"        "-k -o $OUTPUT_FILE -s --http2 -r 0-14 https://localhost:8080/small.html"
+# HTTP/3 needs curl with HTTP3 and a server built with -DENABLE_HTTP3=ON, which advertises it with Alt-Svc
+if curl --version | grep -q HTTP3 && curl -k -s -D - -o /dev/null https://localhost:8080/ | grep -qi "^alt-svc: h3"
+then
+  integration_test "${FRONTEND_DIR}large.html"                   "curl"        "-k -o $OUTPUT_FILE -s --http3-only https://localhost:8080/large.html"
+  integration_test "tests/nc/outputs/range_small_html.txt"      "curl"        "-k -o $OUTPUT_FILE -s --http3-only -r 0-14 https://localhost:8080/small.html"
+fi
+integration_test "tests/nc/outputs/range_small_html.txt"        "curl"        "-o $OUTPUT_FILE -s -r 0-14 http://localhost:8081/small.html"
 integration_test "tests/nc/outputs/leave_dir.txt"               "nc"          "localhost 8081"                                                    "tests/nc/inputs/leave_dir.txt"
+integration_test "tests/nc/outputs/leave_dir.txt"               "nc"          "localhost 8081"                                                    "tests/nc/inputs/leave_dir_2.txt"
+integration_test "tests/nc/outputs/leave_dir.txt"               "nc"          "localhost 8081"                                                    "tests/nc/inputs/leave_dir_3.txt"
+integration_test "tests/nc/outputs/leave_dir.txt"               "nc"          "localhost 8081"                                                    "tests/nc/inputs/leave_dir_4.txt"
 integration_test "tests/nc/outputs/invalid_method.txt"          "nc"          "localhost 8081"                                                    "tests/nc/inputs/invalid_method.txt"
+integration_test "tests/nc/outputs/expect_continue_too_large.txt" "nc"         "localhost 8081"                                                    "tests/nc/inputs/expect_continue_too_large.txt"
 integration_test "tests/nc/outputs/redirect_http_to_https.txt"  "nc"          "localhost 8082"                                                    "tests/nc/inputs/redirect_test.txt"
 integration_test "tests/nc/outputs/redirect_same_scheme.txt"    "nc"          "localhost 8083"                                                    "tests/nc/inputs/redirect_test.txt"
+integration_test "tests/nc/outputs/pipelined_redirect.txt"      "nc"          "localhost 8082"                                                    "tests/nc/inputs/pipelined_redirect_test.txt"
 # Function call  $1: Expected output file                       $2: Command   $3: Options                                                         $4 Netcat input file (omit for curl)
 
 kill $WEBSERVER_PID # Shut down web server after all tests have finished. Also ends any netcat background processes that are still alive.
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include <boost/asio/io_context.hpp> // io_context
+#include <boost/filesystem.hpp> // copy_file, current_path, temp_directory_path
+#include <openssl/evp.h> // EVP_PKEY_get_base_id
+#include <openssl/ssl.h> // SSL_CTX_get0_privatekey
+#include <chrono> // milliseconds, steady_clock
+
+#include "gtest/gtest.h"
+#include "nginx_config_server_block.h" // Config
+#include "server/certificate_reloader.h" // certificate_reloader
+
+namespace fs = boost::filesystem;
+
+
+class CertificateReloaderTest : public ::testing::Test{
+protected:
+  fs::path certs_dir;
+  fs::path dir;
+  boost::asio::io_context io_context; // Outlives reloader
+  std::shared_ptr<certificate_reloader> reloader;
+
+  void SetUp() override{ // Set up test fixture
+    /* Unit tests are run in webserver/build/Testing/Temporary,
+       so 3 directories up from current_path lands in the webserver root. */
+    certs_dir = fs::current_path().parent_path().parent_path().parent_path() /
+      "tests" / "certs";
+    dir = fs::temp_directory_path() / fs::unique_path("certificate-reloader-test-%%%%-%%%%");
+    fs::create_directories(dir);
+    install("localhost.crt", "localhost.key");
+
+    std::shared_ptr<Config> config = std::make_shared<Config>();
+    config->type = Config::HTTPS_SERVER;
+    config->certificates = {(dir / "server.crt").string()};
+    config->private_keys = {(dir / "server.key").string()};
+    reloader = certificate_reloader::get(config, io_context);
+  }
+  void TearDown() override{ // Clean up test fixture once done
+    reloader.reset();
+    fs::remove_all(dir);
+  }
+
+  /// Writes a certificate and key from tests/certs over the watched pair.
+  void install(const std::string& certificate, const std::string& key){
+    fs::copy_file(certs_dir / certificate, dir / "server.crt",
+                  fs::copy_options::overwrite_existing);
+    fs::copy_file(certs_dir / key, dir / "server.key",
+                  fs::copy_options::overwrite_existing);
+  }
+
+  /// Runs the IO context until the context changes or timeout passes.
+  std::shared_ptr<tls_context> wait(std::shared_ptr<tls_context> current,
+                                    std::chrono::milliseconds timeout){
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (reloader->context() == current &&
+           std::chrono::steady_clock::now() < deadline)
+      io_context.run_for(std::chrono::milliseconds(100));
+    return reloader->context();
+  }
+};
+
+
+/// Swaps in a context with the new pair once the files are rewritten.
+TEST_F(CertificateReloaderTest, Reload){ // Uses test fixture
+  std::shared_ptr<tls_context> current = reloader->context();
+  ASSERT_NE(current, nullptr);
+  io_context.run_for(std::chrono::milliseconds(100)); // Starts watching
+
+  install("localhost_ecdsa.crt", "localhost_ecdsa.key");
+  std::shared_ptr<tls_context> reloaded = wait(current, std::chrono::seconds(5));
+  ASSERT_NE(reloaded, current);
+  EVP_PKEY* key = SSL_CTX_get0_privatekey(reloaded->ssl().native_handle());
+  ASSERT_NE(key, nullptr);
+  EXPECT_EQ(EVP_PKEY_get_base_id(key), EVP_PKEY_EC);
+}
+
+
+/// Keeps the current context while the certificate doesn't match its key.
+TEST_F(CertificateReloaderTest, ReloadMismatched){ // Uses test fixture
+  std::shared_ptr<tls_context> current = reloader->context();
+  io_context.run_for(std::chrono::milliseconds(100)); // Starts watching
+
+  install("localhost_ecdsa.crt", "localhost.key");
+  // Longer than reload_delay_ms, so that the reload was attempted
+  EXPECT_EQ(wait(current, std::chrono::milliseconds(2500)), current);
+}
\ No newline at end of file
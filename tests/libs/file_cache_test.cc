@@ -0,0 +1,287 @@
+#include <boost/asio/io_context.hpp> // io_context
+#include <boost/filesystem.hpp> // temp_directory_path, unique_path
+#include <boost/filesystem/fstream.hpp> // ofstream
+#include <chrono> // milliseconds
+#include <fcntl.h> // open
+#include <sys/stat.h> // stat
+#include <unistd.h> // close, symlink
+
+#include "file_cache.h" // FileCache
+#include "gtest/gtest.h"
+#include "open_file_cache.h" // OpenFileCache
+
+namespace fs = boost::filesystem;
+
+
+class FileCacheTest : public ::testing::Test{
+protected:
+  fs::path dir;
+
+  void SetUp() override{ // Set up test fixture
+    dir = fs::temp_directory_path() / fs::unique_path("file-cache-test-%%%%-%%%%");
+    fs::create_directories(dir);
+    FileCache::inst().max_size(1048576);
+  }
+  void TearDown() override{ // Clean up test fixture once done
+    FileCache::inst().unwatch();
+    FileCache::inst().max_size(0); // Disable and empty the cache
+    fs::remove_all(dir);
+  }
+
+  /// Writes a file and returns its normalized path.
+  std::string write(const std::string& name, const std::string& contents){
+    fs::path path = dir / name;
+    fs::ofstream(path) << contents;
+    return path.lexically_normal().string();
+  }
+
+  /// Returns an entry for the file as it is on disk now.
+  FileCache::Entry entry(const std::string& path, const std::string& contents){
+    struct stat info;
+    ::stat(path.c_str(), &info);
+    return {std::make_shared<const std::string>(contents), "text/html", "",
+            info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec};
+  }
+};
+
+
+/// Returns the same shared buffer on every hit.
+TEST_F(FileCacheTest, InsertFind){ // Uses test fixture
+  std::string path = write("a.html", "hello");
+  FileCache::Entry a = entry(path, "hello");
+
+  EXPECT_EQ(FileCache::inst().find(path), nullptr); // Miss before insert
+  EXPECT_TRUE(FileCache::inst().insert(path, a));
+  ASSERT_NE(FileCache::inst().find(path), nullptr);
+  EXPECT_EQ(FileCache::inst().find(path)->body, a.body);
+  EXPECT_EQ(FileCache::inst().size(), 5);
+}
+
+
+/// Caches nothing with a budget of 0 (the default).
+TEST_F(FileCacheTest, Disabled){ // Uses test fixture
+  FileCache::inst().max_size(0);
+  std::string path = write("a.html", "hello");
+
+  EXPECT_FALSE(FileCache::inst().insert(path, entry(path, "hello")));
+  EXPECT_EQ(FileCache::inst().find(path), nullptr);
+}
+
+
+/// Rejects files larger than max_entry_size, which are sent with sendfile.
+TEST_F(FileCacheTest, TooLarge){ // Uses test fixture
+  FileCache::inst().max_size(4 * FileCache::max_entry_size);
+  std::string contents(FileCache::max_entry_size + 1, 'x');
+  std::string path = write("large.html", contents);
+
+  EXPECT_FALSE(FileCache::inst().insert(path, entry(path, contents)));
+}
+
+
+/// Evicts the least recently used entry once the budget is exceeded.
+TEST_F(FileCacheTest, EvictLeastRecentlyUsed){ // Uses test fixture
+  FileCache::inst().max_size(10);
+  std::string a = write("a.html", "aaaa");
+  std::string b = write("b.html", "bbbb");
+  std::string c = write("c.html", "cccc");
+
+  EXPECT_TRUE(FileCache::inst().insert(a, entry(a, "aaaa")));
+  EXPECT_TRUE(FileCache::inst().insert(b, entry(b, "bbbb")));
+  FileCache::inst().find(a); // a is now more recently used than b
+  EXPECT_TRUE(FileCache::inst().insert(c, entry(c, "cccc")));
+
+  EXPECT_NE(FileCache::inst().find(a), nullptr);
+  EXPECT_EQ(FileCache::inst().find(b), nullptr); // Evicted
+  EXPECT_NE(FileCache::inst().find(c), nullptr);
+  EXPECT_EQ(FileCache::inst().size(), 8);
+}
+
+
+/// Rejects an entry whose file changed after it was read.
+TEST_F(FileCacheTest, StaleInsert){ // Uses test fixture
+  std::string path = write("a.html", "hello");
+  FileCache::Entry stale = entry(path, "hello");
+  write("a.html", "goodbye");
+
+  EXPECT_FALSE(FileCache::inst().insert(path, stale));
+}
+
+
+/// Without inotify, misses once the file changes on disk.
+TEST_F(FileCacheTest, ChangedFileStat){ // Uses test fixture
+  std::string path = write("a.html", "hello");
+  EXPECT_TRUE(FileCache::inst().insert(path, entry(path, "hello")));
+
+  write("a.html", "goodbye");
+  EXPECT_EQ(FileCache::inst().find(path), nullptr);
+  EXPECT_EQ(FileCache::inst().size(), 0);
+}
+
+
+/// With inotify, drops the entry once the change event is read.
+TEST_F(FileCacheTest, ChangedFileInotify){ // Uses test fixture
+  boost::asio::io_context io_context;
+  ASSERT_TRUE(FileCache::inst().watch(io_context));
+  std::string path = write("a.html", "hello");
+  EXPECT_TRUE(FileCache::inst().insert(path, entry(path, "hello")));
+
+  write("a.html", "hello"); // Same size, possibly even the same mtime
+  for (int i = 0; i < 100 && FileCache::inst().size(); i++)
+    io_context.run_one_for(std::chrono::milliseconds(10));
+  EXPECT_EQ(FileCache::inst().find(path), nullptr);
+
+  FileCache::inst().unwatch(); // Before io_context is destroyed
+}
+
+
+/// Memoizes validators per file version, regardless of the byte budget.
+TEST_F(FileCacheTest, Metadata){ // Uses test fixture
+  FileCache::inst().max_size(0);
+  std::string path = write("a.html", "hello");
+  struct stat info;
+  ::stat(path.c_str(), &info);
+  std::string etag, last_modified;
+
+  EXPECT_FALSE(FileCache::inst().find_metadata(path, info, etag, last_modified));
+  FileCache::inst().insert_metadata(path, info, "\"1\"", "date");
+  EXPECT_TRUE(FileCache::inst().find_metadata(path, info, etag, last_modified));
+  EXPECT_EQ(etag, "\"1\"");
+  EXPECT_EQ(last_modified, "date");
+
+  write("a.html", "goodbye"); // New version, the memo no longer applies
+  ::stat(path.c_str(), &info);
+  EXPECT_FALSE(FileCache::inst().find_metadata(path, info, etag, last_modified));
+  FileCache::inst().clear();
+}
+
+
+class OpenFileCacheTest : public ::testing::Test{
+protected:
+  fs::path dir;
+  int root_fd = -1;
+
+  void SetUp() override{ // Set up test fixture
+    dir = fs::temp_directory_path() / fs::unique_path("open-file-cache-test-%%%%-%%%%");
+    fs::create_directories(dir);
+    root_fd = ::open(dir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    OpenFileCache::inst().configure(100, std::chrono::seconds(60),
+                                    std::chrono::seconds(60), true);
+  }
+  void TearDown() override{ // Clean up test fixture once done
+    OpenFileCache::inst().configure(0, std::chrono::seconds(60),
+                                    std::chrono::seconds(60), false);
+    ::close(root_fd);
+    fs::remove_all(dir);
+  }
+
+  /// Looks up a path beneath dir.
+  std::shared_ptr<const OpenFileCache::File> find(const std::string& path){
+    return OpenFileCache::inst().find(root_fd, path, dir.string().size());
+  }
+
+  /// Writes a file and returns its path.
+  std::string write(const std::string& name, const std::string& contents){
+    fs::path path = dir / name;
+    fs::ofstream(path) << contents;
+    return path.string();
+  }
+};
+
+
+/// Opens regular files once and reuses the descriptor while valid.
+TEST_F(OpenFileCacheTest, Find){ // Uses test fixture
+  std::string path = write("a.html", "hello");
+
+  auto file = find(path);
+  EXPECT_TRUE(file->exists);
+  EXPECT_FALSE(file->directory);
+  ASSERT_NE(file->body, nullptr);
+  EXPECT_EQ(file->body->size(), 5);
+  EXPECT_EQ(find(path), file); // Hit
+
+  fs::remove(path); // Not noticed within the validity period
+  EXPECT_TRUE(find(path)->exists);
+
+  auto directory = find(dir.string());
+  EXPECT_TRUE(directory->directory);
+  EXPECT_EQ(directory->body, nullptr);
+}
+
+
+/// Caches missing paths only with open_file_cache_errors on.
+TEST_F(OpenFileCacheTest, Errors){ // Uses test fixture
+  std::string path = (dir / "a.html").string();
+  EXPECT_FALSE(find(path)->exists);
+  write("a.html", "hello");
+  EXPECT_FALSE(find(path)->exists); // Cached miss
+
+  OpenFileCache::inst().configure(100, std::chrono::seconds(60),
+                                  std::chrono::seconds(60), false);
+  OpenFileCache::inst().clear();
+  std::string missing = (dir / "b.html").string();
+  EXPECT_FALSE(find(missing)->exists);
+  EXPECT_EQ(OpenFileCache::inst().size(), 0);
+  write("b.html", "hello");
+  EXPECT_TRUE(find(missing)->exists);
+}
+
+
+/// Checks entries on disk once the validity period ends.
+TEST_F(OpenFileCacheTest, Revalidate){ // Uses test fixture
+  OpenFileCache::inst().configure(100, std::chrono::seconds(60),
+                                  std::chrono::seconds(0), true);
+  std::string path = write("a.html", "hello");
+
+  auto file = find(path);
+  EXPECT_EQ(find(path)->body, file->body); // Unchanged
+
+  write("a.html", "goodbye");
+  auto changed = find(path);
+  ASSERT_NE(changed->body, nullptr);
+  EXPECT_NE(changed->body, file->body); // Reopened
+  EXPECT_EQ(changed->body->size(), 7);
+
+  fs::remove(path);
+  EXPECT_FALSE(find(path)->exists);
+}
+
+
+/// Drops the least recently used paths beyond max, or all if max is 0.
+TEST_F(OpenFileCacheTest, Evict){ // Uses test fixture
+  OpenFileCache::inst().configure(2, std::chrono::seconds(60),
+                                  std::chrono::seconds(60), true);
+  std::string a = write("a.html", "aaaa");
+  std::string b = write("b.html", "bbbb");
+  std::string c = write("c.html", "cccc");
+
+  auto file = find(a);
+  find(b);
+  find(a); // a is now more recently used than b
+  find(c);
+  EXPECT_EQ(OpenFileCache::inst().size(), 2);
+  EXPECT_EQ(find(a), file); // Still cached
+
+  OpenFileCache::inst().configure(0, std::chrono::seconds(60),
+                                  std::chrono::seconds(60), true);
+  EXPECT_EQ(OpenFileCache::inst().size(), 0);
+  EXPECT_TRUE(find(a)->exists); // Looked up uncached
+  EXPECT_EQ(OpenFileCache::inst().size(), 0);
+}
+
+
+/// Refuses paths resolving outside of the root, through ".." or symlinks.
+TEST_F(OpenFileCacheTest, Beneath){ // Uses test fixture
+  fs::path outside = dir.parent_path() / (dir.filename().string() + "-outside");
+  fs::ofstream(outside) << "secret";
+  ::symlink(outside.c_str(), (dir / "link.html").c_str());
+  ::symlink("a.html", (dir / "alias.html").c_str());
+  write("a.html", "hello");
+
+  std::string escape = dir.string() + "/../" + outside.filename().string();
+  EXPECT_FALSE(find(escape)->exists);
+  EXPECT_FALSE(find((dir / "link.html").string())->exists);
+  EXPECT_TRUE(find((dir / "alias.html").string())->exists); // Stays beneath
+  EXPECT_FALSE(OpenFileCache::inst().find(-1, (dir / "a.html").string(),
+                                          dir.string().size())->exists);
+  fs::remove(outside);
+}
\ No newline at end of file
@@ -1,16 +1,25 @@
 #include <boost/filesystem.hpp> // current_path, parent_path, path
+#include <fstream> // ifstream
 #include <iomanip> // put_time
 #include <memory> // std::unique_ptr
+#include <sys/stat.h> // stat
 
+#include "file_cache.h" // FileCache
 #include "file_request_handler.h" // FileRequestHandler
 #include "gtest/gtest.h"
 #include "nginx_config_parser.h" // Config, ConfigParser
 
 
+std::string get_body(Response res); // Helper function
 std::string get_content_length(Response res); // Helper function
 std::string get_content_type(Response res); // Helper function
+std::string get_header(Response res, boost::beast::http::field field); // Helper function
+std::string read_file(const std::string& path); // Helper function
 // Uses implementation from file_request_handler.cc
 std::string last_modified_time(boost::filesystem::path file_obj);
+std::uint64_t xxh64(const char* data, size_t size, std::uint64_t seed);
+bool hash_file(boost::beast::http::file_body::value_type& file, struct stat& info,
+               std::string& etag, std::uint64_t max_size);
 
 
 class FileRequestHandlerTest : public ::testing::Test{
@@ -76,7 +85,7 @@ TEST_F(FileRequestHandlerTest, ConnectionClose){ // Uses test fixture
     std::to_string(index_contents.length()));
   EXPECT_EQ(get_content_type(*res), "text/html");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -101,7 +110,7 @@ TEST_F(FileRequestHandlerTest, Create){ // Uses test fixture
     std::to_string(index_contents.length()));
   EXPECT_EQ(get_content_type(*res), "text/html");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
   free(created_handler); // Free memory used by created FileRequestHandler
   factory.reset(); // Free memory used by unique_ptr
 }
@@ -123,7 +132,7 @@ TEST_F(FileRequestHandlerTest, ServeDir){ // Uses test fixture
     std::to_string(index_contents.length()));
   EXPECT_EQ(get_content_type(*res), "text/html");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -149,7 +158,7 @@ TEST_F(FileRequestHandlerTest, ServeInaccessible){ // Uses test fixture
   EXPECT_EQ(get_content_type(*res), "text/html");
 
   chmod(file_path.c_str(), 0644); // Make file accessible again
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -167,7 +176,7 @@ TEST_F(FileRequestHandlerTest, ServeLarge){ // Uses test fixture
   EXPECT_EQ(get_content_length(*res), "1068184"); // Length of large.html
   EXPECT_EQ(get_content_type(*res), "text/html"); // Type of large.html
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -187,7 +196,7 @@ TEST_F(FileRequestHandlerTest, ServeNonexistent){ // Uses test fixture
     std::to_string(index_contents.length()));
   EXPECT_EQ(get_content_type(*res), "text/html");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -205,7 +214,7 @@ TEST_F(FileRequestHandlerTest, ServeOctetStream){ // Uses test fixture
   EXPECT_EQ(get_content_length(*res), "27"); // Length of octet_stream
   EXPECT_EQ(get_content_type(*res), "application/octet-stream"); // Type of octet_stream
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -230,7 +239,31 @@ TEST_F(FileRequestHandlerTest, ValidateCache){ // Uses test fixture
   // Content-Type should not be set when body is empty
   EXPECT_EQ(get_content_type(*res), "");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
+}
+
+
+/// Serves repeated requests from one shared buffer once FileCache is enabled.
+TEST_F(FileRequestHandlerTest, ServeCached){ // Uses test fixture
+  FileCache::inst().max_size(1048576); // Disabled unless set by server_main
+
+  Response* miss = file_request_handler->handle_request(req);
+  Response* hit = file_request_handler->handle_request(req);
+
+  EXPECT_EQ(hit->result_int(), 200); // 200 OK
+  EXPECT_TRUE(hit->keep_alive()); // Connection: Keep-Alive
+
+  // Both responses share the cached contents of small.html
+  ASSERT_TRUE(hit->shared_body);
+  EXPECT_EQ(hit->shared_body, miss->shared_body);
+  EXPECT_EQ(get_body(*hit), index_contents);
+  EXPECT_EQ(get_content_length(*hit),
+    std::to_string(index_contents.length()));
+  EXPECT_EQ(get_content_type(*hit), "text/html");
+
+  FileCache::inst().max_size(0); // Disable and empty the cache for other tests
+  delete miss; // Free memory used by created responses
+  delete hit;
 }
 
 
@@ -258,7 +291,7 @@ TEST_F(FileRequestHandlerTest, ExactMatchNoTryFiles){ // Uses test fixture
     std::to_string(index_contents.length()));
   EXPECT_EQ(get_content_type(*res), "text/html");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -283,23 +316,21 @@ TEST_F(FileRequestHandlerTest, StopModifiers){ // Uses test fixture
   // Content-Type should not be set when body is empty
   EXPECT_EQ(get_content_type(*res), "");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
 /** Tests the case where the longest prefix match location block has no stop
-  * modifier. Additionally tests the exception case thrown when the try_files
-  * fallback parameter is a non-integer HTTP status code.
+  * modifier.
   */
 TEST_F(FileRequestHandlerTest, LongestMatchNoModifier){ // Uses test fixture
   /* Will match "location ^~ /stopmod" which returns status 500, and also match
-     "location /stopmodnone" which has no stop modifier and returns status aaa.
-     Status aaa throws exception at lexical cast and sets status 0. */
+     "location /stopmodnone" which has no stop modifier and returns status 403. */
   req.target("/stopmodnone");
 
   Response* res = file_request_handler->handle_request(req);
 
-  EXPECT_EQ(res->result_int(), 0); // 0 Unknown
+  EXPECT_EQ(res->result_int(), 403); // 403 Forbidden
   EXPECT_EQ(res->version(), 11); // HTTP/1.1
   EXPECT_TRUE(res->keep_alive()); // Connection: Keep-Alive
 
@@ -309,7 +340,7 @@ TEST_F(FileRequestHandlerTest, LongestMatchNoModifier){ // Uses test fixture
   // Content-Type should not be set when body is empty
   EXPECT_EQ(get_content_type(*res), "");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -333,13 +364,32 @@ TEST_F(FileRequestHandlerTest, TryFilesNonVariableMatch){ // Uses test fixture
     std::to_string(index_contents.length()));
   EXPECT_EQ(get_content_type(*res), "text/html");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
 // File serving without location blocks testing (switches to config 1)
 
 
+/** Tests the case where a regex match location block wins over the longest
+  * prefix match, which has no stop modifier. Its root replaces only the leading
+  * slash of the target.
+  */
+TEST_F(FileRequestHandlerTest, RegexMatch){ // Uses test fixture
+  /* Will match "location /" and "location ~* \.conf$", which serves files from
+     tests/inputs/configs instead of falling back to small.html. */
+  req.target("/basic_defaults.conf");
+  Config* config = ConfigParser::inst().configs().at(0);
+
+  Response* res = file_request_handler->handle_request(req);
+
+  EXPECT_EQ(res->result_int(), 200); // 200 OK
+  EXPECT_EQ(get_body(*res), read_file(config->root + "configs/basic_defaults.conf"));
+
+  delete res; // Free memory used by created response
+}
+
+
 /// Serves index page correctly when config does not define location blocks
 TEST_F(FileRequestHandlerTest, NoLocationBlocksSmall){ // Uses test fixture
   // Set file request handler to use config 1 which has no location blocks
@@ -352,13 +402,16 @@ TEST_F(FileRequestHandlerTest, NoLocationBlocksSmall){ // Uses test fixture
   EXPECT_EQ(res->version(), 11); // HTTP/1.1
   EXPECT_TRUE(res->keep_alive()); // Connection: Keep-Alive
 
+  // Config 1 is plain HTTP, so the body is sent from the file (sendfile)
+  EXPECT_TRUE(res->file);
+  EXPECT_EQ(res->body(), "");
   // For default target /, body should contain index (small.html)
-  EXPECT_EQ(res->body(), index_contents);
+  EXPECT_EQ(get_body(*res), index_contents);
   EXPECT_EQ(get_content_length(*res),
     std::to_string(index_contents.length()));
   EXPECT_EQ(get_content_type(*res), "text/html");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -374,11 +427,304 @@ TEST_F(FileRequestHandlerTest, NoLocationBlocksOctetStream){ // Uses test fixtur
   EXPECT_EQ(res->version(), 11); // HTTP/1.1
   EXPECT_TRUE(res->keep_alive()); // Connection: Keep-Alive
 
-  EXPECT_EQ(res->body(), "This file has no extension!"); // Contents of octet_stream
+  EXPECT_TRUE(res->file); // Config 1 is plain HTTP, body is sent from file
+  EXPECT_EQ(get_body(*res), "This file has no extension!"); // Contents of octet_stream
   EXPECT_EQ(get_content_length(*res), "27"); // Length of octet_stream
   EXPECT_EQ(get_content_type(*res), "application/octet-stream"); // Type of octet_stream
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
+}
+
+
+/// Percent-decodes the target and ignores its query string to find the file
+TEST_F(FileRequestHandlerTest, DecodedTarget){ // Uses test fixture
+  // Set file request handler to use config 1 which has no location blocks
+  file_request_handler->init_config(ConfigParser::inst().configs().at(1));
+
+  req.target("/%6fctet%5Fstream?v=%2e%2e"); // /octet_stream, query not decoded
+  Response* res = file_request_handler->handle_request(req);
+
+  EXPECT_EQ(res->result_int(), 200); // 200 OK
+  EXPECT_EQ(get_body(*res), "This file has no extension!"); // Contents of octet_stream
+  EXPECT_EQ(get_content_type(*res), "application/octet-stream"); // Type of octet_stream
+
+  delete res; // Free memory used by created response
+}
+
+
+/// Serves 400 for a target with an invalid or NUL escape
+TEST_F(FileRequestHandlerTest, DecodedTargetInvalid){ // Uses test fixture
+  file_request_handler->init_config(ConfigParser::inst().configs().at(1));
+
+  for (const char* target : {"/small.html%", "/small%zz.html", "/small.html%00"}){
+    req.target(target);
+    Response* res = file_request_handler->handle_request(req);
+    EXPECT_EQ(res->result_int(), 400) << target; // 400 Bad Request
+    delete res; // Free memory used by created response
+  }
+}
+
+
+/// Serves the Brotli sidecar of a file when the client accepts br.
+TEST_F(FileRequestHandlerTest, PrecompressedBrotli){ // Uses test fixture
+  // Set file request handler to use config 1 (gzip_static and brotli_static on)
+  Config* config = ConfigParser::inst().configs().at(1);
+  file_request_handler->init_config(config);
+
+  req.target("/precompressed.js");
+  req.set(boost::beast::http::field::accept_encoding, "gzip, deflate, br");
+  Response* res = file_request_handler->handle_request(req);
+
+  EXPECT_EQ(res->result_int(), 200); // 200 OK
+  EXPECT_EQ(get_body(*res), read_file(config->root + "precompressed.js.br"));
+  EXPECT_EQ(get_header(*res, boost::beast::http::field::content_encoding), "br");
+  EXPECT_EQ(get_header(*res, boost::beast::http::field::vary), "Accept-Encoding");
+  // Content-Type is that of the requested file, not the sidecar
+  EXPECT_EQ(get_content_type(*res), "text/javascript");
+
+  delete res; // Free memory used by created response
+}
+
+
+/// Serves the gzip sidecar of a file when the client doesn't accept br.
+TEST_F(FileRequestHandlerTest, PrecompressedGzip){ // Uses test fixture
+  // Set file request handler to use config 1 (gzip_static and brotli_static on)
+  Config* config = ConfigParser::inst().configs().at(1);
+  file_request_handler->init_config(config);
+
+  req.target("/precompressed.js");
+  req.set(boost::beast::http::field::accept_encoding, "gzip;q=0.8, br;q=0");
+  Response* res = file_request_handler->handle_request(req);
+
+  EXPECT_EQ(res->result_int(), 200); // 200 OK
+  EXPECT_EQ(get_body(*res), read_file(config->root + "precompressed.js.gz"));
+  EXPECT_EQ(get_header(*res, boost::beast::http::field::content_encoding), "gzip");
+  EXPECT_EQ(get_header(*res, boost::beast::http::field::vary), "Accept-Encoding");
+  EXPECT_EQ(get_content_type(*res), "text/javascript");
+
+  delete res; // Free memory used by created response
+}
+
+
+/// Serves the uncompressed file when the client accepts no encoding.
+TEST_F(FileRequestHandlerTest, PrecompressedNotAccepted){ // Uses test fixture
+  // Set file request handler to use config 1 (gzip_static and brotli_static on)
+  Config* config = ConfigParser::inst().configs().at(1);
+  file_request_handler->init_config(config);
+
+  req.target("/precompressed.js");
+  Response* res = file_request_handler->handle_request(req);
+
+  EXPECT_EQ(res->result_int(), 200); // 200 OK
+  EXPECT_EQ(get_body(*res), read_file(config->root + "precompressed.js"));
+  EXPECT_EQ(get_header(*res, boost::beast::http::field::content_encoding), "");
+  // Caches must still key on Accept-Encoding
+  EXPECT_EQ(get_header(*res, boost::beast::http::field::vary), "Accept-Encoding");
+
+  delete res; // Free memory used by created response
+}
+
+
+/// Serves "206 Partial Content" with one range of the file.
+TEST_F(FileRequestHandlerTest, RangeSingle){ // Uses test fixture
+  req.set(boost::beast::http::field::range, "bytes=0-14");
+  Response* res = file_request_handler->handle_request(req);
+
+  EXPECT_EQ(res->result_int(), 206); // 206 Partial Content
+  EXPECT_EQ(get_body(*res), "<!DOCTYPE html>"); // First 15 bytes of small.html
+  EXPECT_EQ(get_content_length(*res), "15");
+  EXPECT_EQ(get_header(*res, boost::beast::http::field::content_range),
+    "bytes 0-14/" + std::to_string(index_contents.length()));
+  EXPECT_EQ(get_content_type(*res), "text/html");
+  EXPECT_EQ(get_header(*res, boost::beast::http::field::accept_ranges), "bytes");
+
+  delete res; // Free memory used by created response
+}
+
+
+/// Serves several ranges of the file as a multipart/byteranges body.
+TEST_F(FileRequestHandlerTest, RangeMultipart){ // Uses test fixture
+  // Set file request handler to use config 1 (plain HTTP, sent with sendfile)
+  file_request_handler->init_config(ConfigParser::inst().configs().at(1));
+  req.set(boost::beast::http::field::range, "bytes=0-0, -1");
+  Response* res = file_request_handler->handle_request(req);
+
+  EXPECT_EQ(res->result_int(), 206); // 206 Partial Content
+  std::string content_type = get_content_type(*res);
+  std::string boundary = "multipart/byteranges; boundary=";
+  ASSERT_EQ(content_type.find(boundary), 0);
+  boundary = content_type.substr(boundary.length());
+
+  std::string last = std::to_string(index_contents.length() - 1);
+  std::string size = std::to_string(index_contents.length());
+  EXPECT_EQ(get_body(*res),
+    "\r\n--" + boundary + "\r\nContent-Type: text/html\r\n"
+    "Content-Range: bytes 0-0/" + size + "\r\n\r\n<"
+    "\r\n--" + boundary + "\r\nContent-Type: text/html\r\n"
+    "Content-Range: bytes " + last + "-" + last + "/" + size + "\r\n\r\n>"
+    "\r\n--" + boundary + "--\r\n");
+  EXPECT_EQ(get_content_length(*res), std::to_string(get_body(*res).length()));
+
+  delete res; // Free memory used by created response
+}
+
+
+/// Serves "416 Range Not Satisfiable" for ranges past the end of the file.
+TEST_F(FileRequestHandlerTest, RangeNotSatisfiable){ // Uses test fixture
+  req.set(boost::beast::http::field::range, "bytes=100000-");
+  Response* res = file_request_handler->handle_request(req);
+
+  EXPECT_EQ(res->result_int(), 416); // 416 Range Not Satisfiable
+  EXPECT_EQ(get_body(*res), "");
+  EXPECT_EQ(get_content_length(*res), "0");
+  EXPECT_EQ(get_header(*res, boost::beast::http::field::content_range),
+    "bytes */" + std::to_string(index_contents.length()));
+
+  delete res; // Free memory used by created response
+}
+
+
+/// Serves the whole file if the Range header is invalid or If-Range mismatches.
+TEST_F(FileRequestHandlerTest, RangeIgnored){ // Uses test fixture
+  req.set(boost::beast::http::field::range, "bytes=5-2"); // Last before first
+  Response* res = file_request_handler->handle_request(req);
+  EXPECT_EQ(res->result_int(), 200); // 200 OK
+  EXPECT_EQ(get_body(*res), index_contents);
+  delete res;
+
+  req.set(boost::beast::http::field::range, "bytes=0-14");
+  req.set(boost::beast::http::field::if_range, "Thu, 01 Jan 1970 00:00:00 GMT");
+  res = file_request_handler->handle_request(req);
+  EXPECT_EQ(res->result_int(), 200); // 200 OK, file changed since that date
+  EXPECT_EQ(get_body(*res), index_contents);
+  delete res; // Free memory used by created response
+}
+
+
+/// Serves a strong ETag, and "304 Not Modified" to If-None-Match with it.
+TEST_F(FileRequestHandlerTest, ETagRevalidate){ // Uses test fixture
+  Response* res = file_request_handler->handle_request(req);
+  EXPECT_EQ(res->result_int(), 200); // 200 OK
+  std::string etag = get_header(*res, boost::beast::http::field::etag);
+  EXPECT_EQ(etag.length(), 18); // 16 hex digits in double quotes
+  EXPECT_EQ(etag.front(), '"');
+  delete res;
+
+  req.set(boost::beast::http::field::if_none_match, "\"0\", W/" + etag);
+  res = file_request_handler->handle_request(req);
+  EXPECT_EQ(res->result_int(), 304); // 304 Not Modified, weak comparison
+  EXPECT_EQ(get_header(*res, boost::beast::http::field::etag), etag);
+  EXPECT_EQ(get_body(*res), "");
+  delete res;
+
+  // If-None-Match takes precedence over a matching If-Modified-Since
+  Config* config = ConfigParser::inst().configs().at(0);
+  req.set(boost::beast::http::field::if_modified_since,
+          last_modified_time(config->root + config->index));
+  req.set(boost::beast::http::field::if_none_match, "\"0000000000000000\"");
+  res = file_request_handler->handle_request(req);
+  EXPECT_EQ(res->result_int(), 200); // 200 OK, client has another version
+  EXPECT_EQ(get_body(*res), index_contents);
+  delete res; // Free memory used by created response
+}
+
+
+/// Serves "304 Not Modified" from FileCache, for If-None-Match or "*".
+TEST_F(FileRequestHandlerTest, ETagRevalidateCached){ // Uses test fixture
+  FileCache::inst().max_size(1048576); // Disabled unless set by server_main
+
+  Response* res = file_request_handler->handle_request(req);
+  std::string etag = get_header(*res, boost::beast::http::field::etag);
+  delete res;
+
+  for (const std::string& tag : {etag, std::string("*")}){
+    req.set(boost::beast::http::field::if_none_match, tag);
+    res = file_request_handler->handle_request(req);
+    EXPECT_EQ(res->result_int(), 304) << tag; // 304 Not Modified
+    EXPECT_EQ(get_header(*res, boost::beast::http::field::etag), etag);
+    EXPECT_EQ(get_body(*res), "");
+    delete res;
+  }
+
+  FileCache::inst().max_size(0); // Disable and empty the cache for other tests
+}
+
+
+/// Serves "304 Not Modified" to If-Modified-Since without If-None-Match.
+TEST_F(FileRequestHandlerTest, LastModifiedRevalidate){ // Uses test fixture
+  Response* res = file_request_handler->handle_request(req);
+  std::string last_modified = get_header(*res, boost::beast::http::field::last_modified);
+  delete res;
+
+  req.set(boost::beast::http::field::if_modified_since, last_modified);
+  res = file_request_handler->handle_request(req);
+  EXPECT_EQ(res->result_int(), 304); // 304 Not Modified
+  EXPECT_EQ(get_body(*res), "");
+  delete res; // Free memory used by created response
+}
+
+
+/// Hashes with XXH64, matching the reference implementation's test vectors.
+TEST(FileRequestHandlerHashTest, XXH64KnownAnswers){
+  auto hash = [](const std::string& data, std::uint64_t seed){
+    return xxh64(data.data(), data.size(), seed);
+  };
+  EXPECT_EQ(hash("", 0), 0xEF46DB3751D8E999ULL);
+  EXPECT_EQ(hash("a", 0), 0xD24EC4F1A98C6E5BULL);
+  EXPECT_EQ(hash("abc", 0), 0x44BC2CF5AD770999ULL);
+  EXPECT_EQ(hash("xxhash", 0), 0x32DD38952C4BC720ULL);
+  EXPECT_EQ(hash("xxhash", 20141025), 0xB559B98D844E0635ULL); // Seeded
+  // Over 32 bytes, so also hashed in 32 byte stripes
+  EXPECT_EQ(hash("Nobody inspects the spammish repetition", 0), 0xFBCEA83C8A378BF1ULL);
+}
+
+
+/// Tags files by their hash, or by mtime and size if over max_size.
+TEST_F(FileRequestHandlerTest, ETagHash){ // Uses test fixture
+  Response* res = file_request_handler->handle_request(req);
+  EXPECT_EQ(get_header(*res, boost::beast::http::field::etag), "\"f25f60533835075f\"");
+  delete res; // Free memory used by created response
+
+  Config* config = ConfigParser::inst().configs().at(0);
+  boost::beast::http::file_body::value_type file;
+  boost::system::error_code ec;
+  file.open((config->root + "large.html").c_str(), boost::beast::file_mode::scan, ec);
+  ASSERT_FALSE(ec);
+  struct stat info;
+  std::string etag;
+  // Hashed in 64 KiB chunks, each seeded with the hash of those before it
+  EXPECT_TRUE(hash_file(file, info, etag, FileRequestHandler::hash_max_size));
+  EXPECT_EQ(etag, "\"10d22cc8c60bac3a\"");
+
+  // Not read, so the IO thread isn't blocked by a large file
+  EXPECT_TRUE(hash_file(file, info, etag, info.st_size - 1));
+  char expected[36];
+  std::snprintf(expected, sizeof(expected), "\"%llx-%llx\"",
+                static_cast<unsigned long long>(info.st_mtim.tv_sec) * 1000000000ULL +
+                  info.st_mtim.tv_nsec,
+                static_cast<unsigned long long>(info.st_size));
+  EXPECT_EQ(etag, expected);
+}
+
+
+/// Serves "206 Partial Content" if If-Range has the current ETag.
+TEST_F(FileRequestHandlerTest, ETagIfRange){ // Uses test fixture
+  Response* res = file_request_handler->handle_request(req);
+  std::string etag = get_header(*res, boost::beast::http::field::etag);
+  delete res;
+
+  req.set(boost::beast::http::field::range, "bytes=0-14");
+  req.set(boost::beast::http::field::if_range, etag);
+  res = file_request_handler->handle_request(req);
+  EXPECT_EQ(res->result_int(), 206); // 206 Partial Content
+  EXPECT_EQ(get_body(*res), "<!DOCTYPE html>");
+  delete res;
+
+  req.set(boost::beast::http::field::if_range, "W/" + etag); // Never matches
+  res = file_request_handler->handle_request(req);
+  EXPECT_EQ(res->result_int(), 200); // 200 OK
+  EXPECT_EQ(get_body(*res), index_contents);
+  delete res; // Free memory used by created response
 }
 
 
@@ -400,7 +746,25 @@ TEST_F(FileRequestHandlerTest, NoLocationBlocks404){ // Uses test fixture
   // Content-Type should not be set when body is empty
   EXPECT_EQ(get_content_type(*res), "");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
+}
+
+
+/// Helper function to extract the body as sent, wherever the response stores it
+std::string get_body(Response res){
+  std::string body = res.shared_body ? *res.shared_body : res.body();
+  if (res.file){
+    body.resize(res.file->size());
+    boost::system::error_code ec;
+    res.file->file().seek(0, ec);
+    res.file->file().read(body.data(), body.size(), ec);
+  }
+  if (res.ranges.empty())
+    return body;
+  std::string sent; // Only the requested ranges are sent
+  for (const Response::byte_range& range : res.ranges)
+    sent += range.prefix + body.substr(range.offset, range.length);
+  return sent + res.ranges_suffix;
 }
 
 
@@ -423,4 +787,22 @@ std::string get_content_type(Response res){
   catch (std::out_of_range){
     return "";
   }
+}
+
+
+/// Helper function to extract any header, "" if not set
+std::string get_header(Response res, boost::beast::http::field field){
+  try{
+    return res.at(field);
+  }
+  catch (std::out_of_range){
+    return "";
+  }
+}
+
+
+/// Helper function to read a whole file, e.g. to compare with a body
+std::string read_file(const std::string& path){
+  std::ifstream file(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(file), {});
 }
\ No newline at end of file
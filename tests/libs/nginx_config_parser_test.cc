@@ -73,9 +73,105 @@ TEST_F(NginxConfigParserTest, BasicDefaults){ // Uses test fixture
 }
 
 
+TEST_F(NginxConfigParserTest, BasicReparse){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_worker_threads.conf"));
+  std::vector<std::shared_ptr<Config>> snapshot = ConfigParser::inst().snapshot();
+
+  // A second parse replaces the configs, like a reload
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "basic_defaults.conf"));
+  EXPECT_EQ(ConfigParser::inst().configs().size(), 1);
+  EXPECT_EQ(ConfigParser::inst().configs().at(0)->port, 80);
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "basic_empty_invalid.conf"));
+
+  // The snapshot of the first parse is unaffected
+  ASSERT_EQ(snapshot.size(), 1);
+  EXPECT_EQ(snapshot.at(0)->port, 8080);
+  EXPECT_EQ(snapshot.at(0)->root, expected_root);
+}
+
+
 // Argument testing
 
 
+TEST_F(NginxConfigParserTest, ArgsClientMaxBodySize){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_client_max_body_size.conf"));
+  Config* config = ConfigParser::inst().configs().at(0); // Extract first parsed config
+  EXPECT_EQ(config->client_max_body_size, 8 * 1024 * 1024);
+
+  // Location blocks override (0 disables the limit) or inherit the server value
+  EXPECT_EQ(config->get_location("/upload/file")->client_max_body_size, 0);
+  EXPECT_EQ(config->get_location("/index.html")->client_max_body_size, 8 * 1024 * 1024);
+
+  // Requests are routed by their decoded path, as FileRequestHandler does
+  EXPECT_EQ(config->body_limit("/%75pload/file?size=1"), 0);
+  EXPECT_EQ(config->body_limit("/upload%zz"), 8 * 1024 * 1024); // Invalid, 400
+
+  // Default is 1m
+  config = ConfigParser::inst().configs().at(1); // Extract second parsed config
+  EXPECT_EQ(config->client_max_body_size, 1024 * 1024);
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsClientMaxBodySizeNegative){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_client_max_body_size_negative_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsClientMaxBodySizeSuffix){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_client_max_body_size_suffix_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsStaticCompression){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_static_compression.conf"));
+  Config* config = ConfigParser::inst().configs().at(0); // Extract parsed config
+  EXPECT_TRUE(config->gzip_static);
+  EXPECT_FALSE(config->brotli_static); // Default is off
+
+  // Location blocks override or inherit the server values
+  EXPECT_FALSE(*config->get_location("/nogzip/main.js")->gzip_static);
+  EXPECT_FALSE(*config->get_location("/nogzip/main.js")->brotli_static);
+  EXPECT_TRUE(*config->get_location("/brotli/main.js")->gzip_static);
+  EXPECT_TRUE(*config->get_location("/brotli/main.js")->brotli_static);
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsStaticCompressionFlag){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_static_compression_flag_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsOpenCacheMaxSize){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_open_cache_max_size.conf"));
+  EXPECT_EQ(ConfigParser::inst().open_cache_max_size(), 16 * 1024 * 1024);
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsOpenCacheMaxSizeInServer){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_open_cache_max_size_in_server_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsOpenFileCache){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_open_file_cache.conf"));
+  EXPECT_EQ(ConfigParser::inst().open_file_cache_max(), 1000);
+  EXPECT_EQ(ConfigParser::inst().open_file_cache_inactive(), 20);
+  EXPECT_EQ(ConfigParser::inst().open_file_cache_valid(), 30);
+  EXPECT_TRUE(ConfigParser::inst().open_file_cache_errors());
+
+  // Off by default
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_open_cache_max_size.conf"));
+  EXPECT_EQ(ConfigParser::inst().open_file_cache_max(), 0);
+  EXPECT_FALSE(ConfigParser::inst().open_file_cache_errors());
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsOpenFileCacheInvalid){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_open_file_cache_no_max_invalid.conf"));
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_open_file_cache_param_invalid.conf"));
+}
+
+
 TEST_F(NginxConfigParserTest, ArgsInHTTPContext){ // Uses test fixture
   EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_in_http_invalid.conf"));
 }
@@ -149,6 +245,99 @@ TEST_F(NginxConfigParserTest, ArgsSSLGood){ // Uses test fixture
   EXPECT_EQ(config->index, expected_index);
   EXPECT_EQ(config->host, "localhost");
   EXPECT_EQ(config->port, 8080);
+  EXPECT_EQ(config->certificates.size(), 1);
+  EXPECT_EQ(config->private_keys.size(), 1);
+  EXPECT_TRUE(config->ktls); // Default is on
+  EXPECT_EQ(config->ssl_session_cache, 0); // Default is off, tickets still resume
+  EXPECT_TRUE(config->ssl_session_tickets);
+  EXPECT_EQ(config->ssl_session_timeout, 15 * 60);
+  EXPECT_EQ(config->ssl_protocols, Config::TLS_V1 | Config::TLS_V1_1 |
+                                   Config::TLS_V1_2 | Config::TLS_V1_3);
+  EXPECT_EQ(config->ssl_ciphers, "HIGH:!aNULL:!MD5");
+  EXPECT_EQ(config->ssl_ecdh_curve, "auto"); // Default
+  EXPECT_FALSE(config->http2); // Default is off, like Nginx
+  EXPECT_EQ(config->quic_port, 0); // No listen quic
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsSSLKtls){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_ssl_ktls.conf"));
+  EXPECT_FALSE(ConfigParser::inst().configs().at(0)->ktls);
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsSSLSession){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_ssl_session.conf"));
+  Config* config = ConfigParser::inst().configs().at(0); // Extract parsed config
+  EXPECT_EQ(config->ssl_session_cache, 4096); // shared:SSL:1m, larger than builtin:1000
+  EXPECT_FALSE(config->ssl_session_tickets);
+  EXPECT_EQ(config->ssl_session_timeout, 15 * 60);
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsSSLSessionCacheInvalid){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_ssl_session_cache_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsSSLSessionTimeoutInvalid){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_ssl_session_timeout_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsSSLProtocols){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_ssl_protocols.conf"));
+  Config* config = ConfigParser::inst().configs().at(0); // Extract parsed config
+  EXPECT_EQ(config->ssl_protocols, Config::TLS_V1_3);
+  EXPECT_EQ(config->ssl_ciphers, "TLS_AES_128_GCM_SHA256:TLS_CHACHA20_POLY1305_SHA256");
+  EXPECT_EQ(config->ssl_ecdh_curve, "X25519:prime256v1");
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsSSLProtocolsInvalid){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_ssl_protocols_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsSSLCertificates){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_ssl_certificates.conf"));
+  Config* config = ConfigParser::inst().configs().at(0); // Extract parsed config
+  std::vector<std::string> expected_certificates = {
+    root_dir + "/tests/certs/localhost.crt",
+    root_dir + "/tests/certs/localhost_ecdsa.crt"
+  };
+  std::vector<std::string> expected_keys = {
+    root_dir + "/tests/certs/localhost.key",
+    root_dir + "/tests/certs/localhost_ecdsa.key"
+  };
+  EXPECT_EQ(config->certificates, expected_certificates);
+  EXPECT_EQ(config->private_keys, expected_keys);
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsSSLCertificatesUnpaired){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_ssl_certificates_unpaired_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsHttp2){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_http2.conf"));
+  Config* config = ConfigParser::inst().configs().at(0); // Extract parsed config
+  EXPECT_TRUE(config->http2);
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsListenQuic){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_listen_quic.conf"));
+  Config* config = ConfigParser::inst().configs().at(0); // Extract parsed config
+  EXPECT_EQ(config->type, Config::ServerType::HTTPS_SERVER);
+  EXPECT_EQ(config->port, 8080); // TCP port of listen ssl is kept
+  EXPECT_EQ(config->quic_port, 8443);
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsListenQuicNonSSL){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_listen_quic_non_ssl_invalid.conf"));
 }
 
 
@@ -167,6 +356,56 @@ TEST_F(NginxConfigParserTest, ArgsUnknownInServer){ // Uses test fixture
 }
 
 
+TEST_F(NginxConfigParserTest, ArgsWorkerMode){ // Uses test fixture
+  // Default worker mode is shared
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "test_config.conf"));
+  EXPECT_EQ(ConfigParser::inst().worker_mode(), ConfigParser::SHARED_WORKERS);
+
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_worker_mode_sharded.conf"));
+  EXPECT_EQ(ConfigParser::inst().worker_mode(), ConfigParser::SHARDED_WORKERS);
+  EXPECT_EQ(ConfigParser::inst().worker_threads(), 2);
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsWorkerModeInvalid){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_worker_mode_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsWorkerThreads){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_worker_threads.conf"));
+  EXPECT_EQ(ConfigParser::inst().worker_threads(), 4);
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsWorkerThreadsAuto){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_worker_threads_auto.conf"));
+  // auto resolves to the hardware thread count, which is always at least 1
+  EXPECT_GE(ConfigParser::inst().worker_threads(), 1);
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsWorkerThreadsString){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_worker_threads_string_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsWorkerThreadsZero){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_worker_threads_zero_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsSSLHandshakeThreads){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_ssl_handshake_threads.conf"));
+  EXPECT_EQ(ConfigParser::inst().ssl_handshake_threads(), 2);
+}
+
+
+TEST_F(NginxConfigParserTest, ArgsSSLHandshakeThreadsNegative){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "args_ssl_handshake_threads_negative_invalid.conf"));
+}
+
+
 // Comments testing
 
 
@@ -254,6 +493,76 @@ TEST_F(NginxConfigParserTest, EscapeWords){ // Uses test fixture
 }
 
 
+// Location resolution testing
+
+
+TEST_F(NginxConfigParserTest, LocationPrecedence){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "location_precedence.conf"));
+  Config* config = ConfigParser::inst().configs().at(0); // Extract parsed config
+
+  EXPECT_EQ(config->get_location("/app")->index, "exact.html"); // = wins
+  EXPECT_EQ(config->get_location("/app/")->index, "first.html"); // First of same URI
+  EXPECT_EQ(config->get_location("/app.html")->index, "app.html"); // Not per path segment
+  EXPECT_EQ(config->get_location("/apple/pie")->index, "apple.html"); // Split edge
+  EXPECT_EQ(config->get_location("/app/assets/a.js")->index, "assets.html"); // ^~ longest
+  // Same length without modifier wins over ^~
+  EXPECT_EQ(config->get_location("/app/static/a.js")->index, "static_no_stop.html");
+  EXPECT_EQ(config->get_location("/ap")->index, "root.html"); // Ends within an edge
+  EXPECT_EQ(config->get_location("/")->index, "root.html");
+}
+
+
+TEST_F(NginxConfigParserTest, LocationRegex){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "location_regex.conf"));
+  Config* config = ConfigParser::inst().configs().at(0); // Extract parsed config
+  EXPECT_EQ(config->locations[LocationBlock::ModifierType::REGEX_MATCH].size(), 3);
+
+  // Regex wins over prefix match without modifier, first regex in config order
+  EXPECT_EQ(config->get_location("/projects/a.ipynb")->index, "notebook.html");
+  EXPECT_EQ(config->get_location("/projects/a.ipynb?v=1")->index, "notebook.html");
+  EXPECT_EQ(config->get_location("/projects/a.IPYNB")->index, "projects.html"); // ~
+  EXPECT_EQ(config->get_location("/img/a.PNG")->index, "image.html"); // ~*
+  EXPECT_EQ(config->get_location("/static/a.png")->index, "static.html"); // ^~ stops
+  EXPECT_EQ(config->get_location("/exact.png")->index, "exact.html"); // = stops
+  EXPECT_EQ(config->get_location("/a.ipynb.bak")->index, "root.html"); // Anchored
+}
+
+
+TEST_F(NginxConfigParserTest, LocationRegexInvalid){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "location_regex_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, LocationTryFilesCompiled){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "location_try_files.conf"));
+  Config* config = ConfigParser::inst().configs().at(0); // Extract parsed config
+
+  // Split at each $uri, root joined to the first segment
+  LocationBlock* location = config->get_location("/");
+  std::vector<std::vector<std::string>> expected_paths = {
+    {expected_root + "/", ""}, {expected_root + "/", ".gz/", ""}};
+  EXPECT_EQ(location->try_files_paths, expected_paths);
+  EXPECT_EQ(location->try_files_fallback_status, -1); // URI fallback
+  EXPECT_EQ(location->try_files_fallback_path, expected_root + "/small.html");
+
+  EXPECT_EQ(config->get_location("/code")->try_files_fallback_status, 404);
+}
+
+
+TEST_F(NginxConfigParserTest, LocationTryFilesCodeInvalid){ // Uses test fixture
+  EXPECT_FALSE(ConfigParser::inst().parse(configs_folder + "location_try_files_code_invalid.conf"));
+}
+
+
+TEST_F(NginxConfigParserTest, LocationNoMatch){ // Uses test fixture
+  EXPECT_TRUE(ConfigParser::inst().parse(configs_folder + "args_location_overrides.conf"));
+  Config* config = ConfigParser::inst().configs().at(0); // Extract parsed config
+
+  EXPECT_EQ(config->get_location("index.html"), nullptr); // No leading slash
+  EXPECT_NE(config->get_location("/index.html"), nullptr);
+}
+
+
 // Quote word testing
 
 
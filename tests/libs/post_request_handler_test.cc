@@ -70,7 +70,7 @@ TEST_F(PostRequestHandlerTest, ConnectionClose){ // Uses test fixture
     std::to_string(default_payload_output.length()));
   EXPECT_EQ(get_content_type(*res), "application/json");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -94,7 +94,7 @@ TEST_F(PostRequestHandlerTest, Create){ // Uses test fixture
     std::to_string(default_payload_output.length()));
   EXPECT_EQ(get_content_type(*res), "application/json");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
   free(created_handler); // Free memory used by created FileRequestHandler
   factory.reset(); // Free memory used by unique_ptr
 }
@@ -125,7 +125,7 @@ TEST_F(PostRequestHandlerTest, DirectoryExitAttack){ // Uses test fixture
     std::to_string(expected_output.length()));
   EXPECT_EQ(get_content_type(*res), "application/json");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -154,7 +154,7 @@ TEST_F(PostRequestHandlerTest, InvalidExecutable){ // Uses test fixture
     std::to_string(expected_output.length()));
   EXPECT_EQ(get_content_type(*res), "application/json");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -181,7 +181,7 @@ TEST_F(PostRequestHandlerTest, JsonParserError){ // Uses test fixture
     std::to_string(expected_output.length()));
   EXPECT_EQ(get_content_type(*res), "application/json");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -208,7 +208,7 @@ TEST_F(PostRequestHandlerTest, PtreeError){ // Uses test fixture
     std::to_string(expected_output.length()));
   EXPECT_EQ(get_content_type(*res), "application/json");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 
@@ -237,7 +237,7 @@ TEST_F(PostRequestHandlerTest, RawInput){ // Uses test fixture
     std::to_string(expected_output.length()));
   EXPECT_EQ(get_content_type(*res), "application/json");
 
-  free(res); // Free memory used by created response
+  delete res; // Free memory used by created response
 }
 
 